@@ -75,8 +75,16 @@
     V(standardGeneric, "standardGeneric")                                      \
     SIMPLE_INSTRUCTIONS(SYMBOLS_SIMPLE_INSTRUCTION_V, V)                       \
     V(UseMethod, "UseMethod")                                                  \
+    V(DotGeneric, ".Generic")                                                  \
+    V(DotClass, ".Class")                                                      \
+    V(DotMethod, ".Method")                                                    \
+    V(DotGroup, ".Group")                                                      \
+    V(DotGenericCallEnv, ".GenericCallEnv")                                    \
+    V(DotGenericDefEnv, ".GenericDefEnv")                                      \
+    V(S3MethodsTable, ".__S3MethodsTable__.")                                  \
     V(sysframe, "sys.frame")                                                   \
     V(syscall, "sys.call")                                                     \
+    V(warnPartialMatchArgs, "warnPartialMatchArgs")                            \
     V(srcref, "srcref")                                                        \
     V(ambiguousCallTarget, ".ambiguousCallTarget.")                            \
     V(delayedArglist, ".delayedArglist.")                                      \
@@ -14,12 +14,14 @@
 #include "compiler/translations/pir_2_rir/pir_2_rir.h"
 #include "compiler/translations/rir_2_pir/rir_2_pir.h"
 #include "compiler/translations/rir_2_pir/rir_2_pir_compiler.h"
+#include "interpreter/alloc_profiler.h"
 #include "interpreter/interp_incl.h"
 #include "ir/BC.h"
 #include "ir/Compiler.h"
 
 #include <list>
 #include <memory>
+#include <sstream>
 #include <string>
 
 using namespace rir;
@@ -271,6 +273,20 @@ REXPORT SEXP rir_invocation_count(SEXP what) {
     return res;
 }
 
+REXPORT SEXP rir_context_free(SEXP what) {
+    if (!isValidClosureSEXP(what)) {
+        Rf_error("not a compiled closure");
+    }
+    auto dt = DispatchTable::check(BODY(what));
+    assert(dt);
+
+    SEXP res = Rf_allocVector(LGLSXP, dt->size());
+    for (size_t i = 0; i < dt->size(); ++i)
+        LOGICAL(res)[i] = dt->get(i)->signature().contextFree;
+
+    return res;
+}
+
 REXPORT SEXP pir_compile(SEXP what, SEXP name, SEXP debugFlags,
                          SEXP debugStyle) {
     if (debugFlags != R_NilValue &&
@@ -322,8 +338,13 @@ REXPORT SEXP pir_check(SEXP f, SEXP checksSxp, SEXP env) {
     if (TYPEOF(checksSxp) != LISTSXP)
         Rf_error("pir_check: 2nd parameter must be a pairlist (of symbols)");
     std::list<PirCheck::Type> checkTypes;
+    std::list<std::pair<PirCheck::Type, unsigned>> checkBounds;
     for (SEXP c = checksSxp; c != R_NilValue; c = CDR(c)) {
         SEXP checkSxp = CAR(c);
+        // Quantitative checks are passed as tagged bounds, e.g. MaxEnvs=0
+        bool bounded = TAG(c) != R_NilValue;
+        if (bounded)
+            checkSxp = TAG(c);
         if (TYPEOF(checkSxp) != SYMSXP)
             Rf_error("pir_check: each item in 2nd parameter must be a symbol");
         PirCheck::Type type = PirCheck::parseType(CHAR(PRINTNAME(checkSxp)));
@@ -331,14 +352,29 @@ REXPORT SEXP pir_check(SEXP f, SEXP checksSxp, SEXP env) {
             Rf_error("pir_check: invalid check type. List of check types:"
 #define V(Check) "\n    " #Check
                      LIST_OF_PIR_CHECKS(V)
+#undef V
+#define V(Check) "\n    " #Check "=<n>"
+                     LIST_OF_PIR_QUANTITATIVE_CHECKS(V)
 #undef V
             );
-        checkTypes.push_back(type);
+        if (PirCheck::isQuantitative(type) != bounded)
+            Rf_error("pir_check: %s %s", CHAR(PRINTNAME(checkSxp)),
+                     bounded ? "does not take a bound"
+                             : "needs a bound, e.g. MaxEnvs=0");
+        if (bounded) {
+            int bound = Rf_asInteger(CAR(c));
+            if (bound == NA_INTEGER || bound < 0)
+                Rf_error("pir_check: bound of %s must be a non-negative integer",
+                         CHAR(PRINTNAME(checkSxp)));
+            checkBounds.push_back({type, (unsigned)bound});
+        } else {
+            checkTypes.push_back(type);
+        }
     }
     // Automatically compile rir for convenience (necessary to get PIR)
     if (!isValidClosureSEXP(f))
         rir_compile(f, env);
-    PirCheck check(checkTypes);
+    PirCheck check(checkTypes, checkBounds);
     bool res = check.run(f);
     return res ? R_TrueValue : R_FalseValue;
 }
@@ -399,6 +435,19 @@ REXPORT SEXP rir_deserialize(SEXP fileSexp) {
     return res;
 }
 
+REXPORT SEXP rir_printAllocationProfile(SEXP reset) {
+    if (!AllocationProfiler::enabled())
+        Rf_warning("allocation profiling is disabled, set "
+                   "RIR_PROFILE_ALLOCATIONS=1 to enable it");
+    std::stringstream out;
+    AllocationProfiler::instance().print(out);
+    Rprintf("%s", out.str().c_str());
+    if (Rf_asLogical(reset) == TRUE)
+        AllocationProfiler::instance().reset();
+    R_Visible = (Rboolean) false;
+    return R_NilValue;
+}
+
 bool startup() {
     initializeRuntime();
     return true;
@@ -26,5 +26,6 @@ extern SEXP rirOptDefaultOptsDryrun(SEXP closure, const rir::Assumptions&,
                                     SEXP name);
 REXPORT SEXP rir_serialize(SEXP data, SEXP file);
 REXPORT SEXP rir_deserialize(SEXP file);
+REXPORT SEXP rir_printAllocationProfile(SEXP reset);
 
 #endif // API_H_
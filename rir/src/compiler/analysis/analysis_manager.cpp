@@ -0,0 +1,43 @@
+#include "analysis_manager.h"
+#include "../pir/pir_impl.h"
+
+namespace rir {
+namespace pir {
+
+const CFG& AnalysisManager::cfg(Code* code) {
+    auto& res = cfgs[code];
+    if (!res)
+        res.reset(new CFG(code));
+    return *res;
+}
+
+const DominanceGraph& AnalysisManager::dominance(Code* code) {
+    auto& res = doms[code];
+    if (!res)
+        res.reset(new DominanceGraph(code));
+    return *res;
+}
+
+const DominanceFrontier& AnalysisManager::dominanceFrontier(Code* code) {
+    auto& res = dfronts[code];
+    if (!res)
+        res.reset(new DominanceFrontier(code, cfg(code), dominance(code)));
+    return *res;
+}
+
+const LoopDetection& AnalysisManager::loops(Code* code) {
+    auto& res = loops_[code];
+    if (!res)
+        res.reset(new LoopDetection(code, cfg(code), dominance(code), true));
+    return *res;
+}
+
+void AnalysisManager::invalidate() {
+    cfgs.clear();
+    doms.clear();
+    dfronts.clear();
+    loops_.clear();
+}
+
+} // namespace pir
+} // namespace rir
@@ -0,0 +1,46 @@
+#ifndef PIR_ANALYSIS_MANAGER_H
+#define PIR_ANALYSIS_MANAGER_H
+
+#include "../util/cfg.h"
+#include "loop_detection.h"
+
+#include <memory>
+#include <unordered_map>
+
+namespace rir {
+namespace pir {
+
+/*
+ * Caches analyses of a ClosureVersion (and its promises), which only depend
+ * on the shape of the control flow graph. Results are computed on first use
+ * and stay valid until invalidate() is called.
+ *
+ * The pass scheduler invalidates the cache after every pass which changed the
+ * version, unless the pass declares that it preserves the CFG (ie. it never
+ * adds or removes basic blocks or edges). Since the cache is only cleared
+ * between passes, a pass which changes the CFG must not query the manager
+ * after it started modifying the code. Dataflow analyses (eg. scope analysis
+ * or available checkpoints) depend on the instructions and are not cached,
+ * but they should be built on top of the cached CFG.
+ */
+class AnalysisManager {
+  public:
+    const CFG& cfg(Code* code);
+    const DominanceGraph& dominance(Code* code);
+    const DominanceFrontier& dominanceFrontier(Code* code);
+    // Loops are always computed including their nesting
+    const LoopDetection& loops(Code* code);
+
+    void invalidate();
+
+  private:
+    std::unordered_map<Code*, std::unique_ptr<CFG>> cfgs;
+    std::unordered_map<Code*, std::unique_ptr<DominanceGraph>> doms;
+    std::unordered_map<Code*, std::unique_ptr<DominanceFrontier>> dfronts;
+    std::unordered_map<Code*, std::unique_ptr<LoopDetection>> loops_;
+};
+
+} // namespace pir
+} // namespace rir
+
+#endif
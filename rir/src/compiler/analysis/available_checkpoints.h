@@ -40,6 +40,10 @@ class FwdAvailableCheckpoints
     Checkpoint* at(Instruction* i) {
         return StaticAnalysis::at<PositioningStyle::BeforeInstruction>(i).get();
     }
+
+    Checkpoint* after(Instruction* i) {
+        return StaticAnalysis::at<PositioningStyle::AfterInstruction>(i).get();
+    }
 };
 
 class RwdAvailableCheckpoints
@@ -62,13 +66,12 @@ class RwdAvailableCheckpoints
 };
 
 class AvailableCheckpoints {
-    CFG cfg;
     FwdAvailableCheckpoints fwd;
     RwdAvailableCheckpoints rwd;
 
   public:
-    AvailableCheckpoints(ClosureVersion* cls, LogStream& log)
-        : cfg(cls), fwd(cls, log), rwd(cls, cfg, log) {}
+    AvailableCheckpoints(ClosureVersion* cls, const CFG& cfg, LogStream& log)
+        : fwd(cls, log), rwd(cls, cfg, log) {}
 
     Checkpoint* at(Instruction* i) { return fwd.at(i); }
     Checkpoint* next(Instruction* i) { return rwd.at(i); }
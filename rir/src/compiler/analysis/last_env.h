@@ -18,8 +18,8 @@ class LastEnv : public StaticAnalysis<AbstractUnique<Value>> {
             state.set(i->env());
             return AbstractResult::Updated;
         }
-        // pop_context_ does not restore env
-        if (state.get() && PopContext::Cast(i)) {
+        // pop_context_ and pop_loop_context_ do not restore env
+        if (state.get() && (PopContext::Cast(i) || PopLoopContext::Cast(i))) {
             state.clear();
             return AbstractResult::Updated;
         }
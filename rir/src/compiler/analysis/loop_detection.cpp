@@ -4,9 +4,11 @@
 namespace rir {
 namespace pir {
 
-LoopDetection::LoopDetection(Code* code, bool determineNesting) {
-    CFG cfg(code);
-    DominanceGraph dom(code);
+LoopDetection::LoopDetection(Code* code, bool determineNesting)
+    : LoopDetection(code, CFG(code), DominanceGraph(code), determineNesting) {}
+
+LoopDetection::LoopDetection(Code* code, const CFG& cfg,
+                             const DominanceGraph& dom, bool determineNesting) {
     // map of header nodes to tail nodes
     std::unordered_map<BB*, BBList> tailNodes;
 
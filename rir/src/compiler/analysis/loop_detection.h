@@ -70,7 +70,7 @@ class LoopDetection {
          * TODO: finds a preheader when there is one.
          * We should create a preheader when there is non.
          */
-        BB* preheader(const CFG& cfg) {
+        BB* preheader(const CFG& cfg) const {
             BBList outOfLoopPredecessor;
             for (const auto& pred : cfg.immediatePredecessors(header())) {
                 if (!body_.count(pred))
@@ -105,6 +105,8 @@ class LoopDetection {
     };
 
     LoopDetection(Code* code, bool determineNesting = false);
+    LoopDetection(Code* code, const CFG& cfg, const DominanceGraph& dom,
+                  bool determineNesting = false);
 
     LoopDetection(const LoopDetection&) = delete;
     LoopDetection& operator=(const LoopDetection&) = delete;
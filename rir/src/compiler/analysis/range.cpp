@@ -0,0 +1,443 @@
+#include "range.h"
+#include "R/Funtab.h"
+#include "R/r.h"
+
+#include <algorithm>
+#include <climits>
+
+namespace rir {
+namespace pir {
+
+// Vector lengths are never negative
+bool Bound::provablyLe(const Bound& a, const Bound& b) {
+    if (!a.bounded || !b.bounded)
+        return false;
+    if (a.length == b.length)
+        return a.offset <= b.offset;
+    if (!a.length)
+        return a.offset <= b.offset;
+    return false;
+}
+
+void Bound::print(std::ostream& out) const {
+    if (!bounded) {
+        out << "inf";
+        return;
+    }
+    if (length) {
+        out << "len(";
+        length->printRef(out);
+        out << ")";
+        if (offset > 0)
+            out << "+" << offset;
+        else if (offset < 0)
+            out << offset;
+        return;
+    }
+    out << offset;
+}
+
+Range Range::join(const Range& o) const {
+    if (!known || !o.known)
+        return Range();
+    Range r;
+    r.known = true;
+    if (lo.bounded && o.lo.bounded) {
+        // min(len(a)+x, len(b)+y) >= min(x, y)
+        if (lo.length == o.lo.length)
+            r.lo = Bound::lengthOf(lo.length, std::min(lo.offset, o.lo.offset));
+        else
+            r.lo = Bound::constant(std::min(lo.offset, o.lo.offset));
+    }
+    if (hi.bounded && o.hi.bounded && hi.length == o.hi.length)
+        r.hi = Bound::lengthOf(hi.length, std::max(hi.offset, o.hi.offset));
+    return r;
+}
+
+Range Range::widen(const Range& old) const {
+    if (!known || !old.known)
+        return *this;
+    Range r = *this;
+    if (lo != old.lo)
+        r.lo = Bound();
+    if (hi != old.hi)
+        r.hi = Bound();
+    return r;
+}
+
+void Range::print(std::ostream& out) const {
+    if (!known) {
+        out << "?";
+        return;
+    }
+    out << "[";
+    if (lo.bounded)
+        lo.print(out);
+    else
+        out << "-inf";
+    out << ", ";
+    hi.print(out);
+    out << "]";
+}
+
+static Value* canonical(Value* v) {
+    while (true) {
+        auto next = v->followCastsAndForce();
+        if (auto cp = PirCopy::Cast(next))
+            next = cp->arg<0>().val();
+        if (next == v)
+            return v;
+        v = next;
+    }
+}
+
+Range RangeState::rangeOf(Value* v) const {
+    auto r = ranges.find(canonical(v));
+    if (r == ranges.end())
+        return Range();
+    return r->second;
+}
+
+Value* RangeState::lengthOf(Value* v) const {
+    v = canonical(v);
+    auto l = sameLength.find(v);
+    if (l == sameLength.end())
+        return v;
+    return l->second;
+}
+
+bool RangeState::inBounds(Value* vec, Value* idx) const {
+    auto r = rangeOf(idx);
+    return r.known && Bound::provablyLe(Bound::constant(1), r.lo) &&
+           Bound::provablyLe(r.hi, Bound::lengthOf(lengthOf(vec)));
+}
+
+AbstractResult RangeState::merge(const RangeState& other) {
+    AbstractResult res;
+
+    for (auto& r : other.ranges) {
+        auto mine = ranges.find(r.first);
+        if (mine == ranges.end()) {
+            ranges.emplace(r);
+            res.update();
+        } else {
+            auto joined = mine->second.join(r.second);
+            if (joined != mine->second) {
+                mine->second = joined;
+                res.lostPrecision();
+            }
+        }
+    }
+
+    for (auto& l : other.sameLength) {
+        auto mine = sameLength.find(l.first);
+        if (mine == sameLength.end()) {
+            sameLength.emplace(l);
+            res.update();
+        } else if (mine->second != l.second && mine->second != l.first) {
+            mine->second = l.first;
+            res.lostPrecision();
+        }
+    }
+
+    // Equal branches are harmless, a successor with a single predecessor is
+    // only ever reached through the same edge, and in all other blocks the
+    // branch is ignored.
+    if (branch != other.branch && branch) {
+        branch = nullptr;
+        res.update();
+    }
+
+    return res;
+}
+
+void RangeState::print(std::ostream& out, bool tty) const {
+    for (auto& r : ranges) {
+        r.first->printRef(out);
+        out << " in ";
+        r.second.print(out);
+        out << "\n";
+    }
+    for (auto& l : sameLength) {
+        if (l.first == l.second)
+            continue;
+        out << "len(";
+        l.first->printRef(out);
+        out << ") = len(";
+        l.second->printRef(out);
+        out << ")\n";
+    }
+}
+
+static void setRange(RangeState& state, Value* v, const Range& r,
+                     AbstractResult& res) {
+    auto old = state.ranges.find(v);
+    if (old == state.ranges.end()) {
+        state.ranges.emplace(v, r);
+        res.update();
+    } else if (old->second != r) {
+        old->second = r;
+        res.update();
+    }
+}
+
+static void setLength(RangeState& state, Value* v, Value* length,
+                      AbstractResult& res) {
+    auto old = state.sameLength.find(v);
+    if (old == state.sameLength.end()) {
+        state.sameLength.emplace(v, length);
+        res.update();
+    } else if (old->second != length) {
+        old->second = length;
+        res.update();
+    }
+}
+
+static bool isSeqAlong(Value* v) {
+    static int seqAlong = findBuiltin("seq_along");
+    if (auto b = CallBuiltin::Cast(v))
+        return b->builtinId == seqAlong && b->nCallArgs() == 1;
+    if (auto b = CallSafeBuiltin::Cast(v))
+        return b->builtinId == seqAlong && b->nCallArgs() == 1;
+    return false;
+}
+
+// Values which always get an entry in RangeState::ranges when the analysis
+// reaches them. A missing entry means that they were not reached yet.
+static bool tracksRange(Value* v) {
+    switch (v->tag) {
+    case Tag::LdConst:
+    case Tag::Inc:
+    case Tag::Dec:
+    case Tag::ForSeqSize:
+    case Tag::Length:
+    case Tag::Extract2_1D:
+    case Tag::Phi:
+        return true;
+    default:
+        return false;
+    }
+}
+
+// Same for RangeState::sameLength
+static bool tracksLength(Value* v) {
+    return Subassign1_1D::Cast(v) || Subassign2_1D::Cast(v) ||
+           Phi::Cast(v) || isSeqAlong(v);
+}
+
+// x <= y + k
+static void refineLe(RangeState& state, Value* x, Value* y, long k,
+                     AbstractResult& res) {
+    x = canonical(x);
+    y = canonical(y);
+    auto rx = state.rangeOf(x);
+    auto ry = state.rangeOf(y);
+    if (!rx.known || !ry.known)
+        return;
+
+    auto hi = ry.hi + k;
+    if (hi.bounded && (!rx.hi.bounded || Bound::provablyLe(hi, rx.hi)))
+        rx.hi = hi;
+    auto lo = rx.lo + (-k);
+    if (lo.bounded && (!ry.lo.bounded || Bound::provablyLe(ry.lo, lo)))
+        ry.lo = lo;
+
+    setRange(state, x, rx, res);
+    setRange(state, y, ry, res);
+}
+
+static void refine(RangeState& state, BB* from, BB* to, AbstractResult& res) {
+    if (from->isEmpty() || from->trueBranch() == from->falseBranch())
+        return;
+    bool taken;
+    if (from->trueBranch() == to)
+        taken = true;
+    else if (from->falseBranch() == to)
+        taken = false;
+    else
+        return;
+
+    auto branch = Branch::Cast(from->last());
+    if (!branch)
+        return;
+    auto cond = branch->arg<0>().val();
+    if (auto t = AsTest::Cast(cond))
+        cond = t->val();
+    auto c = Instruction::Cast(cond);
+    if (!c || c->nargs() < 2)
+        return;
+    auto a = c->arg(0).val();
+    auto b = c->arg(1).val();
+
+    switch (c->tag) {
+    case Tag::Lt:
+        if (taken)
+            refineLe(state, a, b, -1, res);
+        else
+            refineLe(state, b, a, 0, res);
+        break;
+    case Tag::Lte:
+        if (taken)
+            refineLe(state, a, b, 0, res);
+        else
+            refineLe(state, b, a, -1, res);
+        break;
+    case Tag::Gt:
+        if (taken)
+            refineLe(state, b, a, -1, res);
+        else
+            refineLe(state, a, b, 0, res);
+        break;
+    case Tag::Gte:
+        if (taken)
+            refineLe(state, b, a, 0, res);
+        else
+            refineLe(state, a, b, -1, res);
+        break;
+    default:
+        break;
+    }
+}
+
+AbstractResult RangeAnalysis::compute(RangeState& state, Instruction* i) {
+    if (auto phi = Phi::Cast(i)) {
+        // Join the inputs we have seen so far. To terminate we widen every
+        // bound which changed since the last iteration.
+        Range r;
+        bool first = true;
+        phi->eachArg([&](Value* v) {
+            v = canonical(v);
+            auto in = state.ranges.find(v);
+            if (in == state.ranges.end() && tracksRange(v))
+                return;
+            auto vr = in == state.ranges.end() ? Range() : in->second;
+            r = first ? vr : r.join(vr);
+            first = false;
+        });
+        auto old = phis.ranges.find(phi);
+        if (old == phis.ranges.end()) {
+            phis.ranges.emplace(phi, r);
+            phis.changed_ = true;
+        } else {
+            r = r.widen(old->second);
+            if (r != old->second) {
+                old->second = r;
+                phis.changed_ = true;
+            }
+        }
+    }
+    return apply(state, i);
+}
+
+AbstractResult RangeAnalysis::apply(RangeState& state, Instruction* i) const {
+    AbstractResult res;
+
+    if (state.branch) {
+        auto from = state.branch;
+        state.branch = nullptr;
+        res.update();
+        // The state might have flown through empty blocks, or be merged from
+        // other predecessors. Refine only directly on the edge.
+        if (i == *i->bb()->begin() && cfg.hasSinglePred(i->bb()) &&
+            cfg.isImmediatePredecessor(from, i->bb()))
+            refine(state, from, i->bb(), res);
+    }
+
+    switch (i->tag) {
+    case Tag::LdConst: {
+        SEXP c = LdConst::Cast(i)->c();
+        if (IS_SIMPLE_SCALAR(c, INTSXP) && INTEGER(c)[0] != NA_INTEGER) {
+            setRange(state, i, Range::constant(INTEGER(c)[0]), res);
+        } else if (IS_SIMPLE_SCALAR(c, REALSXP)) {
+            double d = REAL(c)[0];
+            if (!ISNAN(d) && d > INT_MIN && d < INT_MAX && d == (int)d)
+                setRange(state, i, Range::constant((int)d), res);
+        }
+        break;
+    }
+
+    case Tag::Inc:
+    case Tag::Dec: {
+        auto r = state.rangeOf(i->arg(0).val());
+        long k = i->tag == Tag::Inc ? 1 : -1;
+        r.lo = r.lo + k;
+        r.hi = r.hi + k;
+        setRange(state, i, r, res);
+        break;
+    }
+
+    case Tag::ForSeqSize:
+    case Tag::Length: {
+        auto len = Bound::lengthOf(state.lengthOf(i->arg(0).val()));
+        setRange(state, i, {true, len, len}, res);
+        break;
+    }
+
+    case Tag::CallBuiltin:
+    case Tag::CallSafeBuiltin:
+        if (isSeqAlong(i)) {
+            auto x = i->arg(0).val();
+            if (!x->type.maybeObj())
+                setLength(state, i, state.lengthOf(x), res);
+        }
+        break;
+
+    case Tag::Extract2_1D: {
+        // Elements of seq_along(x) are equal to their index
+        auto e = Extract2_1D::Cast(i);
+        auto seq = canonical(e->vec());
+        if (isSeqAlong(seq) && state.inBounds(seq, e->idx()))
+            setRange(state, i, state.rangeOf(e->idx()), res);
+        else
+            setRange(state, i, Range(), res);
+        break;
+    }
+
+    case Tag::Subassign1_1D:
+    case Tag::Subassign2_1D: {
+        // In bounds updates do not change the length, unless the value is
+        // NULL, which deletes list elements.
+        auto vec = i->arg(1).val();
+        auto val = i->arg(0).val();
+        if (!vec->type.maybeObj() && !val->type.maybe(RType::nil) &&
+            state.inBounds(vec, i->arg(2).val()))
+            setLength(state, i, state.lengthOf(vec), res);
+        else
+            setLength(state, i, i, res);
+        break;
+    }
+
+    case Tag::Phi: {
+        auto phi = Phi::Cast(i);
+        auto r = phis.ranges.find(phi);
+        setRange(state, i, r == phis.ranges.end() ? Range() : r->second, res);
+
+        Value* length = nullptr;
+        phi->eachArg([&](Value* v) {
+            auto in = canonical(v);
+            if (!state.sameLength.count(in) && tracksLength(in))
+                return;
+            auto l = state.lengthOf(in);
+            if (!length)
+                length = l;
+            else if (length != l)
+                length = i;
+        });
+        setLength(state, i, length ? length : i, res);
+        break;
+    }
+
+    case Tag::Branch:
+        state.branch = i->bb();
+        res.update();
+        break;
+
+    default:
+        break;
+    }
+
+    return res;
+}
+
+} // namespace pir
+} // namespace rir
@@ -0,0 +1,127 @@
+#ifndef PIR_RANGE_H
+#define PIR_RANGE_H
+
+#include "../pir/pir_impl.h"
+#include "../util/cfg.h"
+#include "generic_static_analysis.h"
+
+#include <unordered_map>
+
+namespace rir {
+namespace pir {
+
+/*
+ * A symbolic bound. Either a constant, or the length of a vector plus a
+ * constant. Vectors are identified by their length representative (see
+ * RangeState::lengthOf), such that different SSA values which provably have
+ * the same length yield equal bounds.
+ */
+struct Bound {
+    bool bounded = false;
+    Value* length = nullptr;
+    long offset = 0;
+
+    static Bound constant(long c) { return {true, nullptr, c}; }
+    static Bound lengthOf(Value* v, long off = 0) { return {true, v, off}; }
+
+    Bound operator+(long k) const {
+        return bounded ? Bound({true, length, offset + k}) : *this;
+    }
+
+    bool operator==(const Bound& o) const {
+        return bounded == o.bounded &&
+               (!bounded || (length == o.length && offset == o.offset));
+    }
+    bool operator!=(const Bound& o) const { return !(*this == o); }
+
+    // Is a <= b for all possible lengths?
+    static bool provablyLe(const Bound& a, const Bound& b);
+
+    void print(std::ostream& out) const;
+};
+
+/*
+ * Range of an integer valued scalar. If known is set, the value is never NA
+ * and between lo and hi (inclusive, unbounded sides are infinite).
+ */
+struct Range {
+    bool known = false;
+    Bound lo;
+    Bound hi;
+
+    static Range constant(long c) {
+        return {true, Bound::constant(c), Bound::constant(c)};
+    }
+
+    bool operator==(const Range& o) const {
+        return known == o.known && (!known || (lo == o.lo && hi == o.hi));
+    }
+    bool operator!=(const Range& o) const { return !(*this == o); }
+
+    Range join(const Range& o) const;
+    // Widen every bound which changed compared to old
+    Range widen(const Range& old) const;
+
+    void print(std::ostream& out) const;
+};
+
+struct RangeState {
+    // Values we track always get an entry, possibly an unknown range, when
+    // they are reached. Other values have no entry and an unknown range.
+    std::unordered_map<Value*, Range> ranges;
+    // Maps a vector to a value with the same length
+    std::unordered_map<Value*, Value*> sameLength;
+    // Set after a branch, to refine the ranges in the successor. Only used if
+    // the successor is reached through the edge itself, see apply.
+    BB* branch = nullptr;
+
+    Range rangeOf(Value* v) const;
+    Value* lengthOf(Value* v) const;
+
+    // Index value is within 1..length(vec)
+    bool inBounds(Value* vec, Value* idx) const;
+
+    AbstractResult merge(const RangeState& other);
+    AbstractResult mergeExit(const RangeState& other) { return merge(other); }
+
+    void print(std::ostream& out, bool tty) const;
+};
+
+// Flow insensitive ranges of phis, used for widening
+struct PhiRanges {
+    std::unordered_map<Phi*, Range> ranges;
+    bool changed_ = false;
+
+    void resetChanged() { changed_ = false; }
+    bool changed() { return changed_; }
+};
+
+/*
+ * Range analysis for integer scalars, mainly indices and loop counters. We
+ * track symbolic ranges relative to vector lengths, so that we can prove
+ * accesses like `x[[i]]` inside `for (i in seq_along(x))` to be in bounds.
+ * Comparisons refine the ranges of their operands in the successors of a
+ * branch, which have the branching block as their only predecessor. Loop
+ * carried ranges are widened at phis.
+ */
+class RangeAnalysis : public StaticAnalysis<RangeState, PhiRanges> {
+  public:
+    RangeAnalysis(ClosureVersion* cls, Code* code, const CFG& cfg,
+                  LogStream& log)
+        : StaticAnalysis("Range", cls, code, RangeState(), &phis, log),
+          cfg(cfg) {}
+
+    AbstractResult apply(RangeState& state, Instruction* i) const override;
+
+  protected:
+    AbstractResult compute(RangeState& state, Instruction* i) override;
+
+  private:
+    const CFG& cfg;
+    PhiRanges phis;
+};
+
+} // namespace pir
+} // namespace rir
+
+#endif
@@ -307,13 +307,16 @@ AbstractResult ScopeAnalysis::doCompute(ScopeAnalysisState& state,
                     target = result.singleValue().val->followCastsAndForce();
             });
             assert(target);
+            // With ... the callee does not see the arguments one by one
             if (auto mk = MkFunCls::Cast(target))
-                if (mk->cls->nargs() == calli->nCallArgs())
+                if (mk->cls->nargs() == calli->nCallArgs() &&
+                    !mk->cls->formals().hasDots())
                     if (auto trg = call->tryDispatch(mk->cls))
                         interProceduralAnalysis(trg, mk->lexicalEnv());
         } else if (auto call = StaticCall::Cast(i)) {
             auto target = call->cls();
-            if (target && target->nargs() == calli->nCallArgs())
+            if (target && target->nargs() == calli->nCallArgs() &&
+                !target->formals().hasDots())
                 if (auto trg = call->tryDispatch())
                     interProceduralAnalysis(trg, target->closureEnv());
         } else {
@@ -11,14 +11,22 @@ namespace pir {
 
 class CompilerPerf {
     std::unordered_map<std::string, double> passTimer;
+    std::unordered_map<std::string, size_t> passRuns;
+    std::unordered_map<std::string, size_t> passSkips;
+    size_t phaseRounds = 0;
 
   public:
     void addTime(const std::string& name, double time) {
         if (!passTimer.count(name))
             passTimer[name] = 0;
         passTimer.at(name) += time;
+        passRuns[name]++;
     }
 
+    // A pass was not run, because its input did not change since it last ran
+    void addSkip(const std::string& name) { passSkips[name]++; }
+    void addPhaseRound() { phaseRounds++; }
+
     ~CompilerPerf() {
         std::map<double, std::string> ordered;
         double total = 0;
@@ -32,9 +40,12 @@ class CompilerPerf {
         std::cerr << "=== COMPILER perf Breakdown:\n";
         for (auto t : ordered)
             std::cerr << "" << std::setw(24) << t.second << "\t" << t.first
-                      << "\n";
+                      << "\t(" << passRuns[t.second] << " runs, "
+                      << passSkips[t.second] << " skipped)\n";
         std::cerr << "" << std::setw(24) << "total"
                   << "\t" << total << "\n";
+        std::cerr << "" << std::setw(24) << "phase rounds"
+                  << "\t" << phaseRounds << "\n";
     }
 };
 
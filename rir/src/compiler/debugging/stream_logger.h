@@ -156,6 +156,12 @@ class StreamLogger {
 
     void close(ClosureVersion* cls) { streams.erase(cls); }
 
+    // Streams of different versions can be written to concurrently, unless
+    // they all print directly to stdout
+    bool isThreadSafe() const {
+        return !options.includes(DebugFlag::PrintIntoStdout);
+    }
+
   private:
     std::unordered_map<ClosureVersion*, std::unique_ptr<LogStream>> streams;
     DebugOptions options;
@@ -1,3 +1,4 @@
+#include "../analysis/analysis_manager.h"
 #include "../analysis/available_checkpoints.h"
 #include "../pir/pir_impl.h"
 #include "../translations/pir_translator.h"
@@ -50,10 +51,11 @@ struct AvailableAssumptions
     }
 };
 
-void OptimizeAssumptions::apply(RirCompiler&, ClosureVersion* function,
+bool OptimizeAssumptions::apply(RirCompiler&, ClosureVersion* function,
                                 LogStream& log) const {
-    CFG cfg(function);
-    AvailableCheckpoints checkpoint(function, log);
+    bool anyChange = false;
+    AvailableCheckpoints checkpoint(
+        function, function->analyses().cfg(function), log);
     AvailableAssumptions assumptions(function, log);
 
     Visitor::runPostChange(function->entry, [&](BB* bb) {
@@ -73,12 +75,14 @@ void OptimizeAssumptions::apply(RirCompiler&, ClosureVersion* function,
                     delete bb->next1;
                     bb->next1 = nullptr;
                     next = bb->end();
+                    anyChange = true;
                 }
             }
 
             if (auto assume = Assume::Cast(instr)) {
                 if (assumptions.at(instr).includes(assume)) {
                     next = bb->remove(ip);
+                    anyChange = true;
                 } else {
                     // We are trying to group multiple assumes into the same
                     // checkpoint by finding for each assume the topmost
@@ -89,14 +93,17 @@ void OptimizeAssumptions::apply(RirCompiler&, ClosureVersion* function,
                     // if we move both at the same time, we could even jump over
                     // effectful instructions.
                     if (auto cp0 = checkpoint.at(instr)) {
-                        if (assume->checkpoint() != cp0)
+                        if (assume->checkpoint() != cp0) {
                             assume->checkpoint(cp0);
+                            anyChange = true;
+                        }
                     }
                 }
             }
             ip = next;
         }
     });
+    return anyChange;
 }
 
 } // namespace pir
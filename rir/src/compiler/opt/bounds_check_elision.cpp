@@ -0,0 +1,58 @@
+#include "../analysis/range.h"
+#include "../pir/pir_impl.h"
+#include "../util/visitor.h"
+
+#include "R/r.h"
+#include "pass_definitions.h"
+
+namespace rir {
+namespace pir {
+
+bool BoundsCheckElision::apply(RirCompiler&, ClosureVersion* function,
+                               LogStream& log) const {
+    bool anyChange = false;
+
+    // The unchecked extract only handles these vectors
+    static const PirType simpleVector =
+        (PirType(RType::logical) | RType::integer | RType::real | RType::vec)
+            .notObject();
+
+    auto run = [&](Code* code) {
+        RangeAnalysis ranges(function, code, function->analyses().cfg(code),
+                             log);
+        ranges();
+        ranges.foreach<RangeAnalysis::BeforeInstruction>(
+            [&](const RangeState& state, Instruction* i) {
+                if (auto e = Extract2_1D::Cast(i)) {
+                    if (!e->inBounds && e->vec()->type.isA(simpleVector) &&
+                        state.inBounds(e->vec(), e->idx())) {
+                        e->inBounds = true;
+                        anyChange = true;
+                    }
+                }
+
+                if (auto s = Subassign1_1D::Cast(i)) {
+                    if (!s->inBounds && !s->lhs()->type.maybeObj() &&
+                        state.inBounds(s->lhs(), s->idx())) {
+                        s->inBounds = true;
+                        anyChange = true;
+                    }
+                }
+                if (auto s = Subassign2_1D::Cast(i)) {
+                    if (!s->inBounds && !s->lhs()->type.maybeObj() &&
+                        state.inBounds(s->lhs(), s->idx())) {
+                        s->inBounds = true;
+                        anyChange = true;
+                    }
+                }
+            });
+    };
+
+    run(function);
+    function->eachPromise([&](Promise* p) { run(p); });
+
+    return anyChange;
+}
+
+} // namespace pir
+} // namespace rir
@@ -18,6 +18,7 @@ class TheCleanup {
   public:
     explicit TheCleanup(ClosureVersion* function) : function(function) {}
     ClosureVersion* function;
+    bool anyChange = false;
     void operator()() {
         std::unordered_set<size_t> used_p;
         std::unordered_map<BB*, std::unordered_set<Phi*>> usedBB;
@@ -130,8 +131,14 @@ class TheCleanup {
                     }
                 }
 
-                if (!removed) {
+                if (removed) {
+                    anyChange = true;
+                } else {
+                    auto type = i->type;
+                    auto effects = i->effects;
                     i->updateType();
+                    if (i->type != type || i->effects != effects)
+                        anyChange = true;
                 }
                 ip = next;
             }
@@ -153,8 +160,10 @@ class TheCleanup {
         }
 
         for (size_t i = 0; i < function->promises().size(); ++i)
-            if (function->promise(i) && used_p.find(i) == used_p.end())
+            if (function->promise(i) && used_p.find(i) == used_p.end()) {
                 function->erasePromise(i);
+                anyChange = true;
+            }
 
         auto fixupPhiInput = [&](BB* old, BB* n) {
             for (auto phi : usedBB[old]) {
@@ -250,6 +259,8 @@ class TheCleanup {
             bb->next0 = nullptr;
             delete bb;
         }
+        if (!toDel.empty())
+            anyChange = true;
 
         BBTransform::renumber(function);
         function->eachPromise(BBTransform::renumber);
@@ -260,9 +271,10 @@ class TheCleanup {
 namespace rir {
 namespace pir {
 
-void Cleanup::apply(RirCompiler&, ClosureVersion* function, LogStream&) const {
+bool Cleanup::apply(RirCompiler&, ClosureVersion* function, LogStream&) const {
     TheCleanup s(function);
     s();
+    return s.anyChange;
 }
 
 } // namespace pir
@@ -7,9 +7,10 @@
 namespace rir {
 namespace pir {
 
-void CleanupCheckpoints::apply(RirCompiler&, ClosureVersion* function,
+bool CleanupCheckpoints::apply(RirCompiler&, ClosureVersion* function,
                                LogStream&) const {
-    auto apply = [](Code* code) {
+    bool anyChange = false;
+    auto apply = [&](Code* code) {
         std::unordered_set<BB*> toDelete;
         Visitor::run(code->entry, [&](BB* bb) {
             if (bb->isEmpty())
@@ -28,9 +29,12 @@ void CleanupCheckpoints::apply(RirCompiler&, ClosureVersion* function,
         // are not phi inputs. We can delete without further checks.
         for (auto bb : toDelete)
             delete bb;
+        if (!toDelete.empty())
+            anyChange = true;
     };
     apply(function);
     function->eachPromise([&](Promise* p) { apply(p); });
+    return anyChange;
 }
 } // namespace pir
 } // namespace rir
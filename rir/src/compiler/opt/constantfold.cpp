@@ -1,3 +1,4 @@
+#include "../analysis/analysis_manager.h"
 #include "../pir/pir_impl.h"
 #include "../transform/bb.h"
 #include "../translations/rir_compiler.h"
@@ -90,10 +91,11 @@ static bool convertsToLogicalWithoutWarning(SEXP arg) {
 namespace rir {
 namespace pir {
 
-void Constantfold::apply(RirCompiler& cmp, ClosureVersion* function,
+bool Constantfold::apply(RirCompiler& cmp, ClosureVersion* function,
                          LogStream&) const {
+    bool anyChange = false;
     std::unordered_map<BB*, bool> branchRemoval;
-    DominanceGraph dom(function);
+    auto& dom = function->analyses().dominance(function);
 
     Visitor::run(function->entry, [&](BB* bb) {
         if (bb->isEmpty())
@@ -279,6 +281,9 @@ void Constantfold::apply(RirCompiler& cmp, ClosureVersion* function,
                 }
             }
 
+            // Either i was removed or replaced
+            if (next != ip + 1 || *ip != i)
+                anyChange = true;
             ip = next;
         }
 
@@ -321,6 +326,8 @@ void Constantfold::apply(RirCompiler& cmp, ClosureVersion* function,
 
     for (auto bb : toDelete)
         delete bb;
+
+    return anyChange || !branchRemoval.empty();
 }
 } // namespace pir
 } // namespace rir
@@ -9,12 +9,94 @@
 
 #include <unordered_map>
 #include <unordered_set>
+#include <vector>
 
 namespace rir {
 namespace pir {
 
-void OptimizeContexts::apply(RirCompiler&, ClosureVersion* function,
+// A loop context is only needed if some code in the loop can execute a
+// non-local break or next, ie. call functions, force promises or eval.
+static bool loopContextNeeded(PushLoopContext* push, BB* body) {
+    std::unordered_set<BB*> seen;
+    std::vector<BB*> todo = {body};
+    while (!todo.empty()) {
+        BB* bb = todo.back();
+        todo.pop_back();
+        if (!seen.insert(bb).second)
+            continue;
+        bool left = false;
+        for (auto i : *bb) {
+            auto pop = PopLoopContext::Cast(i);
+            if (pop && pop->push() == push) {
+                left = true;
+                break;
+            }
+            if (i->effects.includes(Effect::ExecuteCode) ||
+                i->effects.includes(Effect::Force))
+                return true;
+        }
+        if (left)
+            continue;
+        if (bb->isExit())
+            return true;
+        todo.push_back(bb->trueBranch());
+        if (bb->falseBranch())
+            todo.push_back(bb->falseBranch());
+    }
+    return false;
+}
+
+static bool removeLoopContexts(ClosureVersion* function) {
+    std::vector<std::pair<PushLoopContext*, Identical*>> unneeded;
+    Visitor::run(function->entry, [&](BB* bb) {
+        if (bb->isEmpty() || !bb->isBranch())
+            return;
+        auto branch = Branch::Cast(bb->last());
+        if (!branch)
+            return;
+        auto entered = Identical::Cast(branch->arg<0>().val());
+        if (!entered || entered->arg<1>().val() != Nil::instance())
+            return;
+        auto push = PushLoopContext::Cast(entered->arg<0>().val());
+        if (push && !loopContextNeeded(push, bb->trueBranch()))
+            unneeded.push_back({push, entered});
+    });
+
+    if (unneeded.empty())
+        return false;
+
+    std::unordered_set<Instruction*> toRemove;
+    for (auto& c : unneeded) {
+        // The handler for non-local break and next becomes dead code
+        c.second->replaceUsesWith(True::instance());
+        toRemove.insert(c.second);
+        toRemove.insert(c.first);
+    }
+    Visitor::run(function->entry, [&](BB* bb) {
+        for (auto i : *bb)
+            if (auto pop = PopLoopContext::Cast(i))
+                if (toRemove.count(pop->push()))
+                    toRemove.insert(pop);
+    });
+    for (auto& c : unneeded)
+        c.first->replaceUsesWith(Nil::instance());
+
+    Visitor::run(function->entry, [&](BB* bb) {
+        auto ip = bb->begin();
+        while (ip != bb->end()) {
+            if (toRemove.count(*ip))
+                ip = bb->remove(ip);
+            else
+                ip++;
+        }
+    });
+    return true;
+}
+
+bool OptimizeContexts::apply(RirCompiler&, ClosureVersion* function,
                              LogStream& log) const {
+    bool changed = removeLoopContexts(function);
+
     UnnecessaryContexts unnecessary(function, log);
 
     std::unordered_set<Instruction*> toRemove;
@@ -34,7 +116,7 @@ void OptimizeContexts::apply(RirCompiler&, ClosureVersion* function,
     });
 
     if (toRemove.empty())
-        return;
+        return changed;
 
     assert(toRemove.size() % 2 == 0);
 
@@ -55,6 +137,7 @@ void OptimizeContexts::apply(RirCompiler&, ClosureVersion* function,
     });
 
     assert(toRemove.size() == 0);
+    return true;
 }
 
 } // namespace pir
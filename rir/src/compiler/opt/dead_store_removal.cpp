@@ -1,19 +1,21 @@
+#include "../analysis/analysis_manager.h"
 #include "../analysis/dead_store.h"
 #include "pass_definitions.h"
 
 namespace rir {
 namespace pir {
 
-void DeadStoreRemoval::apply(RirCompiler&, ClosureVersion* function,
+bool DeadStoreRemoval::apply(RirCompiler&, ClosureVersion* function,
                              LogStream& log) const {
+    bool anyChange = false;
     bool noStores = Visitor::check(
         function->entry, [&](Instruction* i) { return !StVar::Cast(i); });
     if (noStores)
-        return;
+        return false;
 
     {
-        CFG cfg(function);
-        DeadStoreAnalysis analysis(function, cfg, log);
+        DeadStoreAnalysis analysis(function, function->analyses().cfg(function),
+                                   log);
 
         Visitor::run(function->entry, [&](BB* bb) {
             auto ip = bb->begin();
@@ -22,6 +24,7 @@ void DeadStoreRemoval::apply(RirCompiler&, ClosureVersion* function,
                 if (auto st = StVar::Cast(*ip)) {
                     if (analysis.isDead(st)) {
                         next = bb->remove(ip);
+                        anyChange = true;
                         continue;
                     }
                 }
@@ -29,6 +32,7 @@ void DeadStoreRemoval::apply(RirCompiler&, ClosureVersion* function,
             }
         });
     }
+    return anyChange;
 }
 
 } // namespace pir
@@ -8,7 +8,8 @@
 namespace rir {
 namespace pir {
 
-void DelayEnv::apply(RirCompiler&, ClosureVersion* function, LogStream&) const {
+bool DelayEnv::apply(RirCompiler&, ClosureVersion* function, LogStream&) const {
+    bool anyChange = false;
     Visitor::run(function->entry, [&](BB* bb) {
         std::unordered_set<MkEnv*> done;
         MkEnv* envInstr;
@@ -73,6 +74,7 @@ void DelayEnv::apply(RirCompiler&, ClosureVersion* function, LogStream&) const {
                     auto st = StVar::Cast(next);
                     if (st && st->env() == envInstr) {
                         if (consumeStVar(st)) {
+                            anyChange = true;
                             it = bb->remove(it + 1);
                             it--;
                             continue;
@@ -92,6 +94,7 @@ void DelayEnv::apply(RirCompiler&, ClosureVersion* function, LogStream&) const {
 
                 bb->swapWithNext(it);
                 it++;
+                anyChange = true;
             }
 
             if (it == bb->end() || (it + 1) == bb->end())
@@ -106,6 +109,7 @@ void DelayEnv::apply(RirCompiler&, ClosureVersion* function, LogStream&) const {
                 deoptBranch->insert(deoptBranch->begin(), newEnvInstr);
                 envInstr->replaceUsesWithLimits(newEnvInstr, deoptBranch);
                 it = bb->moveToBegin(it, fastPathBranch);
+                anyChange = true;
             };
 
             assert(envInstr);
@@ -121,6 +125,7 @@ void DelayEnv::apply(RirCompiler&, ClosureVersion* function, LogStream&) const {
             }
         }
     });
+    return anyChange;
 }
 } // namespace pir
 } // namespace rir
@@ -6,8 +6,9 @@
 namespace rir {
 namespace pir {
 
-void DelayInstr::apply(RirCompiler&, ClosureVersion* function,
+bool DelayInstr::apply(RirCompiler&, ClosureVersion* function,
                        LogStream&) const {
+    bool anyChange = false;
     Visitor::run(function->entry, [&](BB* bb) {
         Checkpoint* checkpoint =
             bb->isEmpty() ? nullptr : Checkpoint::Cast(bb->last());
@@ -48,6 +49,7 @@ void DelayInstr::apply(RirCompiler&, ClosureVersion* function,
                     if (usage && FrameState::Cast(usage) &&
                         usage->bb() == checkpoint->deoptBranch()) {
                         next = bb->moveToBegin(ip, usage->bb());
+                        anyChange = true;
                     }
                 }
             }
@@ -55,6 +57,7 @@ void DelayInstr::apply(RirCompiler&, ClosureVersion* function,
             ip = next;
         }
     });
+    return anyChange;
 }
 } // namespace pir
 } // namespace rir
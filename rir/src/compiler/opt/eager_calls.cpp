@@ -1,3 +1,4 @@
+#include "../analysis/analysis_manager.h"
 #include "../analysis/available_checkpoints.h"
 #include "../pir/pir_impl.h"
 #include "../transform/bb.h"
@@ -16,11 +17,13 @@
 namespace rir {
 namespace pir {
 
-void EagerCalls::apply(RirCompiler& cmp, ClosureVersion* closure,
+bool EagerCalls::apply(RirCompiler& cmp, ClosureVersion* closure,
                        LogStream& log) const {
+    bool anyChange = false;
     std::unordered_set<MkArg*> todo;
     auto code = closure->entry;
-    AvailableCheckpoints checkpoint(closure, log);
+    AvailableCheckpoints checkpoint(closure, closure->analyses().cfg(closure),
+                                    log);
 
     auto replaceLdFunBuiltinWithDeopt = [&](BB* bb, BB::Instrs::iterator ip,
                                             Checkpoint* cp, SEXP builtin,
@@ -77,6 +80,7 @@ void EagerCalls::apply(RirCompiler& cmp, ClosureVersion* closure,
             BuiltinCallFactory::New(call->env(), builtin, args, call->srcIdx);
         call->replaceUsesWith(bt);
         bb->replace(ip, bt);
+        anyChange = true;
     };
 
     // Search for calls that likely point to a builtin.
@@ -147,7 +151,8 @@ void EagerCalls::apply(RirCompiler& cmp, ClosureVersion* closure,
                 Closure* cls = call->cls();
                 ClosureVersion* version = call->tryDispatch();
 
-                if (!version || call->nCallArgs() != cls->nargs()) {
+                if (!version || call->nCallArgs() != cls->nargs() ||
+                    cls->formals().hasDots()) {
                     ip = next;
                     continue;
                 }
@@ -173,6 +178,8 @@ void EagerCalls::apply(RirCompiler& cmp, ClosureVersion* closure,
                                 }
                             });
                         });
+                    if (call->hint != newVersion)
+                        anyChange = true;
                     call->hint = newVersion;
                     assert(call->tryDispatch() == newVersion);
                     ip = next;
@@ -251,13 +258,15 @@ void EagerCalls::apply(RirCompiler& cmp, ClosureVersion* closure,
                             }
                         });
                     });
+                if (call->hint != newVersion)
+                    anyChange = true;
                 call->hint = newVersion;
             }
             ip = next;
         }
     });
     if (todo.empty())
-        return;
+        return anyChange;
 
     // Third step: eagerly evaluate arguments if we know from above that we will
     // call a function that expects them to be eager.
@@ -282,6 +291,7 @@ void EagerCalls::apply(RirCompiler& cmp, ClosureVersion* closure,
 
                 Value* promRes = BBTransform::forInline(prom_copy, split).first;
                 mk->eagerArg(promRes);
+                anyChange = true;
 
                 bb = split;
                 ip = bb->begin();
@@ -293,6 +303,7 @@ void EagerCalls::apply(RirCompiler& cmp, ClosureVersion* closure,
                         if (auto mk = MkArg::Cast(arg.val())) {
                             if (mk->isEager()) {
                                 arg.val() = mk->eagerArg();
+                                anyChange = true;
                             }
                         }
                     });
@@ -300,6 +311,7 @@ void EagerCalls::apply(RirCompiler& cmp, ClosureVersion* closure,
             }
         }
     });
+    return anyChange;
 }
 } // namespace pir
 } // namespace rir
@@ -9,7 +9,8 @@
 namespace rir {
 namespace pir {
 
-void ElideEnv::apply(RirCompiler&, ClosureVersion* function, LogStream&) const {
+bool ElideEnv::apply(RirCompiler&, ClosureVersion* function, LogStream&) const {
+    bool anyChange = false;
     std::unordered_set<Value*> envNeeded;
     std::unordered_map<Value*, Value*> envDependency;
 
@@ -24,6 +25,7 @@ void ElideEnv::apply(RirCompiler&, ClosureVersion* function, LogStream&) const {
                         return v != i->env() && v->type.maybeObj();
                     });
                     if (!envIsNeeded) {
+                        anyChange = true;
                         i->elideEnv();
                         i->type.setNotObject();
                         i->effects.reset(Effect::Reflection);
@@ -39,8 +41,10 @@ void ElideEnv::apply(RirCompiler&, ClosureVersion* function, LogStream&) const {
                 }
 
                 if (auto force = Force::Cast(i)) {
-                    if (!force->input()->type.maybeLazy())
+                    if (!force->input()->type.maybeLazy()) {
                         force->elideEnv();
+                        anyChange = true;
+                    }
                 }
             }
         }
@@ -61,18 +65,22 @@ void ElideEnv::apply(RirCompiler&, ClosureVersion* function, LogStream&) const {
         while (ip != bb->end()) {
             Instruction* i = *ip;
             if (Env::isPirEnv(i)) {
-                if (envNeeded.find(i) == envNeeded.end())
+                if (envNeeded.find(i) == envNeeded.end()) {
                     ip = bb->remove(ip);
-                else
+                    anyChange = true;
+                } else {
                     ip++;
+                }
             } else if (i->hasEnv() && Env::isPirEnv(i->env()) &&
                        envNeeded.find(i->env()) == envNeeded.end()) {
                 ip = bb->remove(ip);
+                anyChange = true;
             } else {
                 ip++;
             }
         }
     });
+    return anyChange;
 }
 } // namespace pir
 } // namespace rir
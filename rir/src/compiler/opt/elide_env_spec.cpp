@@ -1,3 +1,4 @@
+#include "../analysis/analysis_manager.h"
 #include "../analysis/available_checkpoints.h"
 #include "../pir/pir_impl.h"
 #include "../transform/bb.h"
@@ -12,10 +13,11 @@
 namespace rir {
 namespace pir {
 
-void ElideEnvSpec::apply(RirCompiler&, ClosureVersion* function,
+bool ElideEnvSpec::apply(RirCompiler&, ClosureVersion* function,
                          LogStream& log) const {
-
-    AvailableCheckpoints checkpoint(function, log);
+    bool anyChange = false;
+    AvailableCheckpoints checkpoint(
+        function, function->analyses().cfg(function), log);
 
     auto nonObjectArgs = [&](Instruction* i) {
         auto answer = true;
@@ -93,6 +95,7 @@ void ElideEnvSpec::apply(RirCompiler&, ClosureVersion* function,
                 // all operators are primitive values
                 if (checkpoint.at(i) && i->envOnlyForObj() &&
                     nonObjectArgs(i)) {
+                    anyChange = true;
                     i->elideEnv();
                     i->eachArg([&](Value* arg) {
                         if (arg != i->env())
@@ -117,6 +120,10 @@ void ElideEnvSpec::apply(RirCompiler&, ClosureVersion* function,
                     // case they access promises reflectively
                     if (!bannedEnvs.count(i->env())) {
                         auto env = checks[i].second;
+                        // Guarding further uses of an env which is already
+                        // stubbed does not enable anything new
+                        if (!env->stub)
+                            anyChange = true;
                         env->stub = true;
                         auto cp = checks[i].first;
                         auto condition = new IsEnvStub(env);
@@ -127,6 +134,7 @@ void ElideEnvSpec::apply(RirCompiler&, ClosureVersion* function,
             ip = next;
         }
     });
+    return anyChange;
 }
 } // namespace pir
 } // namespace rir
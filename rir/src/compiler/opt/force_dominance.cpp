@@ -363,16 +363,23 @@ class ForceDominanceAnalysis : public StaticAnalysis<ForcedBy> {
 namespace rir {
 namespace pir {
 
-void ForceDominance::apply(RirCompiler&, ClosureVersion* cls,
+bool ForceDominance::apply(RirCompiler&, ClosureVersion* cls,
                            LogStream& log) const {
+    bool anyChange = false;
     auto apply = [&](Code* code) {
         ForceDominanceAnalysis analysis(cls, code, log);
         analysis();
 
         auto& result = analysis.result();
-        if (result.eagerLikeFunction(cls))
+        if (result.eagerLikeFunction(cls) &&
+            !cls->properties.includes(ClosureVersion::Property::IsEager)) {
             cls->properties.set(ClosureVersion::Property::IsEager);
-        cls->properties.argumentForceOrder = result.argumentForceOrder;
+            anyChange = true;
+        }
+        if (cls->properties.argumentForceOrder != result.argumentForceOrder) {
+            cls->properties.argumentForceOrder = result.argumentForceOrder;
+            anyChange = true;
+        }
 
         std::unordered_map<Force*, Value*> inlinedPromise;
         std::unordered_map<Instruction*, MkArg*> forcedMkArg;
@@ -383,14 +390,17 @@ void ForceDominance::apply(RirCompiler&, ClosureVersion* cls,
             while (ip != bb->end()) {
                 auto next = ip + 1;
                 if (auto f = Force::Cast(*ip)) {
-                    if (result.isDominatingForce(f))
+                    if (result.isDominatingForce(f) && !f->strict) {
                         f->strict = true;
+                        anyChange = true;
+                    }
 
                     if (auto mkarg = MkArg::Cast(f->followCastsAndForce())) {
                         if (mkarg->isEager()) {
                             Value* eager = mkarg->eagerArg();
                             f->replaceUsesWith(eager);
                             next = bb->remove(ip);
+                            anyChange = true;
                         } else if (result.isDominatingForce(f)) {
                             if (result.isSafeToInline(mkarg)) {
                                 Promise* prom = mkarg->prom();
@@ -427,6 +437,7 @@ void ForceDominance::apply(RirCompiler&, ClosureVersion* cls,
                                 forcedMkArg[mkarg] = fixedMkArg;
 
                                 inlinedPromise[f] = promRes;
+                                anyChange = true;
                                 break;
                             }
                         }
@@ -437,6 +448,7 @@ void ForceDominance::apply(RirCompiler&, ClosureVersion* cls,
                             auto eager = mk->eagerArg();
                             cast->replaceUsesWith(eager);
                             next = bb->remove(ip);
+                            anyChange = true;
                         }
                     }
                 }
@@ -461,6 +473,7 @@ void ForceDominance::apply(RirCompiler&, ClosureVersion* cls,
                             else
                                 f->replaceUsesWith(dom);
                             next = bb->remove(ip);
+                            anyChange = true;
                         }
                     }
                 }
@@ -482,6 +495,7 @@ void ForceDominance::apply(RirCompiler&, ClosureVersion* cls,
         }
     };
     apply(cls);
+    return anyChange;
 }
 } // namespace pir
 } // namespace rir
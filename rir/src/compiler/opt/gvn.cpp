@@ -1,3 +1,4 @@
+#include "../analysis/analysis_manager.h"
 #include "../pir/pir.h"
 #include "../pir/pir_impl.h"
 #include "../transform/bb.h"
@@ -9,7 +10,7 @@
 namespace rir {
 namespace pir {
 
-void GVN::apply(RirCompiler&, ClosureVersion* cls, LogStream& log) const {
+bool GVN::apply(RirCompiler&, ClosureVersion* cls, LogStream& log) const {
     std::unordered_map<size_t, SmallSet<Value*>> reverseNumber;
     std::unordered_map<size_t, Value*> firstValue;
     {
@@ -162,12 +163,13 @@ void GVN::apply(RirCompiler&, ClosureVersion* cls, LogStream& log) const {
                 it++;
         }
         if (reverseNumber.size() == 0)
-            return;
+            return false;
     }
 
+    bool anyChange = false;
     {
         std::unordered_map<Value*, Value*> replacements;
-        DominanceGraph dom(cls);
+        auto& dom = cls->analyses().dominance(cls);
 
         for (auto& g : reverseNumber) {
             auto p = g.second.begin();
@@ -193,6 +195,7 @@ void GVN::apply(RirCompiler&, ClosureVersion* cls, LogStream& log) const {
                     // Make sure this instruction really gets removed
                     i->effects.reset();
                     replacements[i] = first;
+                    anyChange = true;
                 }
             }
         }
@@ -200,7 +203,9 @@ void GVN::apply(RirCompiler&, ClosureVersion* cls, LogStream& log) const {
 
     // Remove dead instructions here, instead of deferring to the cleanup pass.
     // Sometimes a dead instruction will trip the verifier.
-    BBTransform::removeDeadInstrs(cls);
+    if (BBTransform::removeDeadInstrs(cls))
+        anyChange = true;
+    return anyChange;
 }
 
 } // namespace pir
@@ -1,3 +1,4 @@
+#include "../analysis/analysis_manager.h"
 #include "../pir/pir_impl.h"
 #include "../transform/bb.h"
 #include "../translations/rir_compiler.h"
@@ -13,9 +14,10 @@
 namespace rir {
 namespace pir {
 
-void HoistInstruction::apply(RirCompiler& cmp, ClosureVersion* function,
+bool HoistInstruction::apply(RirCompiler& cmp, ClosureVersion* function,
                              LogStream&) const {
-    DominanceGraph dom(function);
+    bool anyChange = false;
+    auto& dom = function->analyses().dominance(function);
 
     Visitor::run(function->entry, [&](BB* bb) {
         if (bb->isEmpty())
@@ -176,12 +178,15 @@ void HoistInstruction::apply(RirCompiler& cmp, ClosureVersion* function,
             else if (i->cost() > 0)
                 success = noUnneccessaryComputation(target, 1);
 
-            if (success)
+            if (success) {
                 next = bb->moveToLast(ip, target);
+                anyChange = true;
+            }
 
             ip = next;
         }
     });
+    return anyChange;
 }
 } // namespace pir
 } // namespace rir
@@ -11,7 +11,9 @@
 #include "utils/Pool.h"
 
 #include <algorithm>
+#include <functional>
 #include <unordered_map>
+#include <vector>
 
 namespace {
 
@@ -20,6 +22,7 @@ using namespace rir::pir;
 class TheInliner {
   public:
     ClosureVersion* version;
+    bool anyChange = false;
     explicit TheInliner(ClosureVersion* version) : version(version) {}
 
     void operator()() {
@@ -28,12 +31,39 @@ class TheInliner {
         if (version->size() > Parameter::INLINER_MAX_SIZE)
             return;
 
+        // The fuel is spent on the hottest call sites first. If there are more
+        // call sites with feedback than fuel, colder ones are skipped. Call
+        // sites which were never executed are not worth inlining at all.
+        double minFrequency = 0;
+        {
+            std::vector<double> frequencies;
+            Visitor::run(version->entry, [&](Instruction* i) {
+                if (Call::Cast(i) || StaticCall::Cast(i)) {
+                    auto f = CallInstruction::CastCall(i)->frequency;
+                    if (f >= 0)
+                        frequencies.push_back(f);
+                }
+            });
+            if (fuel > 0 && frequencies.size() > fuel) {
+                std::nth_element(frequencies.begin(),
+                                 frequencies.begin() + fuel - 1,
+                                 frequencies.end(), std::greater<double>());
+                minFrequency = frequencies[fuel - 1];
+            }
+        }
+        auto tooCold = [&](CallInstruction* call) {
+            auto f = call->frequency;
+            return f == 0 || (f > 0 && f < minFrequency);
+        };
+
         Visitor::run(version->entry, [&](BB* bb) {
             // Dangerous iterater usage, works since we do only update it in
             // one place.
             for (auto it = bb->begin(); it != bb->end() && fuel; it++) {
                 if (!CallInstruction::CastCall(*it))
                     continue;
+                if (tooCold(CallInstruction::CastCall(*it)))
+                    continue;
 
                 Closure* inlineeCls = nullptr;
                 ClosureVersion* inlinee = nullptr;
@@ -48,6 +78,9 @@ class TheInliner {
                     inlineeCls = mkcls->cls;
                     if (inlineeCls->rirFunction()->uninlinable)
                         continue;
+                    // Arguments for ... are only packed by the interpreter
+                    if (inlineeCls->formals().hasDots())
+                        continue;
                     inlinee = call->tryDispatch(inlineeCls);
                     if (!inlinee)
                         continue;
@@ -61,6 +94,9 @@ class TheInliner {
                     inlineeCls = call->cls();
                     if (inlineeCls->rirFunction()->uninlinable)
                         continue;
+                    // Arguments for ... are only packed by the interpreter
+                    if (inlineeCls->formals().hasDots())
+                        continue;
                     inlinee = call->tryDispatch();
                     if (!inlinee)
                         continue;
@@ -132,11 +168,15 @@ class TheInliner {
 
                 fuel--;
                 version->inlinees++;
+                for (auto& d : inlinee->bindingDependencies())
+                    version->addBindingDependency(d);
 
                 BB* split =
                     BBTransform::split(version->nextBBId++, bb, it, version);
+                anyChange = true;
                 auto theCall = *split->begin();
                 auto theCallInstruction = CallInstruction::CastCall(theCall);
+                auto frequency = theCallInstruction->frequency;
                 std::vector<Value*> arguments;
                 theCallInstruction->eachCallArg(
                     [&](Value* v) { arguments.push_back(v); });
@@ -193,6 +233,13 @@ class TheInliner {
                         // update. For example this happens if we inline an
                         // inner version. Then the lexical env is the current
                         // versions env.
+                        // Calls in the inlinee are executed as often as the
+                        // inlined call times their own frequency
+                        if (auto call = CallInstruction::CastCall(i)) {
+                            if (frequency >= 0 && call->frequency >= 0)
+                                call->frequency *= frequency;
+                        }
+
                         if (needsEnvPatching && i->hasEnv() &&
                             i->env() == inlineeCls->closureEnv()) {
                             i->env(staticEnv);
@@ -337,9 +384,10 @@ size_t Parameter::INLINER_INITIAL_FUEL =
         ? atoi(getenv("PIR_INLINER_INITIAL_FUEL"))
         : 5;
 
-void Inline::apply(RirCompiler&, ClosureVersion* version, LogStream&) const {
+bool Inline::apply(RirCompiler&, ClosureVersion* version, LogStream&) const {
     TheInliner s(version);
     s();
+    return s.anyChange;
 }
 } // namespace pir
 } // namespace rir
@@ -70,8 +70,9 @@ struct AvailableLoads : public StaticAnalysis<IntersectionSet<ALoad>> {
     }
 };
 
-void LoadElision::apply(RirCompiler&, ClosureVersion* function,
+bool LoadElision::apply(RirCompiler&, ClosureVersion* function,
                         LogStream& log) const {
+    bool anyChange = false;
     AvailableLoads loads(function, log);
 
     Visitor::runPostChange(function->entry, [&](BB* bb) {
@@ -84,12 +85,14 @@ void LoadElision::apply(RirCompiler&, ClosureVersion* function,
                 if (auto domld = loads.get(instr)) {
                     instr->replaceUsesWith(domld);
                     next = bb->remove(ip);
+                    anyChange = true;
                 }
             }
 
             ip = next;
         }
     });
+    return anyChange;
 }
 
 } // namespace pir
@@ -1,9 +1,15 @@
+#include "../analysis/analysis_manager.h"
+#include "../analysis/available_checkpoints.h"
 #include "../analysis/loop_detection.h"
 #include "../pir/pir_impl.h"
 #include "../util/cfg.h"
 #include "../util/safe_builtins_list.h"
 #include "pass_definitions.h"
 
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
+
 namespace rir {
 namespace pir {
 
@@ -30,7 +36,7 @@ bool isSafeToHoistLoads(const LoopDetection::Loop& loop) {
     return loop.check(noEnvironmentTainting);
 }
 
-bool overwritesBinding(LoopDetection::Loop& loop, SEXP binding) {
+bool overwritesBinding(const LoopDetection::Loop& loop, SEXP binding) {
     return loop.check(
         [binding](Instruction* i) {
             SEXP varName = nullptr;
@@ -58,10 +64,104 @@ bool overwritesBinding(LoopDetection::Loop& loop, SEXP binding) {
         });
 }
 
-void LoopInvariant::apply(RirCompiler&, ClosureVersion* function,
+static bool isInvariant(const LoopDetection::Loop& loop, Value* v) {
+    auto i = Instruction::Cast(v);
+    return !i || !loop.contains(i->bb());
+}
+
+// Instructions without effects can be executed speculatively in the preheader,
+// as soon as all their inputs are defined outside of the loop.
+static bool isPureAndInvariant(const LoopDetection::Loop& loop,
+                               Instruction* i) {
+    // Those are never hoisted
+    static std::unordered_set<Tag> blacklist = {
+        // would need patching of input branches
+        Tag::Phi,
+        // updates context
+        Tag::MkEnv,
+        // create a fresh object on every iteration
+        Tag::MkArg,
+        Tag::MkCls,
+        Tag::MkFunCls,
+        // nothing to gain
+        Tag::LdConst,
+    };
+
+    if (!i->effects.empty() || i->branchOrExit() || blacklist.count(i->tag))
+        return false;
+
+    bool invariant = true;
+    i->eachArg([&](Value* a) {
+        if (!isInvariant(loop, a))
+            invariant = false;
+    });
+    return invariant;
+}
+
+// A cast might rely on a guard in the loop, which we could not hoist
+static bool guardedInLoop(const LoopDetection::Loop& loop,
+                          const DominanceGraph& dom, Instruction* i) {
+    for (auto bb : loop) {
+        if (bb != i->bb() && !dom.dominates(bb, i->bb()))
+            continue;
+        for (auto j : *bb) {
+            if (j == i)
+                break;
+            if (Assume::Cast(j))
+                return true;
+        }
+    }
+    return false;
+}
+
+// Is bb executed on every iteration, ie. does every path from the header pass
+// through bb, before it leaves the loop or gets back to the header? Paths
+// which deoptimize do not count. Only then the guards in bb would fail in the
+// first iteration, if they fail at all.
+static bool executedOnEveryIteration(const LoopDetection::Loop& loop, BB* bb) {
+    if (bb == loop.header())
+        return true;
+    std::unordered_set<BB*> seen = {loop.header()};
+    std::vector<BB*> todo = {loop.header()};
+    while (!todo.empty()) {
+        auto cur = todo.back();
+        todo.pop_back();
+        if (cur->isExit() && !cur->isDeopt())
+            return false;
+        for (auto next : {cur->next0, cur->next1}) {
+            if (!next || next == bb || next->isDeopt())
+                continue;
+            if (next == loop.header() || !loop.contains(next))
+                return false;
+            if (seen.insert(next).second)
+                todo.push_back(next);
+        }
+    }
+    return true;
+}
+
+bool LoopInvariant::apply(RirCompiler&, ClosureVersion* function,
                           LogStream& log) const {
-    LoopDetection loops(function);
-    CFG cfg(function);
+    bool anyChange = false;
+    auto& loops = function->analyses().loops(function);
+    auto& cfg = function->analyses().cfg(function);
+    auto& dom = function->analyses().dominance(function);
+
+    // Guards are hoisted to the checkpoint available at the end of the
+    // preheader. Those need to be computed before we change anything.
+    std::unordered_map<BB*, std::pair<Checkpoint*, Instruction*>>
+        preheaderCheckpoint;
+    {
+        FwdAvailableCheckpoints checkpoint(function, log);
+        for (auto& loop : loops) {
+            BB* preheader = loop.preheader(cfg);
+            if (preheader && preheader->isJmp() && !preheader->isEmpty()) {
+                auto last = preheader->last();
+                preheaderCheckpoint[preheader] = {checkpoint.after(last),
+                                                  last};
+            }
+        }
+    }
 
     for (auto& loop : loops) {
         BB* targetBB = loop.preheader(cfg);
@@ -79,14 +179,92 @@ void LoopInvariant::apply(RirCompiler&, ClosureVersion* function,
                         binding = ldVar->varName;
                     }
 
-                    if (binding && !overwritesBinding(loop, binding))
+                    if (binding && !overwritesBinding(loop, binding)) {
                         next = bb->moveToEnd(ip, targetBB);
+                        anyChange = true;
+                    }
+
+                    ip = next;
+                }
+            }
+        }
+    }
+
+    // Innermost loops first, such that instructions hoisted out of an inner
+    // loop can be hoisted further out of the enclosing one.
+    std::vector<const LoopDetection::Loop*> nested;
+    for (auto& loop : loops)
+        nested.push_back(&loop);
+    std::sort(nested.begin(), nested.end(),
+              [](const LoopDetection::Loop* a, const LoopDetection::Loop* b) {
+                  return a->size() < b->size();
+              });
+
+    for (auto loop : nested) {
+        BB* preheader = loop->preheader(cfg);
+        if (!preheader)
+            continue;
+
+        // A failing guard deopts to a checkpoint before the loop, the
+        // interpreter then re-enters the loop at its header. This is only
+        // valid if the loads hoisted above did not invalidate the checkpoint.
+        Checkpoint* cp = nullptr;
+        auto pc = preheaderCheckpoint.find(preheader);
+        if (pc != preheaderCheckpoint.end() && pc->second.first &&
+            pc->second.second->bb() == preheader) {
+            cp = pc->second.first;
+            auto it =
+                preheader->begin() + preheader->indexOf(pc->second.second);
+            for (++it; it != preheader->end(); ++it)
+                if ((*it)->isDeoptBarrier() && !Assume::Cast(*it))
+                    cp = nullptr;
+        }
+
+        std::unordered_map<BB*, bool> everyIteration;
+        auto onEveryIteration = [&](BB* bb) {
+            auto e = everyIteration.find(bb);
+            if (e == everyIteration.end())
+                e = everyIteration
+                        .emplace(bb, executedOnEveryIteration(*loop, bb))
+                        .first;
+            return e->second;
+        };
+
+        bool changed = true;
+        while (changed) {
+            changed = false;
+            for (auto bb : *loop) {
+                auto ip = bb->begin();
+                while (ip != bb->end()) {
+                    Instruction* i = *ip;
+                    auto next = ip + 1;
+
+                    bool hoist = false;
+                    if (auto assume = Assume::Cast(i)) {
+                        if (cp && isInvariant(*loop, assume->condition()) &&
+                            onEveryIteration(bb)) {
+                            assume->checkpoint(cp);
+                            hoist = true;
+                        }
+                    } else if (CastType::Cast(i)) {
+                        hoist = isPureAndInvariant(*loop, i) &&
+                                !guardedInLoop(*loop, dom, i);
+                    } else {
+                        hoist = isPureAndInvariant(*loop, i);
+                    }
+
+                    if (hoist) {
+                        next = bb->moveToLast(ip, preheader);
+                        changed = anyChange = true;
+                    }
 
                     ip = next;
                 }
             }
         }
     }
+
+    return anyChange;
 }
 } // namespace pir
 } // namespace rir
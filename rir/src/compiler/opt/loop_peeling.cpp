@@ -0,0 +1,126 @@
+#include "../analysis/loop_detection.h"
+#include "../pir/pir_impl.h"
+#include "../transform/loop_copy.h"
+#include "../util/cfg.h"
+#include "pass_definitions.h"
+
+#include <unordered_set>
+
+namespace rir {
+namespace pir {
+
+// Number of instructions we are willing to duplicate per loop
+static const size_t MAX_PEEL_SIZE = 200;
+
+// The first iteration changes the type of a loop carried value
+static bool isTypeUnstable(const LoopDetection::Loop& loop, BB* preheader) {
+    for (auto i : *loop.header()) {
+        auto phi = Phi::Cast(i);
+        if (!phi)
+            continue;
+        Value* entry = nullptr;
+        PirType carried = PirType::bottom();
+        phi->eachArg([&](BB* in, Value* v) {
+            if (in == preheader)
+                entry = v;
+            else
+                carried = carried | v->type;
+        });
+        if (entry && !carried.isVoid() && !carried.isA(entry->type))
+            return true;
+    }
+    return false;
+}
+
+static void peel(Code* code, const LoopDetection::Loop& loop,
+                 const CFG& cfg) {
+    LoopCopy copy(code, loop, cfg);
+    BB* preheader = copy.preheader();
+    BB* header = loop.header();
+
+    // The copy executes the first iteration and then enters the loop
+    preheader->next0 = copy.header();
+    for (auto latch : copy.latches()) {
+        BB* peeled = copy.map(latch);
+        if (peeled->next0 == copy.header())
+            peeled->next0 = header;
+        if (peeled->next1 == copy.header())
+            peeled->next1 = header;
+    }
+
+    for (auto i : *header) {
+        auto phi = Phi::Cast(i);
+        if (!phi)
+            continue;
+        std::vector<std::pair<BB*, Value*>> carried;
+        phi->eachArg([&](BB* in, Value* v) {
+            if (in != preheader)
+                carried.push_back({copy.map(in), copy.map(v)});
+        });
+        phi->removeInputs({preheader});
+        for (auto c : carried)
+            phi->addInput(c.first, c.second);
+    }
+
+    // The peeled header is only entered from the preheader
+    BB* peeledHeader = copy.header();
+    auto ip = peeledHeader->begin();
+    while (ip != peeledHeader->end()) {
+        auto phi = Phi::Cast(*ip);
+        if (!phi) {
+            ip++;
+            continue;
+        }
+        Value* entry = nullptr;
+        phi->eachArg([&](BB* in, Value* v) {
+            if (in == preheader)
+                entry = v;
+        });
+        phi->replaceUsesWith(entry);
+        ip = peeledHeader->remove(ip);
+    }
+
+    for (auto i : *header)
+        if (auto phi = Phi::Cast(i))
+            phi->updateType();
+}
+
+bool LoopPeeling::apply(RirCompiler&, ClosureVersion* function,
+                        LogStream&) const {
+    bool anyChange = false;
+    std::unordered_set<BB*> peeled;
+
+    // Peeling changes the CFG, thus we recompute the loops after every step
+    while (true) {
+        CFG cfg(function);
+        DominanceGraph dom(function);
+        LoopDetection loops(function, cfg, dom, true);
+
+        const LoopDetection::Loop* candidate = nullptr;
+        for (auto& loop : loops) {
+            if (!loop.isInnermost() || peeled.count(loop.header()))
+                continue;
+            size_t size = 0;
+            for (auto bb : loop)
+                size += bb->size();
+            if (size > MAX_PEEL_SIZE)
+                continue;
+            if (!LoopCopy::supported(function, loop, cfg) ||
+                !isTypeUnstable(loop, loop.preheader(cfg)))
+                continue;
+            candidate = &loop;
+            break;
+        }
+        if (!candidate)
+            break;
+
+        peeled.insert(candidate->header());
+        peel(function, *candidate, cfg);
+        anyChange = true;
+    }
+
+    return anyChange;
+}
+
+} // namespace pir
+} // namespace rir
@@ -0,0 +1,169 @@
+#include "../analysis/loop_detection.h"
+#include "../pir/pir_impl.h"
+#include "../transform/loop_copy.h"
+#include "../transform/replace.h"
+#include "../util/cfg.h"
+#include "pass_definitions.h"
+
+#include <unordered_set>
+
+namespace rir {
+namespace pir {
+
+// Number of instructions we are willing to duplicate per loop
+static const size_t MAX_VERSION_SIZE = 300;
+// Number of checks before entering the fast loop
+static const size_t MAX_VERSION_CHECKS = 4;
+
+typedef std::vector<std::pair<Instruction*, PirType>> Versions;
+
+// Loop invariant vectors which are accessed in the loop, and have a more
+// precise type feedback. Like TypeSpeculation we can only check for
+// numbers and non objects.
+static Versions candidates(const LoopDetection::Loop& loop) {
+    Versions res;
+    std::unordered_set<Instruction*> seen;
+    for (auto bb : loop) {
+        for (auto i : *bb) {
+            switch (i->tag) {
+            case Tag::Extract1_1D:
+            case Tag::Extract2_1D:
+            case Tag::Extract1_2D:
+            case Tag::Extract2_2D:
+            case Tag::ForSeqSize:
+                break;
+            default:
+                continue;
+            }
+            auto vec = Instruction::Cast(i->arg(0).val());
+            if (!vec || loop.contains(vec->bb()) || seen.count(vec))
+                continue;
+            seen.insert(vec);
+
+            PirType type = vec->typeFeedback;
+            if (type.isVoid() || type.maybeObj() || type.maybeLazy() ||
+                vec->type.maybeLazy() || vec->type.maybePromiseWrapped())
+                continue;
+            PirType specType =
+                (type.isA(RType::integer) || type.isA(RType::real))
+                    ? type
+                    : vec->type.notObject();
+            if (vec->type.isA(specType))
+                continue;
+            res.push_back({vec, specType});
+            if (res.size() == MAX_VERSION_CHECKS)
+                return res;
+        }
+    }
+    return res;
+}
+
+// Returns the header of the specialized loop
+static BB* version(Code* code, const LoopDetection::Loop& loop,
+                   const CFG& cfg, const Versions& versions) {
+    LoopCopy copy(code, loop, cfg);
+    BB* preheader = copy.preheader();
+
+    // The original loop is the generic fallback, the copy is specialized
+    BB* generic = new BB(code, code->nextBBId++);
+    generic->setNext(loop.header());
+    BB* fast = new BB(code, code->nextBBId++);
+    fast->setNext(copy.header());
+
+    BB* check = preheader;
+    for (size_t n = 0; n < versions.size(); ++n) {
+        auto vec = versions[n].first;
+        auto type = versions[n].second;
+
+        Instruction* condition;
+        bool expected = true;
+        if (type.isA(RType::integer) || type.isA(RType::real)) {
+            condition = new IsType(type, vec);
+        } else {
+            condition = new IsObject(vec);
+            expected = false;
+        }
+        check->append(condition);
+        check->append(new Branch(condition));
+
+        // Every failing check gets its own edge, to avoid critical edges
+        BB* fail = new BB(code, code->nextBBId++);
+        fail->setNext(generic);
+        BB* next = n + 1 == versions.size() ? fast
+                                             : new BB(code, code->nextBBId++);
+        if (expected)
+            check->setBranch(next, fail);
+        else
+            check->setBranch(fail, next);
+        check = next;
+    }
+
+    for (auto i : *loop.header()) {
+        if (auto phi = Phi::Cast(i)) {
+            for (size_t j = 0; j < phi->nargs(); ++j)
+                if (phi->inputAt(j) == preheader)
+                    phi->updateInputAt(j, generic);
+        }
+    }
+    for (auto i : *copy.header()) {
+        if (auto phi = Phi::Cast(i)) {
+            for (size_t j = 0; j < phi->nargs(); ++j)
+                if (phi->inputAt(j) == preheader)
+                    phi->updateInputAt(j, fast);
+        }
+    }
+
+    for (auto v : versions) {
+        auto cast = new CastType(v.first, PirType::any(), v.second);
+        fast->append(cast);
+        for (auto bb : copy.blocks())
+            for (auto i : *bb)
+                Replace::usesOfValue(i, v.first, cast);
+    }
+
+    return copy.header();
+}
+
+bool LoopVersioning::apply(RirCompiler&, ClosureVersion* function,
+                           LogStream&) const {
+    bool anyChange = false;
+    std::unordered_set<BB*> versioned;
+
+    // Versioning changes the CFG, thus we recompute the loops after every
+    // step
+    while (true) {
+        CFG cfg(function);
+        DominanceGraph dom(function);
+        LoopDetection loops(function, cfg, dom, true);
+
+        const LoopDetection::Loop* candidate = nullptr;
+        Versions versions;
+        for (auto& loop : loops) {
+            if (!loop.isInnermost() || versioned.count(loop.header()))
+                continue;
+            size_t size = 0;
+            for (auto bb : loop)
+                size += bb->size();
+            if (size > MAX_VERSION_SIZE ||
+                !LoopCopy::supported(function, loop, cfg))
+                continue;
+            versions = candidates(loop);
+            if (versions.empty())
+                continue;
+            candidate = &loop;
+            break;
+        }
+        if (!candidate)
+            break;
+
+        // Neither the generic nor the specialized loop is versioned again
+        versioned.insert(candidate->header());
+        versioned.insert(version(function, *candidate, cfg, versions));
+        anyChange = true;
+    }
+
+    return anyChange;
+}
+
+} // namespace pir
+} // namespace rir
@@ -9,24 +9,37 @@ namespace pir {
 
 class Closure;
 
-#define PASS(name)                                                             \
+#define PASS_WITH(name, properties)                                            \
     name:                                                                      \
   public                                                                       \
     PirTranslator {                                                            \
       public:                                                                  \
         name() : PirTranslator(#name){};                                       \
-        void apply(RirCompiler&, ClosureVersion* function, LogStream& log)     \
+        bool apply(RirCompiler&, ClosureVersion* function, LogStream& log)     \
             const final override;                                              \
+        properties                                                             \
     };
 
+#define PASS(name) PASS_WITH(name, )
+
+// Properties of a pass, see PirTranslator
+#define INTERPROCEDURAL                                                        \
+    bool isInterprocedural() const final override { return true; }
+#define PRESERVES_CFG                                                          \
+    bool preservesCFG() const final override { return true; }
+#define PARALLEL                                                               \
+    bool isParallelizable() const final override { return true; }
+
 /*
  * Uses scope analysis to get rid of as many `LdVar`'s as possible.
  *
  * Similar to llvm's mem2reg pass, we try to lift as many loads from the R
  * environment, to pir SSA variables.
  *
+ * Interprocedural, because the scope analysis looks into the versions that
+ * calls dispatch to.
  */
-class PASS(ScopeResolution);
+class PASS_WITH(ScopeResolution, INTERPROCEDURAL PRESERVES_CFG);
 
 /*
  * ElideEnv removes envrionments which are not needed. It looks at all uses of
@@ -36,7 +49,7 @@ class PASS(ScopeResolution);
  *
  */
 
-class PASS(ElideEnv);
+class PASS_WITH(ElideEnv, PRESERVES_CFG PARALLEL);
 
 /*
  * This pass searches for dominating force instructions.
@@ -52,7 +65,7 @@ class PASS(ForceDominance);
  * DelayInstr tries to schedule instructions right before they are needed.
  *
  */
-class PASS(DelayInstr);
+class PASS_WITH(DelayInstr, PRESERVES_CFG PARALLEL);
 
 /*
  * The DelayEnv pass tries to delay the scheduling of `MkEnv` instructions as
@@ -60,7 +73,7 @@ class PASS(DelayInstr);
  * the goal is to move it out of the others.
  *
  */
-class PASS(DelayEnv);
+class PASS_WITH(DelayEnv, PRESERVES_CFG PARALLEL);
 
 /*
  * Inlines a closure. Intentionally stupid. It does not resolve inner
@@ -68,7 +81,7 @@ class PASS(DelayEnv);
  * with multiple environments. Later scope resolution and force dominance
  * passes will do the smart parts.
  */
-class PASS(Inline);
+class PASS_WITH(Inline, INTERPROCEDURAL);
 
 /*
  * Goes through every operation that for the general case needs an environment
@@ -100,7 +113,7 @@ class PASS(Cleanup);
  * Checkpoints keep values alive. Thus it makes sense to remove them if they
  * are unused after a while.
  */
-class PASS(CleanupCheckpoints);
+class PASS_WITH(CleanupCheckpoints, PARALLEL);
 
 /*
  * Unused framestate instructions usually get removed automatically. Except
@@ -109,46 +122,92 @@ class PASS(CleanupCheckpoints);
  * that they can be removed later, if they are not actually used by any
  * checkpoint/deopt.
  */
-class PASS(CleanupFramestate);
+class PASS_WITH(CleanupFramestate, PRESERVES_CFG PARALLEL);
 
 /*
  * Trying to group assumptions, by pushing them up. This well lead to fewer
  * checkpoints being used overall.
  */
-class PASS(OptimizeAssumptions);
+class PASS_WITH(OptimizeAssumptions, PARALLEL);
 
-class PASS(EagerCalls);
+class PASS_WITH(EagerCalls, INTERPROCEDURAL);
 
-class PASS(OptimizeVisibility);
+class PASS_WITH(OptimizeVisibility, PRESERVES_CFG PARALLEL);
 
-class PASS(OptimizeContexts);
+class PASS_WITH(OptimizeContexts, PRESERVES_CFG PARALLEL);
 
-class PASS(DeadStoreRemoval);
+class PASS_WITH(DeadStoreRemoval, PRESERVES_CFG PARALLEL);
 
 /*
- * At this point, loop code invariant mainly tries to hoist ldFun operations
- * outside the loop in case it can prove that the loop body will not change
- * the binding
+ * Loop invariant code motion. Hoists ldFun and ldVar operations outside the
+ * loop in case it can prove that the loop body will not change the binding.
+ * Instructions without effects and invariant inputs are moved to the
+ * preheader, and so are guards on invariant conditions, which then deopt to
+ * the checkpoint before the loop.
  */
-class PASS(LoopInvariant);
+class PASS_WITH(LoopInvariant, PRESERVES_CFG PARALLEL);
 
-class PASS(GVN);
+class PASS_WITH(GVN, PRESERVES_CFG PARALLEL);
 
-class PASS(LoadElision);
+class PASS_WITH(LoadElision, PRESERVES_CFG PARALLEL);
 
-class PASS(TypeInference);
+class PASS_WITH(TypeInference, PRESERVES_CFG);
 
-class PASS(TypeSpeculation);
+class PASS_WITH(TypeSpeculation, PARALLEL);
 
 /*
  * Loop Invariant Code motion
  */
-class PASS(HoistInstruction);
+class PASS_WITH(HoistInstruction, PRESERVES_CFG PARALLEL);
+
+/*
+ * Peels the first iteration of innermost loops, where it changes the type of a
+ * loop carried value. The remaining iterations then see the stable type.
+ */
+class PASS_WITH(LoopPeeling, PARALLEL);
+
+/*
+ * Duplicates innermost loops which access loop invariant vectors with
+ * imprecise types. A check before the loop selects the copy specialized to
+ * the type feedback, the original loop is the fallback.
+ */
+class PASS_WITH(LoopVersioning, PARALLEL);
+
+/*
+ * Escape analysis for small vectors and lists created by c(), list() and
+ * vector(). If they are only read and updated at constant indices, the
+ * elements are kept in SSA values and the allocation is removed.
+ */
+class PASS_WITH(ScalarReplacement, PRESERVES_CFG);
+
+/*
+ * Fuses trees of elementwise arithmetic, comparisons and math builtins on
+ * real vectors into one FusedArith instruction, which is evaluated in a
+ * single pass without temporary vectors. Other passes do not know about
+ * FusedArith, thus this runs during lowering.
+ */
+class PASS_WITH(VectorFusion, PRESERVES_CFG PARALLEL);
+
+/*
+ * Uses the range analysis to mark vector accesses, whose index is provably
+ * within bounds and not NA. Those are lowered to unchecked bytecodes. The
+ * marks are only valid for the final code, so this has to run last.
+ */
+class PASS_WITH(BoundsCheckElision, PRESERVES_CFG PARALLEL);
+
+/*
+ * Turns static calls to the version itself, whose result is returned, into a
+ * jump back to the entry. Only done if the frame is not reflected and the
+ * arguments are eager, the new values are passed in phis. Interprocedural,
+ * because which version a call dispatches to depends on the other versions.
+ */
+class PASS_WITH(TailCalls, INTERPROCEDURAL PARALLEL);
 
 class PhaseMarker : public PirTranslator {
   public:
     explicit PhaseMarker(const std::string& name) : PirTranslator(name) {}
-    void apply(RirCompiler&, ClosureVersion*, LogStream&) const final override {
+    bool apply(RirCompiler&, ClosureVersion*, LogStream&) const final override {
+        return false;
     }
     bool isPhaseMarker() const final override { return true; }
 };
@@ -157,5 +216,9 @@ class PhaseMarker : public PirTranslator {
 } // namespace rir
 
 #undef PASS
+#undef PASS_WITH
+#undef INTERPROCEDURAL
+#undef PRESERVES_CFG
+#undef PARALLEL
 
 #endif
@@ -17,7 +17,14 @@ void PassScheduler::add(std::unique_ptr<const PirTranslator>&& t) {
     auto name = t->getName();
     if (std::regex_match(name.begin(), name.end(), PIR_PASS_BLACKLIST))
         return;
-    schedule_.push_back(std::move(t));
+    assert(!phases_.empty());
+    phases_.back().passes.push_back(std::move(t));
+}
+
+void PassScheduler::nextPhase(const std::string& name, unsigned budget) {
+    phases_.emplace_back(name, budget);
+    phases_.back().marker =
+        std::unique_ptr<const PirTranslator>(new PhaseMarker(name));
 }
 
 PassScheduler::PassScheduler() {
@@ -38,31 +45,41 @@ PassScheduler::PassScheduler() {
         add<Inline>();
         add<OptimizeContexts>();
         add<LoadElision>();
+        add<ScalarReplacement>();
         add<GVN>();
         add<OptimizeAssumptions>();
         add<Cleanup>();
         add<TypeInference>();
     };
 
-    add<PhaseMarker>("Initial");
+    // Only logs the initial state
+    nextPhase("Initial", 0);
 
-    // ==== Phase 1) Run the default passes a couple of times
-    for (size_t i = 0; i < 3; ++i)
-        addDefaultOpt();
+    // ==== Phase 1) Run the default passes until they converge
+    nextPhase("Phase 1", 3);
+    addDefaultOpt();
 
-    add<PhaseMarker>("Phase 1");
+    // ==== Phase 1.1) Peel loops with unstable types
+    //
+    // Needs the environments elided in Phase 1, such that loop carried
+    // values are phis. Only run once, to bound code growth.
+    nextPhase("Phase 1.1: Loop peeling", 1);
+    add<LoopPeeling>();
+    addDefaultOpt();
 
     // ==== Phase 2) Speculate away environments
     //
     // This pass is scheduled second, since we want to first try to do this
     // statically in Phase 1
+    nextPhase("Phase 2: Env speculation", 2);
     add<TypeSpeculation>();
     add<ElideEnvSpec>();
     addDefaultOpt();
-    add<TypeSpeculation>();
-    add<ElideEnvSpec>();
 
-    add<PhaseMarker>("Phase 2: Env speculation");
+    // ==== Phase 2.1) Version loops on the types we did not speculate on
+    nextPhase("Phase 2.1: Loop versioning", 1);
+    add<LoopVersioning>();
+    addDefaultOpt();
 
     // ==== Phase 3) Remove checkpoints we did not use
     //
@@ -71,9 +88,9 @@ PassScheduler::PassScheduler() {
     // Since for example even unused checkpoints keep variables live.
     //
     // After this phase it is no longer possible to add assumptions at any point
+    nextPhase("Phase 3: Cleanup Checkpoints", 2);
     add<CleanupCheckpoints>();
-    for (size_t i = 0; i < 2; ++i)
-        addDefaultOpt();
+    addDefaultOpt();
 
     // ==== Phase 3.1) Remove Framestates we did not use
     //
@@ -81,17 +98,23 @@ PassScheduler::PassScheduler() {
     // dependency and the framestates will subsequently be cleaned.
     //
     // After this pass it is no longer possible to inline callees with deopts
+    nextPhase("Phase 3.1: Cleanup Framestates", 1);
     add<CleanupFramestate>();
     add<CleanupCheckpoints>();
 
-    add<PhaseMarker>("Phase 3: Cleanup Checkpoints");
-
     // ==== Phase 4) Final round of default opts
-    for (size_t i = 0; i < 3; ++i) {
-        addDefaultOpt();
-        add<CleanupCheckpoints>();
-    }
-    add<PhaseMarker>("Phase 4: finished");
+    //
+    // Self tail calls are turned into loops once the environment is elided
+    // and the framestates of calls are gone.
+    nextPhase("Phase 4: finished", 3);
+    add<TailCalls>();
+    addDefaultOpt();
+    add<CleanupCheckpoints>();
+
+    // ==== Phase 5) Annotate the final code for lowering
+    nextPhase("Phase 5: Lowering", 1);
+    add<VectorFusion>();
+    add<BoundsCheckElision>();
 }
 }
 }
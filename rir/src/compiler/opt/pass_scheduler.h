@@ -7,33 +7,47 @@
 namespace rir {
 namespace pir {
 
+/*
+ * The optimization pipeline is a list of phases. The passes of a phase are
+ * repeated until none of them changes the IR anymore (a fixpoint), or until
+ * the iteration budget of the phase is exhausted. Each phase ends with a
+ * PhaseMarker, which is only used for logging.
+ */
 class PassScheduler {
   public:
     typedef std::vector<std::unique_ptr<const PirTranslator>> Schedule;
 
+    struct Phase {
+        Phase(const std::string& name, unsigned budget)
+            : name(name), budget(budget) {}
+        std::string name;
+        // Maximal number of rounds over the passes of this phase
+        unsigned budget;
+        Schedule passes;
+        std::unique_ptr<const PirTranslator> marker;
+    };
+    typedef std::vector<Phase> Phases;
+
     const static PassScheduler& instance() {
         static PassScheduler i;
         return i;
     }
 
-    Schedule::const_iterator begin() const { return schedule_.cbegin(); }
-    Schedule::const_iterator end() const { return schedule_.cend(); }
+    Phases::const_iterator begin() const { return phases_.cbegin(); }
+    Phases::const_iterator end() const { return phases_.cend(); }
 
   private:
     PassScheduler();
 
-    Schedule schedule_;
+    Phases phases_;
 
+    void nextPhase(const std::string& name, unsigned budget);
     void add(std::unique_ptr<const PirTranslator>&&);
 
     template <typename PASS>
     void add() {
         add(std::unique_ptr<const PirTranslator>(new PASS()));
     }
-    template <typename PASS>
-    void add(const std::string& name) {
-        add(std::unique_ptr<const PirTranslator>(new PASS(name)));
-    }
 };
 }
 }
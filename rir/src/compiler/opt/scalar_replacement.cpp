@@ -0,0 +1,310 @@
+#include "../pir/pir_impl.h"
+#include "../util/visitor.h"
+#include "R/Funtab.h"
+#include "R/r.h"
+#include "pass_definitions.h"
+
+#include <algorithm>
+#include <unordered_map>
+
+namespace rir {
+namespace pir {
+
+// Number of elements we are willing to keep in SSA values
+static const size_t MAX_ELEMENTS = 8;
+
+// Scalars which provably have no attributes, e.g. no names
+static bool isPlainScalar(Value* v, unsigned depth = 0) {
+    if (!v->type.isA(PirType::simpleScalar()))
+        return false;
+    if (v == True::instance() || v == False::instance() ||
+        v == NaLogical::instance())
+        return true;
+    auto i = Instruction::Cast(v);
+    if (!i || depth > 4)
+        return false;
+    switch (i->tag) {
+    case Tag::LdConst: {
+        SEXP c = LdConst::Cast(i)->c();
+        return IS_SIMPLE_SCALAR(c, TYPEOF(c));
+    }
+    case Tag::Length:
+    case Tag::ForSeqSize:
+    case Tag::Inc:
+    case Tag::Dec:
+        return true;
+    case Tag::Extract2_1D:
+    case Tag::Extract2_2D:
+        // [[ drops the attributes of atomic vectors
+        return i->arg(0).val()->type.isA(
+            (PirType(RType::logical) | RType::integer | RType::real)
+                .notObject());
+    case Tag::Add:
+    case Tag::Sub:
+    case Tag::Mul:
+    case Tag::Div:
+    case Tag::Lt:
+    case Tag::Gt:
+    case Tag::Lte:
+    case Tag::Gte:
+    case Tag::Eq:
+    case Tag::Neq:
+        return isPlainScalar(i->arg(0).val(), depth + 1) &&
+               isPlainScalar(i->arg(1).val(), depth + 1);
+    default:
+        return false;
+    }
+}
+
+// The type of a scalar, if it has exactly one
+static bool scalarType(Value* v, RType& type) {
+    for (auto t : {RType::logical, RType::integer, RType::real}) {
+        if (v->type.isA(t)) {
+            type = t;
+            return true;
+        }
+    }
+    return false;
+}
+
+// 1-based constant index, or 0
+static size_t constantIndex(Value* v, size_t length) {
+    auto ld = LdConst::Cast(v);
+    if (!ld)
+        return 0;
+    SEXP c = ld->c();
+    double idx;
+    if (IS_SIMPLE_SCALAR(c, INTSXP) && INTEGER(c)[0] != NA_INTEGER)
+        idx = INTEGER(c)[0];
+    else if (IS_SIMPLE_SCALAR(c, REALSXP) && !ISNAN(REAL(c)[0]))
+        idx = REAL(c)[0];
+    else
+        return 0;
+    if (idx < 1 || idx > length || idx != (size_t)idx)
+        return 0;
+    return idx;
+}
+
+/*
+ * A small vector or list allocated by c(), list() or vector(). The elements
+ * are the SSA values stored in it, nullptr stands for the initial value of
+ * vector().
+ */
+struct Aggregate {
+    Instruction* alloc = nullptr;
+    // Atomic vectors hold plain scalars of one type, lists any value
+    bool atomic = false;
+    RType elementType = RType::logical;
+    std::vector<Value*> elements;
+    // Type of the initial elements of vector(), NILSXP for lists
+    SEXPTYPE zeroType = NILSXP;
+
+    bool validElement(Value* v) const {
+        RType type;
+        if (atomic)
+            return isPlainScalar(v) && scalarType(v, type) &&
+                   type == elementType;
+        return v->type.isA(PirType::val()) && !v->type.maybe(RType::nil) &&
+               !MkArg::Cast(v);
+    }
+};
+
+static bool isAggregate(Instruction* i, Aggregate& agg) {
+    static int c = findBuiltin("c");
+    static int list = findBuiltin("list");
+    static int vector = findBuiltin("vector");
+
+    auto call = CallSafeBuiltin::Cast(i);
+    if (!call)
+        return false;
+    agg.alloc = call;
+
+    if (call->builtinId == list) {
+        if (call->nCallArgs() == 0 || call->nCallArgs() > MAX_ELEMENTS)
+            return false;
+        bool ok = true;
+        call->eachCallArg([&](Value* v) {
+            // list(NULL) is fine, but assigning NULL deletes the element
+            if (!v->type.isA(PirType::val()) || MkArg::Cast(v))
+                ok = false;
+            agg.elements.push_back(v);
+        });
+        return ok;
+    }
+
+    if (call->builtinId == c) {
+        if (call->nCallArgs() == 0 || call->nCallArgs() > MAX_ELEMENTS)
+            return false;
+        agg.atomic = true;
+        if (!scalarType(call->arg(0).val(), agg.elementType))
+            return false;
+        bool ok = true;
+        call->eachCallArg([&](Value* v) {
+            if (!agg.validElement(v))
+                ok = false;
+            agg.elements.push_back(v);
+        });
+        return ok;
+    }
+
+    if (call->builtinId == vector) {
+        if (call->nCallArgs() != 2)
+            return false;
+        auto mode = LdConst::Cast(call->arg(0).val());
+        if (!mode || !IS_SIMPLE_SCALAR(mode->c(), STRSXP))
+            return false;
+        size_t length = constantIndex(call->arg(1).val(), MAX_ELEMENTS);
+        if (!length)
+            return false;
+        std::string m = CHAR(STRING_ELT(mode->c(), 0));
+        if (m == "list") {
+            agg.zeroType = NILSXP;
+        } else if (m == "logical") {
+            agg.zeroType = LGLSXP;
+            agg.atomic = true;
+        } else if (m == "integer") {
+            agg.zeroType = INTSXP;
+            agg.atomic = true;
+            agg.elementType = RType::integer;
+        } else if (m == "numeric" || m == "double") {
+            agg.zeroType = REALSXP;
+            agg.atomic = true;
+            agg.elementType = RType::real;
+        } else {
+            return false;
+        }
+        agg.elements.resize(length, nullptr);
+        return true;
+    }
+
+    return false;
+}
+
+static void removeKeepingVisibility(Instruction* i) {
+    auto bb = i->bb();
+    if (!i->hasVisibility())
+        bb->remove(i);
+    else if (i->visibilityFlag() == VisibilityFlag::Off)
+        bb->replace(bb->atPosition(i), new Invisible());
+    else
+        bb->replace(bb->atPosition(i), new Visible());
+}
+
+// Replaces all accesses to the aggregate and its updated versions with the
+// elements, if none of them escape. Returns false if nothing was changed.
+static bool scalarReplace(ClosureVersion* function, Aggregate& agg) {
+    std::unordered_map<Value*, std::vector<Instruction*>> uses;
+    Visitor::run(function->entry, [&](Instruction* i) {
+        i->eachArg([&](Value* v) { uses[v].push_back(i); });
+    });
+
+    auto n = agg.elements.size();
+    std::unordered_map<Instruction*, std::vector<Value*>> versions;
+    std::vector<Instruction*> order = {agg.alloc};
+    std::vector<std::pair<Instruction*, Value*>> reads;
+    std::vector<Instruction*> lengths;
+    versions[agg.alloc] = agg.elements;
+
+    for (size_t pos = 0; pos < order.size(); ++pos) {
+        auto version = order[pos];
+        for (auto use : uses[version]) {
+            switch (use->tag) {
+            case Tag::Length:
+                lengths.push_back(use);
+                continue;
+
+            case Tag::Extract1_1D:
+            case Tag::Extract2_1D: {
+                if (!agg.atomic && use->tag == Tag::Extract1_1D)
+                    return false;
+                auto idx = constantIndex(use->arg(1).val(), n);
+                if (use->arg(0).val() != version || !idx)
+                    return false;
+                reads.push_back({use, versions.at(version)[idx - 1]});
+                continue;
+            }
+
+            case Tag::Subassign1_1D:
+            case Tag::Subassign2_1D: {
+                if (!agg.atomic && use->tag == Tag::Subassign1_1D)
+                    return false;
+                auto val = use->arg(0).val();
+                auto idx = constantIndex(use->arg(2).val(), n);
+                if (use->arg(1).val() != version || val == version || !idx ||
+                    !agg.validElement(val))
+                    return false;
+                if (versions.count(use))
+                    continue;
+                auto elements = versions.at(version);
+                elements[idx - 1] = val;
+                versions[use] = elements;
+                order.push_back(use);
+                continue;
+            }
+
+            default:
+                // Escapes
+                return false;
+            }
+        }
+    }
+
+    Instruction* zero = nullptr;
+    if (std::count(agg.elements.begin(), agg.elements.end(), nullptr)) {
+        switch (agg.zeroType) {
+        case LGLSXP:
+            zero = new LdConst(R_FalseValue);
+            break;
+        case INTSXP:
+            zero = new LdConst(0);
+            break;
+        case REALSXP:
+            zero = new LdConst(PROTECT(Rf_ScalarReal(0)));
+            UNPROTECT(1);
+            break;
+        default:
+            zero = new LdConst(R_NilValue);
+        }
+        agg.alloc->bb()->insert(agg.alloc->bb()->atPosition(agg.alloc), zero);
+    }
+
+    // Elements might be reads of the same aggregate, e.g. p[[2]] <- p[[1]]
+    std::unordered_map<Value*, Value*> replaced;
+    for (auto r : reads)
+        replaced[r.first] = r.second ? r.second : zero;
+    for (auto r : reads) {
+        Value* val = replaced.at(r.first);
+        while (replaced.count(val))
+            val = replaced.at(val);
+        r.first->replaceUsesWith(val);
+        removeKeepingVisibility(r.first);
+    }
+    for (auto l : lengths) {
+        auto length = new LdConst((int)n);
+        l->bb()->insert(l->bb()->atPosition(l), length);
+        l->replaceUsesWith(length);
+        removeKeepingVisibility(l);
+    }
+    for (auto v = order.rbegin(); v != order.rend(); ++v)
+        removeKeepingVisibility(*v);
+    return true;
+}
+
+bool ScalarReplacement::apply(RirCompiler&, ClosureVersion* function,
+                              LogStream&) const {
+    bool anyChange = false;
+    std::vector<Aggregate> candidates;
+    Visitor::run(function->entry, [&](Instruction* i) {
+        Aggregate agg;
+        if (isAggregate(i, agg))
+            candidates.push_back(agg);
+    });
+
+    for (auto& agg : candidates)
+        if (scalarReplace(function, agg))
+            anyChange = true;
+    return anyChange;
+}
+
+} // namespace pir
+} // namespace rir
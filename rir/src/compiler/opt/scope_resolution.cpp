@@ -1,3 +1,4 @@
+#include "../analysis/analysis_manager.h"
 #include "../analysis/query.h"
 #include "../analysis/scope.h"
 #include "../pir/pir_impl.h"
@@ -80,20 +81,26 @@ static bool noReflection(Code* code, Value* callEnv, ScopeAnalysis& analysis,
 class TheScopeResolution {
   public:
     ClosureVersion* function;
-    CFG cfg;
-    DominanceGraph dom;
-    DominanceFrontier dfront;
+    const CFG& cfg;
+    const DominanceGraph& dom;
+    const DominanceFrontier& dfront;
     LogStream& log;
+    bool anyChange = false;
     explicit TheScopeResolution(ClosureVersion* function, LogStream& log)
-        : function(function), cfg(function), dom(function),
-          dfront(function, cfg, dom), log(log) {}
+        : function(function), cfg(function->analyses().cfg(function)),
+          dom(function->analyses().dominance(function)),
+          dfront(function->analyses().dominanceFrontier(function)), log(log) {}
 
     void operator()() {
         ScopeAnalysis analysis(function, log);
         analysis();
         auto& finalState = analysis.result();
-        if (finalState.noReflection())
+        if (finalState.noReflection() &&
+            !function->properties.includes(
+                ClosureVersion::Property::NoReflection)) {
             function->properties.set(ClosureVersion::Property::NoReflection);
+            anyChange = true;
+        }
 
         std::unordered_map<Value*, Value*> replacedValue;
         auto getReplacedValue = [&](Value* val) {
@@ -202,6 +209,7 @@ class TheScopeResolution {
                 };
 
                 pos->insert(pos->begin(), phi);
+                anyChange = true;
                 // If the insert changed the current bb, we need to keep the
                 // iterator updated
                 if (pos == bb)
@@ -233,9 +241,12 @@ class TheScopeResolution {
                     if (after.noReflection()) {
                         i->elideEnv();
                         i->effects.reset(Effect::Reflection);
+                        anyChange = true;
                     }
-                    if (after.envNotEscaped(i->env())) {
+                    if (after.envNotEscaped(i->env()) &&
+                        i->effects.contains(Effect::LeaksEnv)) {
                         i->effects.reset(Effect::LeaksEnv);
+                        anyChange = true;
                     }
                 }
 
@@ -246,8 +257,10 @@ class TheScopeResolution {
                                 if (noReflection(mk->prom(),
                                                  i->hasEnv() ? i->env()
                                                              : Env::notClosed(),
-                                                 analysis, before))
+                                                 analysis, before)) {
                                     mk->noReflection = true;
+                                    anyChange = true;
+                                }
                         }
                     });
                 }
@@ -268,6 +281,7 @@ class TheScopeResolution {
                             if (LdArg::Cast(arg)) {
                                 force->elideEnv();
                                 force->effects.reset(Effect::Reflection);
+                                anyChange = true;
                             }
                         }
                     }
@@ -286,6 +300,7 @@ class TheScopeResolution {
                         bb->replace(ip, r);
                         sts->replaceUsesWith(r);
                         replacedValue[sts] = r;
+                        anyChange = true;
                     }
                     ip = next;
                     continue;
@@ -317,6 +332,7 @@ class TheScopeResolution {
                                 auto theFalse = new LdConst(R_FalseValue);
                                 missing->replaceUsesAndSwapWith(theFalse, ip);
                                 replacedValue[missing] = theFalse;
+                                anyChange = true;
                             }
                         }
                     } else {
@@ -325,6 +341,7 @@ class TheScopeResolution {
                                 auto theTruth = new LdConst(R_TrueValue);
                                 missing->replaceUsesAndSwapWith(theTruth, ip);
                                 replacedValue[missing] = theTruth;
+                                anyChange = true;
                             }
                         });
                     }
@@ -366,6 +383,7 @@ class TheScopeResolution {
                                         ip++;
                                         next = ip + 1;
                                         mk->replaceUsesWithLimits(deoptEnv, bb);
+                                        anyChange = true;
                                     });
                             }
                         }
@@ -395,6 +413,7 @@ class TheScopeResolution {
                                 replacedValue[i] = val;
                                 i->replaceUsesWith(val);
                                 next = bb->remove(ip);
+                                anyChange = true;
                                 return;
                             }
                         }
@@ -403,8 +422,10 @@ class TheScopeResolution {
                     // Narrow down type according to what the analysis reports
                     if (i->type.isRType()) {
                         auto inferedType = res.type;
-                        if (!i->type.isA(inferedType))
+                        if (!i->type.isA(inferedType)) {
                             i->type = inferedType;
+                            anyChange = true;
+                        }
                     }
 
                     // The generic case where we have a bunch of potential
@@ -433,6 +454,7 @@ class TheScopeResolution {
                             i->replaceUsesWith(val);
                             replacedValue[i] = val;
                             next = bb->remove(ip);
+                            anyChange = true;
                             return;
                         }
                     }
@@ -446,6 +468,7 @@ class TheScopeResolution {
                             bb->replace(ip, r);
                             lds->replaceUsesWith(r);
                             replacedValue[lds] = r;
+                            anyChange = true;
                         }
                         return;
                     }
@@ -486,6 +509,7 @@ class TheScopeResolution {
                                 ldfun->replaceUsesWith(guess);
                                 replacedValue[ldfun] = guess;
                                 next = bb->remove(ip);
+                                anyChange = true;
                                 return;
                             }
                         } else {
@@ -498,6 +522,7 @@ class TheScopeResolution {
                                     ip, new Force(firstBinding, ldfun->env()));
                                 ldfun->guessedBinding(*ip);
                                 next = ip + 2;
+                                anyChange = true;
                                 return;
                             }
                         }
@@ -506,8 +531,11 @@ class TheScopeResolution {
                     // If nothing else, narrow down the environment (in case we
                     // found something more concrete).
                     if (i->hasEnv() &&
-                        aLoad.env != AbstractREnvironment::UnknownParent)
+                        aLoad.env != AbstractREnvironment::UnknownParent &&
+                        i->env() != aLoad.env) {
                         i->env(aLoad.env);
+                        anyChange = true;
+                    }
                 });
 
                 if (auto b = CallBuiltin::Cast(i)) {
@@ -535,6 +563,7 @@ class TheScopeResolution {
                         b->replaceUsesWith(safe);
                         bb->replace(ip, safe);
                         replacedValue[b] = safe;
+                        anyChange = true;
                     }
                 }
 
@@ -548,10 +577,11 @@ class TheScopeResolution {
 namespace rir {
 namespace pir {
 
-void ScopeResolution::apply(RirCompiler&, ClosureVersion* function,
+bool ScopeResolution::apply(RirCompiler&, ClosureVersion* function,
                             LogStream& log) const {
     TheScopeResolution s(function, log);
     s();
+    return s.anyChange;
 }
 
 } // namespace pir
@@ -0,0 +1,113 @@
+#include "../pir/pir_impl.h"
+#include "../util/visitor.h"
+#include "pass_definitions.h"
+
+#include <unordered_map>
+
+namespace rir {
+namespace pir {
+
+// A static call to the version itself, whose result is returned right away
+static bool isSelfTailCall(ClosureVersion* function, StaticCall* call) {
+    if (call->tryDispatch() != function ||
+        call->nCallArgs() != function->nargs())
+        return false;
+    auto bb = call->bb();
+    auto it = bb->atPosition(call);
+    if (it + 1 == bb->end())
+        return false;
+    auto ret = Return::Cast(*(it + 1));
+    if (!ret || ret->arg<0>().val() != call || call->hasSingleUse() != ret)
+        return false;
+    bool eager = true;
+    call->eachCallArg([&](Value* v) {
+        auto mk = MkArg::Cast(v);
+        if (!mk || !mk->isEager() || mk->eagerArg() == MissingArg::instance())
+            eager = false;
+    });
+    return eager;
+}
+
+bool TailCalls::apply(RirCompiler&, ClosureVersion* function,
+                      LogStream&) const {
+    auto& assumptions = function->assumptions();
+    if (assumptions.numMissing() > 0 ||
+        function->owner()->formals().hasDots())
+        return false;
+
+    // The frame must not be observable, otherwise the iterations would share
+    // it. Deopt branches materialize the frame of the current iteration.
+    bool reflected = !VisitorNoDeoptBranch::check(
+        function->entry, [&](Instruction* i) {
+            return !MkEnv::Cast(i) && !PushContext::Cast(i) &&
+                   !i->effects.contains(Effect::Reflection);
+        });
+    if (reflected)
+        return false;
+
+    std::vector<StaticCall*> tailCalls;
+    std::vector<LdArg*> args;
+    bool argsInEntry = true;
+    Visitor::run(function->entry, [&](Instruction* i) {
+        if (auto call = StaticCall::Cast(i)) {
+            if (isSelfTailCall(function, call))
+                tailCalls.push_back(call);
+        } else if (auto ld = LdArg::Cast(i)) {
+            if (ld->bb() != function->entry)
+                argsInEntry = false;
+            args.push_back(ld);
+        }
+    });
+    if (tailCalls.empty() || !argsInEntry)
+        return false;
+    bool entryIsTarget = !Visitor::check(function->entry, [&](BB* bb) {
+        return bb->next0 != function->entry && bb->next1 != function->entry;
+    });
+    if (entryIsTarget)
+        return false;
+
+    // The arguments are loaded once before the loop, the old entry becomes
+    // the loop header with a phi for every argument
+    BB* pre = new BB(function, function->nextBBId++);
+    BB* header = function->entry;
+    for (auto ld : args)
+        header->moveToEnd(header->atPosition(ld), pre);
+    pre->setNext(header);
+    function->entry = pre;
+
+    std::unordered_map<size_t, Phi*> phis;
+    for (auto ld : args) {
+        auto p = phis.find(ld->id);
+        if (p != phis.end()) {
+            ld->replaceUsesWith(p->second);
+            continue;
+        }
+        auto phi = new Phi;
+        ld->replaceUsesWith(phi);
+        phi->addInput(pre, ld);
+        phis.emplace(ld->id, phi);
+        header->insert(header->begin(), phi);
+    }
+
+    // Tail calls pass the new argument values around the loop
+    for (auto call : tailCalls) {
+        auto bb = call->bb();
+        size_t i = 0;
+        call->eachCallArg([&](Value* v) {
+            auto p = phis.find(i++);
+            if (p != phis.end())
+                p->second->addInput(bb, MkArg::Cast(v)->eagerArg());
+        });
+        auto it = bb->atPosition(call);
+        it = bb->remove(it);
+        bb->remove(it);
+        bb->setNext(header);
+    }
+
+    for (auto& p : phis)
+        p.second->updateType();
+    return true;
+}
+
+} // namespace pir
+} // namespace rir
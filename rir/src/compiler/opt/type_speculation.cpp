@@ -1,3 +1,4 @@
+#include "../analysis/analysis_manager.h"
 #include "../analysis/available_checkpoints.h"
 #include "../pir/pir_impl.h"
 #include "../transform/bb.h"
@@ -11,10 +12,11 @@
 namespace rir {
 namespace pir {
 
-void TypeSpeculation::apply(RirCompiler&, ClosureVersion* function,
+bool TypeSpeculation::apply(RirCompiler&, ClosureVersion* function,
                             LogStream& log) const {
 
-    AvailableCheckpoints checkpoint(function, log);
+    AvailableCheckpoints checkpoint(
+        function, function->analyses().cfg(function), log);
 
     std::unordered_map<Checkpoint*, std::unordered_map<Instruction*, PirType>>
         speculate;
@@ -97,6 +99,7 @@ void TypeSpeculation::apply(RirCompiler&, ClosureVersion* function,
             ip++;
         }
     });
+    return !speculate.empty();
 }
 } // namespace pir
 } // namespace rir
@@ -14,7 +14,7 @@
 namespace rir {
 namespace pir {
 
-void TypeInference::apply(RirCompiler&, ClosureVersion* function,
+bool TypeInference::apply(RirCompiler&, ClosureVersion* function,
                           LogStream& log) const {
 
     std::unordered_map<Instruction*, PirType> types;
@@ -148,12 +148,16 @@ void TypeInference::apply(RirCompiler&, ClosureVersion* function,
         }
     }
 
+    bool anyChange = false;
     Visitor::run(function->entry, [&](Instruction* i) {
         if (!i->producesRirResult())
             return;
-        if (types.count(i))
+        if (types.count(i) && i->type != types.at(i)) {
             i->type = types.at(i);
+            anyChange = true;
+        }
     });
+    return anyChange;
 }
 
 } // namespace pir
@@ -0,0 +1,185 @@
+#include "../pir/pir_impl.h"
+#include "../util/visitor.h"
+#include "R/Funtab.h"
+#include "ir/FusedKernel.h"
+#include "pass_definitions.h"
+
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace rir {
+namespace pir {
+
+// Elementwise operation on attribute free reals, FusedOp::Arg if i is none
+static FusedOp fusedOp(Instruction* i) {
+    static int sqrt = findBuiltin("sqrt");
+    static int exp = findBuiltin("exp");
+    static int abs = findBuiltin("abs");
+
+    auto real = PirType(RType::real).notObject();
+    auto binop = [&](FusedOp op) {
+        if (i->env() == Env::elided() && i->arg(0).val()->type.isA(real) &&
+            i->arg(1).val()->type.isA(real))
+            return op;
+        return FusedOp::Arg;
+    };
+
+    switch (i->tag) {
+    case Tag::Add:
+        return binop(FusedOp::Add);
+    case Tag::Sub:
+        return binop(FusedOp::Sub);
+    case Tag::Mul:
+        return binop(FusedOp::Mul);
+    case Tag::Div:
+        return binop(FusedOp::Div);
+    case Tag::Lt:
+        return binop(FusedOp::Lt);
+    case Tag::Gt:
+        return binop(FusedOp::Gt);
+    case Tag::Lte:
+        return binop(FusedOp::Le);
+    case Tag::Gte:
+        return binop(FusedOp::Ge);
+    case Tag::Eq:
+        return binop(FusedOp::Eq);
+    case Tag::Neq:
+        return binop(FusedOp::Ne);
+    case Tag::CallSafeBuiltin: {
+        auto call = CallSafeBuiltin::Cast(i);
+        if (call->nargs() != 1 || !call->arg(0).val()->type.isA(real))
+            return FusedOp::Arg;
+        if (call->builtinId == sqrt)
+            return FusedOp::Sqrt;
+        if (call->builtinId == exp)
+            return FusedOp::Exp;
+        if (call->builtinId == abs)
+            return FusedOp::Abs;
+        return FusedOp::Arg;
+    }
+    default:
+        return FusedOp::Arg;
+    }
+}
+
+static bool isComparison(FusedOp op) {
+    return op >= FusedOp::Lt && op <= FusedOp::Ne;
+}
+
+/*
+ * The postfix program of a tree of elementwise operations, rooted at the
+ * last one. Inner nodes are evaluated at the position of the root, thus
+ * they must have no other uses and nothing observable may happen in between.
+ */
+class Kernel {
+  public:
+    Kernel(Instruction* root, const std::unordered_map<Value*, size_t>& uses)
+        : root(root), uses(uses) {}
+
+    Instruction* root;
+    std::vector<int> ops;
+    std::vector<Value*> args;
+    std::vector<Instruction*> inner;
+
+    bool build() {
+        unsigned depth = 0;
+        return add(root, depth) && inner.size() > 0 &&
+               std::any_of(args.begin(), args.end(),
+                           [](Value* a) { return !a->type.isScalar(); });
+    }
+
+  private:
+    const std::unordered_map<Value*, size_t>& uses;
+
+    bool addArg(Value* v, unsigned& depth) {
+        auto pos = std::find(args.begin(), args.end(), v);
+        if (pos == args.end()) {
+            if (args.size() == MAX_FUSED_OPERANDS)
+                return false;
+            pos = args.insert(pos, v);
+        }
+        ops.push_back(static_cast<int>(FusedOp::Arg));
+        ops.push_back(pos - args.begin());
+        depth = 1;
+        return true;
+    }
+
+    bool isInner(Value* v) {
+        auto i = Instruction::Cast(v);
+        if (!i || i->bb() != root->bb() || uses.at(i) != 1)
+            return false;
+        auto op = fusedOp(i);
+        if (op == FusedOp::Arg || isComparison(op))
+            return false;
+        auto bb = root->bb();
+        for (auto it = bb->atPosition(i) + 1; *it != root; ++it)
+            if ((*it)->hasStrongEffects() && fusedOp(*it) == FusedOp::Arg)
+                return false;
+        return true;
+    }
+
+    bool add(Instruction* i, unsigned& depth) {
+        auto op = fusedOp(i);
+        if (i != root)
+            inner.push_back(i);
+
+        unsigned d0 = 0, d1 = 0;
+        auto operand = [&](Value* v, unsigned& d) {
+            if (isInner(v))
+                return add(Instruction::Cast(v), d);
+            return addArg(v, d);
+        };
+
+        if (!operand(i->arg(0).val(), d0))
+            return false;
+        if (op >= FusedOp::Sqrt) {
+            depth = d0;
+        } else {
+            if (!operand(i->arg(1).val(), d1))
+                return false;
+            depth = std::max(d0, d1 + 1);
+        }
+        ops.push_back(static_cast<int>(op));
+        return depth <= MAX_FUSED_DEPTH;
+    }
+};
+
+bool VectorFusion::apply(RirCompiler&, ClosureVersion* function,
+                         LogStream&) const {
+    std::unordered_map<Value*, size_t> uses;
+    Visitor::run(function->entry, [&](Instruction* i) {
+        i->eachArg([&](Value* v) { uses[v]++; });
+    });
+
+    bool anyChange = false;
+    Visitor::run(function->entry, [&](BB* bb) {
+        // Later instructions first, such that the largest trees are fused
+        std::vector<Kernel> kernels;
+        std::unordered_set<Instruction*> fused;
+        for (auto it = bb->rbegin(); it != bb->rend(); ++it) {
+            if (fused.count(*it) || fusedOp(*it) == FusedOp::Arg)
+                continue;
+            Kernel kernel(*it, uses);
+            if (!kernel.build())
+                continue;
+            fused.insert(kernel.inner.begin(), kernel.inner.end());
+            kernels.push_back(kernel);
+        }
+
+        for (auto& kernel : kernels) {
+            auto root = kernel.root;
+            auto f = new FusedArith(root->type, kernel.ops, kernel.args,
+                                    root->srcIdx);
+            root->replaceUsesWith(f);
+            bb->replace(bb->atPosition(root), f);
+            for (auto i : kernel.inner)
+                bb->remove(i);
+            anyChange = true;
+        }
+    });
+    return anyChange;
+}
+
+} // namespace pir
+} // namespace rir
@@ -13,8 +13,9 @@
 namespace rir {
 namespace pir {
 
-void OptimizeVisibility::apply(RirCompiler&, ClosureVersion* function,
+bool OptimizeVisibility::apply(RirCompiler&, ClosureVersion* function,
                                LogStream& log) const {
+    bool anyChange = false;
     VisibilityAnalysis visible(function, log);
 
     Visitor::run(function->entry, [&](BB* bb) {
@@ -26,20 +27,24 @@ void OptimizeVisibility::apply(RirCompiler&, ClosureVersion* function,
             if (auto vis = Visible::Cast(instr)) {
                 if (!visible.observed(vis)) {
                     next = bb->remove(ip);
+                    anyChange = true;
                 }
             } else if (auto vis = Invisible::Cast(instr)) {
                 if (!visible.observed(vis)) {
                     next = bb->remove(ip);
+                    anyChange = true;
                 }
             } else if (instr->effects.contains(Effect::Visibility)) {
                 if (!visible.observed(instr)) {
                     instr->effects.reset(Effect::Visibility);
+                    anyChange = true;
                 }
             }
 
             ip = next;
         }
     });
+    return anyChange;
 }
 
 } // namespace pir
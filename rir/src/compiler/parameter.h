@@ -21,6 +21,10 @@ struct Parameter {
     static unsigned RIR_SERIALIZE_CHAOS;
 
     static unsigned RIR_CHECK_PIR_TYPES;
+
+    static unsigned PIR_OPT_THREADS;
+
+    static bool PIR_NATIVE;
 };
 } // namespace pir
 } // namespace rir
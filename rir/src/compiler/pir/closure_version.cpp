@@ -1,9 +1,11 @@
 #include "closure_version.h"
+#include "../analysis/analysis_manager.h"
 #include "../transform/bb.h"
 #include "../util/visitor.h"
 #include "closure.h"
 #include "pir_impl.h"
 
+#include <algorithm>
 #include <iostream>
 
 namespace rir {
@@ -92,10 +94,41 @@ ClosureVersion* ClosureVersion::clone(const Assumptions& newAssumptions) {
     ctx.assumptions = ctx.assumptions | newAssumptions;
     auto c = owner_->declareVersion(ctx);
     c->properties = properties;
+    c->bindingDependencies_ = bindingDependencies_;
     c->entry = BBTransform::clone(entry, c, c);
     return c;
 }
 
+void ClosureVersion::addBindingDependency(const BindingDependency& dep) {
+    if (std::find(bindingDependencies_.begin(), bindingDependencies_.end(),
+                  dep) == bindingDependencies_.end())
+        bindingDependencies_.push_back(dep);
+}
+
+bool ClosureVersion::dependOnBinding(SEXP env, SEXP sym, SEXP expected,
+                                     BindingDependency& dep) {
+    // All environments up to the binding have to be locked, such that no
+    // binding shadowing it can be added
+    for (SEXP rho = env; rho != R_EmptyEnv; rho = ENCLOS(rho)) {
+        if (!R_EnvironmentIsLocked(rho))
+            return false;
+        R_varloc_t loc = R_findVarLocInFrame(rho, sym);
+        if (R_VARLOC_IS_NULL(loc))
+            continue;
+        // Bindings of base live in the symbol
+        SEXP value = TYPEOF(loc.cell) == SYMSXP ? SYMVALUE(loc.cell)
+                                                : CAR(loc.cell);
+        // Lazy loaded bindings are promises
+        SEXP fun = TYPEOF(value) == PROMSXP ? PRVALUE(value) : value;
+        if (fun != expected || !R_BindingIsLocked(sym, rho))
+            return false;
+        dep = {rho, sym, value};
+        addBindingDependency(dep);
+        return true;
+    }
+    return false;
+}
+
 void ClosureVersion::erasePromise(unsigned id) {
     assert(promises_.at(id) && "Promise already deleted");
 
@@ -119,7 +152,7 @@ ClosureVersion::ClosureVersion(Closure* closure,
                                const OptimizationContext& optimizationContext,
                                const Properties& properties)
     : owner_(closure), optimizationContext_(optimizationContext),
-      properties(properties) {
+      analyses_(new AnalysisManager()), properties(properties) {
     auto id = std::stringstream();
     id << closure->name() << "[" << this << "]";
     name_ = id.str();
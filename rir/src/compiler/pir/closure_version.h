@@ -7,12 +7,16 @@
 #include "optimization_context.h"
 #include "pir.h"
 #include <functional>
+#include <memory>
 #include <sstream>
 #include <unordered_map>
+#include <vector>
 
 namespace rir {
 namespace pir {
 
+class AnalysisManager;
+
 /*
  * ClosureVersion
  *
@@ -40,6 +44,18 @@ class ClosureVersion : public Code {
 
     size_t inlinees = 0;
 
+    // A locked binding in a locked environment, which this version assumes to
+    // keep its value instead of guarding it. See rir::Function::dependencies.
+    struct BindingDependency {
+        SEXP env;
+        SEXP sym;
+        SEXP value;
+        bool operator==(const BindingDependency& other) const {
+            return env == other.env && sym == other.sym &&
+                   value == other.value;
+        }
+    };
+
   private:
     Closure* owner_;
     std::vector<Promise*> promises_;
@@ -47,6 +63,8 @@ class ClosureVersion : public Code {
 
     std::string name_;
     std::string nameSuffix_;
+    std::unique_ptr<AnalysisManager> analyses_;
+    std::vector<BindingDependency> bindingDependencies_;
     ClosureVersion(Closure* closure,
                    const OptimizationContext& optimizationContext,
                    const Properties& properties = Properties());
@@ -65,6 +83,20 @@ class ClosureVersion : public Code {
 
     Properties properties;
 
+    // Cached CFG based analyses of this version and its promises
+    AnalysisManager& analyses() { return *analyses_; }
+
+    const std::vector<BindingDependency>& bindingDependencies() const {
+        return bindingDependencies_;
+    }
+    void addBindingDependency(const BindingDependency&);
+    // Looking up the function `sym` starting from `env` yields `expected`, and
+    // will keep doing so as long as the binding is not unlocked. If this can
+    // be shown, a dependency on the binding is added and stored in dep. The
+    // caller has to make sure that there is no local binding shadowing it.
+    bool dependOnBinding(SEXP env, SEXP sym, SEXP expected,
+                         BindingDependency& dep);
+
     Closure* owner() const { return owner_; }
     size_t nargs() const;
     const std::string& name() const { return name_; }
@@ -434,6 +434,10 @@ void LdVar::printArgs(std::ostream& out, bool tty) const {
     out << CHAR(PRINTNAME(varName)) << ", ";
 }
 
+void DependenciesValid::printArgs(std::ostream& out, bool tty) const {
+    out << CHAR(PRINTNAME(varName)) << ", ";
+}
+
 void LdFun::printArgs(std::ostream& out, bool tty) const {
     out << CHAR(PRINTNAME(varName)) << ", ";
     if (guessedBinding()) {
@@ -599,6 +603,22 @@ void CallSafeBuiltin::printArgs(std::ostream& out, bool tty) const {
     printCallArgs(out, this);
 }
 
+void FusedArith::printArgs(std::ostream& out, bool tty) const {
+    // Indexed by FusedOp
+    static const char* names[] = {"",   "+",    "-",   "*",  "/",
+                                  "<",  ">",    "<=",  ">=", "==",
+                                  "!=", "sqrt", "exp", "abs"};
+    for (size_t k = 0; k < kernel.size(); ++k) {
+        if (k)
+            out << " ";
+        if (static_cast<FusedOp>(kernel[k]) == FusedOp::Arg)
+            arg(kernel[++k]).val()->printRef(out);
+        else
+            out << names[kernel[k]];
+    }
+    out << " ";
+}
+
 void FrameState::printArgs(std::ostream& out, bool tty) const {
     out << code << "+" << pc - code->code();
     out << ": [";
@@ -789,9 +809,13 @@ NamedCall::NamedCall(Value* callerEnv, Value* fun,
     assert(names_.size() == args.size());
     pushArg(fun, RType::closure);
     for (unsigned i = 0; i < args.size(); ++i) {
-        pushArg(args[i], PirType(RType::prom) | RType::missing);
         auto name = Pool::get(names_[i]);
         assert(TYPEOF(name) == SYMSXP || name == R_NilValue);
+        // A forwarded ... is passed as the value of the ellipsis
+        if (name == R_DotsSymbol)
+            pushArg(args[i], PirType::any());
+        else
+            pushArg(args[i], PirType(RType::prom) | RType::missing);
         names.push_back(name);
     }
 }
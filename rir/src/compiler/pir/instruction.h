@@ -6,6 +6,7 @@
 #include "instruction_list.h"
 #include "ir/BC_inc.h"
 #include "ir/Deoptimization.h"
+#include "ir/FusedKernel.h"
 #include "pir.h"
 #include "singleton_values.h"
 #include "tag.h"
@@ -994,6 +995,10 @@ class FLI(AsInt, 1, Effect::Error) {
 
 class FLIE(Subassign1_1D, 4, Effects::Any()) {
   public:
+    // The index is a numeric scalar within the bounds of the vector, see
+    // BoundsCheckElision
+    bool inBounds = false;
+
     Subassign1_1D(Value* val, Value* vec, Value* idx, Value* env,
                   unsigned srcIdx)
         : FixedLenInstructionWithEnvSlot(
@@ -1010,6 +1015,10 @@ class FLIE(Subassign1_1D, 4, Effects::Any()) {
 
 class FLIE(Subassign2_1D, 4, Effects::Any()) {
   public:
+    // The index is a numeric scalar within the bounds of the vector, see
+    // BoundsCheckElision
+    bool inBounds = false;
+
     Subassign2_1D(Value* val, Value* vec, Value* idx, Value* env,
                   unsigned srcIdx)
         : FixedLenInstructionWithEnvSlot(
@@ -1075,6 +1084,10 @@ class FLIE(Extract1_1D, 3, Effects::Any()) {
 
 class FLIE(Extract2_1D, 3, Effects::Any()) {
   public:
+    // The vector is a simple non-object vector and the index a numeric
+    // scalar within its bounds, see BoundsCheckElision
+    bool inBounds = false;
+
     Extract2_1D(Value* vec, Value* idx, Value* env, unsigned srcIdx)
         : FixedLenInstructionWithEnvSlot(PirType::valOrLazy(),
                                          {{PirType::val(), PirType::val()}},
@@ -1507,11 +1520,16 @@ class CallInstruction {
     virtual void
     eachCallArg(const Instruction::MutableArgumentIterator& it) = 0;
     static CallInstruction* CastCall(Value* v);
+    virtual const FrameState* frameState() const { return nullptr; }
     virtual void clearFrameState(){};
     virtual Closure* tryGetCls() const { return nullptr; }
     Assumptions inferAvailableAssumptions() const;
     virtual bool hasNamedArgs() const { return false; }
     ClosureVersion* tryDispatch(Closure*) const;
+
+    // Number of calls per invocation of the caller, according to the type
+    // feedback of the baseline version. Negative if unknown.
+    double frequency = -1;
 };
 
 // Default call instruction. Closure expression (ie. expr left of `(`) is
@@ -1548,7 +1566,7 @@ class VLIE(Call, Effects::Any()), public CallInstruction {
             it(arg(i + 2));
     }
 
-    const FrameState* frameState() const {
+    const FrameState* frameState() const override {
         return FrameState::Cast(arg(0).val());
     }
     void clearFrameState() override { arg(0).val() = Tombstone::framestate(); };
@@ -1618,7 +1636,7 @@ class VLIE(StaticCall, Effects::Any()), public CallInstruction {
             it(arg(i + 1));
     }
 
-    const FrameState* frameState() const {
+    const FrameState* frameState() const override {
         return FrameState::Cast(arg(0).val());
     }
     void clearFrameState() override { arg(0).val() = Tombstone::framestate(); };
@@ -1697,6 +1715,38 @@ class VLI(CallSafeBuiltin,
     VisibilityFlag visibilityFlag() const override;
 };
 
+/*
+ * Elementwise arithmetic over real vectors, evaluated in one loop without
+ * temporaries. The kernel is a postfix program over the arguments, see
+ * FusedOp. Created by VectorFusion from trees of arithmetic and math
+ * builtins.
+ */
+class VLI(FusedArith,
+          Effects(Effect::Warn) | Effect::Error | Effect::Visibility) {
+  public:
+    std::vector<int> kernel;
+
+    FusedArith(PirType resultType, const std::vector<int>& kernel,
+               const std::vector<Value*>& args, unsigned srcIdx)
+        : VarLenInstruction(resultType, srcIdx), kernel(kernel) {
+        for (auto a : args)
+            pushArg(a, PirType::val());
+    }
+
+    void printArgs(std::ostream & out, bool tty) const override;
+
+    size_t gvnBase() const override {
+        auto h = InstructionImplementation::gvnBase();
+        for (auto k : kernel)
+            h = hash_combine(h, k);
+        return h;
+    }
+
+    VisibilityFlag visibilityFlag() const override {
+        return VisibilityFlag::On;
+    }
+};
+
 class BuiltinCallFactory {
   public:
     static Instruction* New(Value* callerEnv, SEXP builtin,
@@ -1776,6 +1826,26 @@ class FLIE(IsEnvStub, 1, Effect::ReadsEnv) {
         : FixedLenInstructionWithEnvSlot(NativeType::test, e) {}
 };
 
+// Does the locked binding of varName in bindingEnv, which is reached by
+// looking up varName from env, still hold value? See
+// ClosureVersion::dependOnBinding.
+class FLIE(DependenciesValid, 1, Effect::ReadsEnv) {
+  public:
+    SEXP bindingEnv;
+    SEXP varName;
+    SEXP value;
+
+    DependenciesValid(Value* env, SEXP bindingEnv, SEXP varName, SEXP value)
+        : FixedLenInstructionWithEnvSlot(NativeType::test, env),
+          bindingEnv(bindingEnv), varName(varName), value(value) {}
+
+    void printArgs(std::ostream& out, bool tty) const override;
+
+    size_t gvnBase() const override {
+        return hash_combine(InstructionImplementation::gvnBase(), varName);
+    }
+};
+
 class FLIE(PushContext, 3, Effect::ChangesContexts) {
   public:
     PushContext(Value* ast, Value* op, Value* sysparent)
@@ -1793,6 +1863,29 @@ class FLI(PopContext, 2, Effect::ChangesContexts) {
     PushContext* push() { return PushContext::Cast(arg<1>().val()); }
 };
 
+/*
+ * Runs the code up to the matching PopLoopContexts in a loop context, such that
+ * break and next in promises and eval'd code find their loop. One context
+ * spans all iterations of a loop. Returns nil when entering the context. After
+ * a non-local break or next, execution continues after this instruction again,
+ * still in the context, returning the symbol `break` or `next`.
+ */
+class FLIE(PushLoopContext, 1, Effects::Any()) {
+  public:
+    explicit PushLoopContext(Value* env)
+        : FixedLenInstructionWithEnvSlot(PirType(RType::nil) | RType::sym,
+                                         env) {}
+};
+
+class FLI(PopLoopContext, 1, Effect::ChangesContexts) {
+  public:
+    explicit PopLoopContext(PushLoopContext* push)
+        : FixedLenInstruction(PirType::voyd(),
+                              {{PirType(RType::nil) | RType::sym}}, {{push}}) {
+    }
+    PushLoopContext* push() { return PushLoopContext::Cast(arg<0>().val()); }
+};
+
 class VLI(Phi, Effects::None()) {
     std::vector<BB*> input;
 
@@ -52,6 +52,7 @@
     V(AsInt)                                                                   \
     V(IsObject)                                                                \
     V(IsEnvStub)                                                               \
+    V(DependenciesValid)                                                       \
     V(Return)                                                                  \
     V(MkArg)                                                                   \
     V(MkFunCls)                                                                \
@@ -63,9 +64,12 @@
     V(StaticCall)                                                              \
     V(CallBuiltin)                                                             \
     V(CallSafeBuiltin)                                                         \
+    V(FusedArith)                                                              \
     V(MkEnv)                                                                   \
     V(PushContext)                                                             \
     V(PopContext)                                                              \
+    V(PushLoopContext)                                                         \
+    V(PopLoopContext)                                                          \
     V(LdFunctionEnv)                                                           \
     V(LAnd)                                                                    \
     V(LOr)                                                                     \
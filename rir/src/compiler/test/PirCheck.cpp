@@ -1,14 +1,17 @@
 #include "PirCheck.h"
 #include "../../ir/Compiler.h"
+#include "../analysis/loop_detection.h"
 #include "../analysis/query.h"
 #include "../analysis/verifier.h"
 #include "../pir/pir_impl.h"
 #include "../translations/pir_2_rir/pir_2_rir.h"
+#include "../translations/pir_2_rir/unboxing.h"
 #include "../translations/rir_2_pir/rir_2_pir.h"
 #include "../util/visitor.h"
 #include "api.h"
 #include "compiler/parameter.h"
 #include <string>
+#include <unordered_set>
 #include <vector>
 
 namespace rir {
@@ -144,16 +147,152 @@ static bool testLdVarVectorInFirstBB(ClosureVersion* f) {
     return false;
 }
 
+// Arithmetic which produces a fresh boxed result in the final code
+static bool isBoxedArith(Instruction* i) {
+    switch (i->tag) {
+    case Tag::Add:
+    case Tag::Sub:
+    case Tag::Mul:
+    case Tag::Div:
+    case Tag::IDiv:
+    case Tag::Mod:
+    case Tag::Pow:
+    case Tag::Plus:
+    case Tag::Minus:
+    case Tag::Inc:
+    case Tag::Dec:
+        return true;
+    default:
+        return false;
+    }
+}
+
+// Conservative: anything which (potentially) allocates on the R heap. Only
+// instructions known not to allocate are excluded, new ones allocate until
+// they are added here.
+static bool mayAllocate(Instruction* i) {
+    if (auto f = Force::Cast(i))
+        return f->input()->type.maybeLazy();
+    switch (i->tag) {
+    case Tag::LdConst:
+    case Tag::LdArg:
+    case Tag::LdVar:
+    case Tag::LdVarSuper:
+    case Tag::LdFunctionEnv:
+    case Tag::Branch:
+    case Tag::Phi:
+    case Tag::Return:
+    case Tag::AsTest:
+    case Tag::IsObject:
+    case Tag::IsEnvStub:
+    case Tag::Is:
+    case Tag::IsType:
+    case Tag::Identical:
+    case Tag::DependenciesValid:
+    case Tag::ChkMissing:
+    case Tag::ChkClosure:
+    case Tag::Missing:
+    case Tag::CastType:
+    case Tag::Visible:
+    case Tag::Invisible:
+    case Tag::PirCopy:
+    case Tag::Nop:
+    // Deoptimizing leaves the loop
+    case Tag::FrameState:
+    case Tag::Checkpoint:
+    case Tag::Assume:
+    case Tag::Deopt:
+    case Tag::ScheduledDeopt:
+        return false;
+    default:
+        return true;
+    }
+}
+
+// Arithmetic and comparisons are lowered to unboxed instructions where
+// possible, thus only count what is still boxed afterwards
+static bool testNoLoopAlloc(ClosureVersion* f) {
+    LoopDetection loops(f, true);
+    Unboxing unboxing(f);
+    for (auto& loop : loops) {
+        if (loop.isInnermost() && !loop.check([&](Instruction* i) {
+                return unboxing.unboxed(i) || !mayAllocate(i);
+            }))
+            return false;
+    }
+    return true;
+}
+
+static unsigned
+countInstructions(ClosureVersion* f,
+                  const std::function<bool(Instruction*)>& pred) {
+    unsigned n = 0;
+    Visitor::run(f->entry, [&](Instruction* i) {
+        if (pred(i))
+            n++;
+    });
+    return n;
+}
+
+static unsigned countMaxEnvs(ClosureVersion* f) {
+    return countInstructions(f, [](Instruction* i) { return MkEnv::Cast(i); });
+}
+
+static unsigned countMaxPromises(ClosureVersion* f) {
+    return countInstructions(f, [](Instruction* i) { return MkArg::Cast(i); });
+}
+
+static unsigned countMaxCalls(ClosureVersion* f) {
+    return countInstructions(f, [](Instruction* i) {
+        return CallInstruction::CastCall(i) && !CallSafeBuiltin::Cast(i);
+    });
+}
+
+static unsigned countMaxForces(ClosureVersion* f) {
+    return countInstructions(f, [](Instruction* i) { return Force::Cast(i); });
+}
+
+static unsigned countMaxCasts(ClosureVersion* f) {
+    return countInstructions(f,
+                             [](Instruction* i) { return CastType::Cast(i); });
+}
+
+static unsigned countMaxLoopArith(ClosureVersion* f) {
+    LoopDetection loops(f);
+    Unboxing unboxing(f);
+    std::unordered_set<Instruction*> found;
+    for (auto& loop : loops) {
+        for (auto bb : loop)
+            for (auto i : *bb)
+                if (isBoxedArith(i) && !unboxing.unboxed(i))
+                    found.insert(i);
+    }
+    return found.size();
+}
+
 PirCheck::Type PirCheck::parseType(const char* str) {
 #define V(Check)                                                               \
     if (strcmp(str, #Check) == 0)                                              \
         return PirCheck::Type::Check;                                          \
     else
     LIST_OF_PIR_CHECKS(V)
+    LIST_OF_PIR_QUANTITATIVE_CHECKS(V)
 #undef V
     return PirCheck::Type::Invalid;
 }
 
+bool PirCheck::isQuantitative(Type type) {
+    switch (type) {
+#define V(Check)                                                               \
+    case PirCheck::Type::Check:                                                \
+        return true;
+        LIST_OF_PIR_QUANTITATIVE_CHECKS(V)
+#undef V
+    default:
+        return false;
+    }
+}
+
 bool PirCheck::run(SEXP f) {
     Module m;
     ClosureVersion* pir = recompilePir(f, &m);
@@ -168,10 +307,30 @@ bool PirCheck::run(SEXP f) {
         break;
                 LIST_OF_PIR_CHECKS(V)
 #undef V
-        default:
-            assert(false);
+            default:
+                assert(false);
+            }
+        }
+        for (auto& b : bounds) {
+            unsigned found = 0;
+            const char* name = nullptr;
+            switch (b.first) {
+#define V(Check)                                                               \
+    case PirCheck::Type::Check:                                                \
+        found = count##Check(pir);                                             \
+        name = #Check;                                                         \
+        break;
+                LIST_OF_PIR_QUANTITATIVE_CHECKS(V)
+#undef V
+            default:
+                assert(false);
+            }
+            if (found > b.second) {
+                std::cout << "pir check failed: " << name << "=" << b.second
+                          << ", found " << found << "\n";
+                success = false;
+            }
         }
-    }
     }
     if (!success)
         m.print(std::cout, false);
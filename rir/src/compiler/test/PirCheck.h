@@ -3,6 +3,7 @@
 #include "R/Symbols.h"
 #include "common.h"
 #include <list>
+#include <utility>
 
 namespace rir {
 
@@ -21,23 +22,45 @@ namespace rir {
     V(NoEq)                                                                    \
     V(OneEq)                                                                   \
     V(OneNot)                                                                  \
-    V(LdVarVectorInFirstBB)
+    V(LdVarVectorInFirstBB)                                                    \
+    V(NoLoopAlloc)
+
+// Checks which take an upper bound, e.g. pir.check(f, MaxEnvs=0)
+#define LIST_OF_PIR_QUANTITATIVE_CHECKS(V)                                     \
+    V(MaxEnvs)                                                                 \
+    V(MaxPromises)                                                             \
+    V(MaxCalls)                                                                \
+    V(MaxForces)                                                               \
+    V(MaxCasts)                                                                \
+    V(MaxLoopArith)
 
 struct PirCheck {
     enum class Type : unsigned {
 #define V(Check) Check,
-        LIST_OF_PIR_CHECKS(V)
+        LIST_OF_PIR_CHECKS(V) LIST_OF_PIR_QUANTITATIVE_CHECKS(V)
 #undef V
             Invalid
     };
 
     std::list<Type> types;
+    // Upper bounds of the quantitative checks
+    std::list<std::pair<Type, unsigned>> bounds;
 
     static Type parseType(const char* str);
+    static bool isQuantitative(Type type);
     explicit PirCheck(std::list<Type>& types) : types(types) {
 #ifdef ENABLE_SLOWASSERT
         for (Type type : types)
-            assert(type != Type::Invalid);
+            assert(type != Type::Invalid && !isQuantitative(type));
+#endif
+    }
+    PirCheck(std::list<Type>& types,
+             std::list<std::pair<Type, unsigned>>& bounds)
+        : PirCheck(types) {
+        this->bounds = bounds;
+#ifdef ENABLE_SLOWASSERT
+        for (auto& b : bounds)
+            assert(isQuantitative(b.first));
 #endif
     }
     bool run(SEXP f);
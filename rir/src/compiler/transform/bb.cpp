@@ -217,7 +217,8 @@ void BBTransform::renumber(Code* fun) {
         });
 }
 
-void BBTransform::removeDeadInstrs(Code* fun) {
+bool BBTransform::removeDeadInstrs(Code* fun) {
+    bool removed = false;
     Visitor::run(fun->entry, [&](BB* bb) {
         auto ip = bb->begin();
         while (ip != bb->end()) {
@@ -226,10 +227,12 @@ void BBTransform::removeDeadInstrs(Code* fun) {
             if (i->unused() && !i->branchOrExit() &&
                 !i->hasObservableEffects()) {
                 next = bb->remove(ip);
+                removed = true;
             }
             ip = next;
         }
     });
+    return removed;
 }
 
 } // namespace pir
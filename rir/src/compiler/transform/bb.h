@@ -33,7 +33,7 @@ class BBTransform {
     static void renumber(Code* fun);
 
     // Remove dead instructions (instead of waiting until the cleanup pass)
-    static void removeDeadInstrs(Code* fun);
+    static bool removeDeadInstrs(Code* fun);
 };
 
 } // namespace pir
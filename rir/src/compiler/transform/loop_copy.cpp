@@ -0,0 +1,151 @@
+#include "loop_copy.h"
+#include "../pir/pir_impl.h"
+#include "../util/visitor.h"
+
+#include <unordered_set>
+
+namespace rir {
+namespace pir {
+
+// Deopt branches of the loop, they are copied together with the loop
+static bool isSideExit(const LoopDetection::Loop& loop, const CFG& cfg,
+                       BB* bb) {
+    if (loop.contains(bb) || !bb->isDeopt())
+        return false;
+    for (auto pred : cfg.immediatePredecessors(bb))
+        if (!loop.contains(pred))
+            return false;
+    return true;
+}
+
+bool LoopCopy::supported(Code* code, const LoopDetection::Loop& loop,
+                         const CFG& cfg) {
+    auto preheader = loop.preheader(cfg);
+    if (!preheader || !preheader->isJmp())
+        return false;
+
+    size_t exits = 0;
+    for (auto bb : loop) {
+        for (auto next : {bb->next0, bb->next1})
+            if (next && !loop.contains(next) && !isSideExit(loop, cfg, next))
+                exits++;
+    }
+    if (exits != 1)
+        return false;
+
+    // Values flowing out of the loop are merged with a phi
+    bool mergeable = true;
+    Visitor::run(code->entry, [&](Instruction* i) {
+        if (loop.contains(i->bb()) || isSideExit(loop, cfg, i->bb()))
+            return;
+        i->eachArg([&](Value* v) {
+            auto def = Instruction::Cast(v);
+            if (def && loop.contains(def->bb()) &&
+                (!def->type.isRType() || MkEnv::Cast(def)))
+                mergeable = false;
+        });
+    });
+    return mergeable;
+}
+
+LoopCopy::LoopCopy(Code* code, const LoopDetection::Loop& loop,
+                   const CFG& cfg)
+    : loop(loop), preheader_(loop.preheader(cfg)), landing_(nullptr) {
+    assert(supported(code, loop, cfg));
+
+    std::vector<BB*> region;
+    std::unordered_set<BB*> sideExits;
+    BB* exiting = nullptr;
+    BB* exit = nullptr;
+    for (auto bb : loop) {
+        region.push_back(bb);
+        for (auto next : {bb->next0, bb->next1}) {
+            if (!next)
+                continue;
+            if (next == loop.header()) {
+                latches_.push_back(bb);
+            } else if (loop.contains(next)) {
+                // nothing to do
+            } else if (isSideExit(loop, cfg, next)) {
+                if (!sideExits.count(next)) {
+                    sideExits.insert(next);
+                    region.push_back(next);
+                }
+            } else {
+                exiting = bb;
+                exit = next;
+            }
+        }
+    }
+
+    // Split the exit edge, such that both loops can leave to the same block
+    landing_ = new BB(code, code->nextBBId++);
+    landing_->setNext(exit);
+    if (exiting->next0 == exit)
+        exiting->next0 = landing_;
+    else
+        exiting->next1 = landing_;
+    for (auto i : *exit) {
+        if (auto phi = Phi::Cast(i)) {
+            for (size_t j = 0; j < phi->nargs(); ++j)
+                if (phi->inputAt(j) == exiting)
+                    phi->updateInputAt(j, landing_);
+        }
+    }
+
+    for (auto bb : region) {
+        BB* copy = BB::cloneInstrs(bb, code->nextBBId++, code);
+        bbs[bb] = copy;
+        blocks_.push_back(copy);
+        for (size_t i = 0; i < bb->size(); ++i)
+            values[bb->at(i)] = copy->at(i);
+    }
+
+    for (auto bb : region) {
+        BB* copy = map(bb);
+        copy->next0 = bb->next0 ? map(bb->next0) : nullptr;
+        copy->next1 = bb->next1 ? map(bb->next1) : nullptr;
+        for (auto i : *copy) {
+            if (auto phi = Phi::Cast(i)) {
+                for (size_t j = 0; j < phi->nargs(); ++j)
+                    phi->updateInputAt(j, map(phi->inputAt(j)));
+            }
+            i->eachArg([&](InstrArg& arg) { arg.val() = map(arg.val()); });
+        }
+    }
+
+    // Uses after the loop get the value from the loop which was executed
+    std::unordered_map<Value*, Phi*> merged;
+    Visitor::run(code->entry, [&](Instruction* i) {
+        if (loop.contains(i->bb()) || sideExits.count(i->bb()) ||
+            i->bb() == landing_)
+            return;
+        i->eachArg([&](InstrArg& arg) {
+            auto def = Instruction::Cast(arg.val());
+            if (!def || !loop.contains(def->bb()))
+                return;
+            if (!merged.count(def)) {
+                auto phi = new Phi;
+                phi->addInput(exiting, def);
+                phi->addInput(map(exiting), map(def));
+                phi->updateType();
+                landing_->append(phi);
+                merged[def] = phi;
+            }
+            arg.val() = merged.at(def);
+        });
+    });
+}
+
+BB* LoopCopy::map(BB* bb) const {
+    auto m = bbs.find(bb);
+    return m == bbs.end() ? bb : m->second;
+}
+
+Value* LoopCopy::map(Value* v) const {
+    auto m = values.find(v);
+    return m == values.end() ? v : m->second;
+}
+
+} // namespace pir
+} // namespace rir
@@ -0,0 +1,57 @@
+#ifndef PIR_LOOP_COPY_H
+#define PIR_LOOP_COPY_H
+
+#include "../analysis/loop_detection.h"
+#include "../pir/pir.h"
+
+#include <unordered_map>
+#include <vector>
+
+namespace rir {
+namespace pir {
+
+/*
+ * Duplicates a loop, used for loop peeling and loop versioning.
+ *
+ * The copy includes the deopt blocks branching off the loop. The exit edge of
+ * the loop is split into a landing block, which both loops jump to, and all
+ * uses of loop values after the loop are replaced by phis in the landing
+ * block. The copy is initially unreachable: its header phis still have the
+ * original preheader as input and the caller decides how to enter it.
+ *
+ * Only loops with a preheader ending in a jump and a single exit edge are
+ * supported, see LoopCopy::supported.
+ */
+class LoopCopy {
+  public:
+    LoopCopy(Code* code, const LoopDetection::Loop& loop, const CFG& cfg);
+
+    static bool supported(Code* code, const LoopDetection::Loop& loop,
+                          const CFG& cfg);
+
+    BB* header() const { return map(loop.header()); }
+    BB* preheader() const { return preheader_; }
+    BB* landing() const { return landing_; }
+    // Blocks of the original loop with a back edge to the header
+    const std::vector<BB*>& latches() const { return latches_; }
+    // All blocks of the copy
+    const std::vector<BB*>& blocks() const { return blocks_; }
+
+    BB* map(BB* bb) const;
+    Value* map(Value* v) const;
+    void remap(Value* orig, Value* v) { values[orig] = v; }
+
+  private:
+    const LoopDetection::Loop& loop;
+    BB* preheader_;
+    BB* landing_;
+    std::vector<BB*> latches_;
+    std::vector<BB*> blocks_;
+    std::unordered_map<BB*, BB*> bbs;
+    std::unordered_map<Value*, Value*> values;
+};
+
+} // namespace pir
+} // namespace rir
+
+#endif
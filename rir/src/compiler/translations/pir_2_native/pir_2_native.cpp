@@ -0,0 +1,399 @@
+#include "pir_2_native.h"
+#include "../../pir/pir_impl.h"
+#include "../../util/visitor.h"
+#include "R/r.h"
+#include "compiler/parameter.h"
+#include "x86_64.h"
+
+#include <climits>
+#include <cstdlib>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace rir {
+namespace pir {
+
+bool Parameter::PIR_NATIVE =
+    getenv("PIR_NATIVE") && 0 == strncmp("1", getenv("PIR_NATIVE"), 1);
+
+#if defined(__x86_64__)
+
+namespace {
+
+// Loops poll for user interrupts every so many iterations, like the
+// interpreter on jumps
+static const uint32_t INTERRUPT_INTERVAL = 1000;
+
+class Translator {
+  public:
+    explicit Translator(ClosureVersion* cls) : cls(cls) {}
+
+    bool translate();
+
+    X86Assembler as;
+
+  private:
+    ClosureVersion* cls;
+    std::unordered_set<Value*> reals;
+    std::unordered_map<Value*, size_t> slots;
+    std::unordered_map<BB*, X86Assembler::Label> labels;
+
+    size_t slot(Value* v) {
+        auto s = slots.find(v);
+        if (s != slots.end())
+            return s->second;
+        auto n = slots.size();
+        slots.emplace(v, n);
+        return n;
+    }
+
+    void findReals();
+    bool supported(Instruction* i);
+    void emit(Instruction* i, X86Assembler::Label bail,
+              X86Assembler::Label done);
+    void emitBranch(Branch* br, X86Assembler::Label bail);
+};
+
+static bool isArith(Instruction* i) {
+    switch (i->tag) {
+    case Tag::Add:
+    case Tag::Sub:
+    case Tag::Mul:
+    case Tag::Div:
+        return true;
+    default:
+        return false;
+    }
+}
+
+static bool isCompare(Instruction* i) {
+    switch (i->tag) {
+    case Tag::Lt:
+    case Tag::Gt:
+    case Tag::Lte:
+    case Tag::Gte:
+    case Tag::Eq:
+    case Tag::Neq:
+        return true;
+    default:
+        return false;
+    }
+}
+
+// Ends in a lowered deopt, the whole block just bails out
+static bool isDeoptBlock(BB* bb) {
+    return !bb->isEmpty() && ScheduledDeopt::Cast(bb->last());
+}
+
+// Values which are plain scalar reals, given that the arguments are. Phis
+// are assumed to be real until one of their inputs is not.
+void Translator::findReals() {
+    Visitor::run(cls->entry, [&](Instruction* i) {
+        if (LdArg::Cast(i) || Force::Cast(i) || CastType::Cast(i) ||
+            PirCopy::Cast(i) || Phi::Cast(i) ||
+            (isArith(i) && i->env() == Env::elided()))
+            reals.insert(i);
+        else if (auto ld = LdConst::Cast(i))
+            if (IS_SIMPLE_SCALAR(ld->c(), REALSXP))
+                reals.insert(i);
+    });
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        Visitor::run(cls->entry, [&](Instruction* i) {
+            if (!reals.count(i) || LdArg::Cast(i) || LdConst::Cast(i))
+                return;
+            bool real = true;
+            if (isArith(i))
+                real = reals.count(i->arg(0).val()) &&
+                       reals.count(i->arg(1).val());
+            else if (auto phi = Phi::Cast(i))
+                phi->eachArg([&](BB*, Value* v) {
+                    if (!reals.count(v))
+                        real = false;
+                });
+            else
+                real = reals.count(i->arg(0).val());
+            if (!real) {
+                reals.erase(i);
+                changed = true;
+            }
+        });
+    }
+}
+
+bool Translator::supported(Instruction* i) {
+    if (reals.count(i))
+        return true;
+    switch (i->tag) {
+    case Tag::Nop:
+    case Tag::Visible:
+        return true;
+    case Tag::Lt:
+    case Tag::Gt:
+    case Tag::Lte:
+    case Tag::Gte:
+    case Tag::Eq:
+    case Tag::Neq:
+        return i->env() == Env::elided() && reals.count(i->arg(0).val()) &&
+               reals.count(i->arg(1).val());
+    case Tag::AsTest: {
+        auto in = Instruction::Cast(i->arg(0).val());
+        return in && isCompare(in) && supported(in);
+    }
+    case Tag::IsType: {
+        // Always holds for plain scalar reals. The RIR type check on an
+        // unforced argument fails on promises, leave that to the body.
+        auto in = i->arg(0).val();
+        return reals.count(in) && !LdArg::Cast(in) &&
+               IsType::Cast(i)->typeTest.isA(RType::real);
+    }
+    case Tag::Branch: {
+        auto c = i->arg(0).val();
+        if (c == True::instance() || c == False::instance())
+            return true;
+        auto in = Instruction::Cast(c);
+        return in && (AsTest::Cast(in) || IsType::Cast(in)) && supported(in);
+    }
+    case Tag::Return:
+        return reals.count(i->arg(0).val());
+    default:
+        return false;
+    }
+}
+
+bool Translator::translate() {
+    findReals();
+
+    bool ok = Visitor::check(cls->entry, [&](BB* bb) {
+        if (isDeoptBlock(bb))
+            return true;
+        for (auto i : *bb)
+            if (!supported(i))
+                return false;
+        return true;
+    });
+    if (!ok)
+        return false;
+
+    // All inputs of a phi are written to its slot (see toCSSA)
+    ok = Visitor::check(cls->entry, [&](Instruction* i) {
+        auto phi = Phi::Cast(i);
+        if (!phi)
+            return true;
+        auto s = slot(phi);
+        bool distinct = true;
+        phi->eachArg([&](BB*, Value* v) {
+            if (slots.count(v))
+                distinct = false;
+            slots.emplace(v, s);
+        });
+        return distinct;
+    });
+    if (!ok)
+        return false;
+
+    std::vector<BB*> order;
+    std::unordered_map<BB*, size_t> index;
+    Visitor::run(cls->entry, [&](BB* bb) {
+        index.emplace(bb, order.size());
+        order.push_back(bb);
+        labels.emplace(bb, as.mkLabel());
+    });
+    Visitor::run(cls->entry, [&](Instruction* i) {
+        if (reals.count(i))
+            slot(i);
+    });
+
+    // Targets of back edges
+    std::unordered_set<BB*> loopHeads;
+    for (auto bb : order)
+        for (auto s : {bb->next0, bb->next1})
+            if (s && index.at(s) <= index.at(bb))
+                loopHeads.insert(s);
+    auto counter = slots.size();
+
+    auto bail = as.mkLabel();
+    auto done = as.mkLabel();
+    auto frame = X86Assembler::frameSize(counter + 1);
+    as.enter(frame);
+    if (!loopHeads.empty())
+        as.storeSlotImm(counter, INTERRUPT_INTERVAL);
+    for (size_t n = 0; n < order.size(); ++n) {
+        auto bb = order[n];
+        as.bind(labels.at(bb));
+        if (isDeoptBlock(bb)) {
+            as.jmp(bail);
+            continue;
+        }
+        if (loopHeads.count(bb)) {
+            auto skip = as.mkLabel();
+            as.decSlot(counter);
+            as.jcc(X86Assembler::NotEqual, skip);
+            as.call(&R_CheckUserInterrupt);
+            as.storeSlotImm(counter, INTERRUPT_INTERVAL);
+            as.bind(skip);
+        }
+        for (auto i : *bb)
+            emit(i, bail, done);
+        if (bb->isJmp() &&
+            (n + 1 == order.size() || order[n + 1] != bb->next0))
+            as.jmp(labels.at(bb->next0));
+    }
+    as.bind(done);
+    as.leave(frame, 0);
+    as.bind(bail);
+    as.leave(frame, 1);
+    return true;
+}
+
+void Translator::emit(Instruction* i, X86Assembler::Label bail,
+                      X86Assembler::Label done) {
+    switch (i->tag) {
+    case Tag::LdArg:
+        as.loadArg(X86Assembler::xmm0, LdArg::Cast(i)->id);
+        as.storeSlot(slot(i), X86Assembler::xmm0);
+        break;
+    case Tag::LdConst:
+        as.loadImm(X86Assembler::xmm0, REAL(LdConst::Cast(i)->c())[0]);
+        as.storeSlot(slot(i), X86Assembler::xmm0);
+        break;
+    case Tag::Force:
+    case Tag::CastType:
+    case Tag::PirCopy:
+        as.loadSlot(X86Assembler::xmm0, slot(i->arg(0).val()));
+        as.storeSlot(slot(i), X86Assembler::xmm0);
+        break;
+    case Tag::Add:
+    case Tag::Sub:
+    case Tag::Mul:
+    case Tag::Div: {
+        auto op = i->tag == Tag::Add
+                      ? X86Assembler::Add
+                      : i->tag == Tag::Sub
+                            ? X86Assembler::Sub
+                            : i->tag == Tag::Mul ? X86Assembler::Mul
+                                                 : X86Assembler::Div;
+        as.loadSlot(X86Assembler::xmm0, slot(i->arg(0).val()));
+        as.loadSlot(X86Assembler::xmm1, slot(i->arg(1).val()));
+        as.arith(op, X86Assembler::xmm0, X86Assembler::xmm1);
+        as.storeSlot(slot(i), X86Assembler::xmm0);
+        break;
+    }
+    case Tag::Branch:
+        emitBranch(Branch::Cast(i), bail);
+        break;
+    case Tag::Return:
+        as.loadSlot(X86Assembler::xmm0, slot(i->arg(0).val()));
+        as.storeResult(X86Assembler::xmm0);
+        as.jmp(done);
+        break;
+    default:
+        // Phis are written by their inputs. Comparisons and tests are
+        // evaluated by the branch using them.
+        break;
+    }
+}
+
+void Translator::emitBranch(Branch* br, X86Assembler::Label bail) {
+    auto bb = br->bb();
+    auto t = labels.at(bb->trueBranch());
+    auto f = labels.at(bb->falseBranch());
+    auto c = br->arg(0).val();
+    if (c == False::instance()) {
+        as.jmp(f);
+        return;
+    }
+    if (c == True::instance() || IsType::Cast(c)) {
+        as.jmp(t);
+        return;
+    }
+
+    auto cmp = Instruction::Cast(AsTest::Cast(c)->arg(0).val());
+    X86Assembler::Cond cond;
+    switch (cmp->tag) {
+    case Tag::Lt:
+        cond = X86Assembler::Below;
+        break;
+    case Tag::Gt:
+        cond = X86Assembler::Above;
+        break;
+    case Tag::Lte:
+        cond = X86Assembler::BelowEqual;
+        break;
+    case Tag::Gte:
+        cond = X86Assembler::AboveEqual;
+        break;
+    case Tag::Eq:
+        cond = X86Assembler::Equal;
+        break;
+    case Tag::Neq:
+        cond = X86Assembler::NotEqual;
+        break;
+    default:
+        assert(false);
+        return;
+    }
+    as.loadSlot(X86Assembler::xmm0, slot(cmp->arg(0).val()));
+    as.loadSlot(X86Assembler::xmm1, slot(cmp->arg(1).val()));
+    as.ucomisd(X86Assembler::xmm0, X86Assembler::xmm1);
+    // The condition is NA, let the body raise the error
+    as.jcc(X86Assembler::Parity, bail);
+    as.jcc(cond, t);
+    as.jmp(f);
+}
+
+static void freeNativeCode(SEXP handle) {
+    if (auto mem = R_ExternalPtrAddr(handle)) {
+        munmap(mem, INTEGER(R_ExternalPtrTag(handle))[0]);
+        R_ClearExternalPtr(handle);
+    }
+}
+
+// Code is copied to its own pages, which are made executable afterwards. They
+// are unmapped when the returned handle is collected.
+static SEXP install(X86Assembler& as) {
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_t size = (as.size() + page - 1) / page * page;
+    if (size > INT_MAX)
+        return R_NilValue;
+    SEXP tag = PROTECT(Rf_ScalarInteger(size));
+    SEXP handle = PROTECT(R_MakeExternalPtr(nullptr, tag, R_NilValue));
+    R_RegisterCFinalizerEx(handle, freeNativeCode, FALSE);
+    UNPROTECT(2);
+
+    void* mem = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED)
+        return R_NilValue;
+    as.copyTo(static_cast<uint8_t*>(mem));
+    if (mprotect(mem, size, PROT_READ | PROT_EXEC) != 0) {
+        munmap(mem, size);
+        return R_NilValue;
+    }
+    R_SetExternalPtrAddr(handle, mem);
+    return handle;
+}
+
+} // namespace
+
+SEXP Pir2Native::compile(ClosureVersion* cls) {
+    if (!Parameter::PIR_NATIVE || cls->nargs() > Function::MAX_NATIVE_ARGS ||
+        cls->owner()->formals().hasDots())
+        return R_NilValue;
+    Translator translator(cls);
+    if (!translator.translate())
+        return R_NilValue;
+    return install(translator.as);
+}
+
+#else
+
+SEXP Pir2Native::compile(ClosureVersion*) { return R_NilValue; }
+
+#endif
+
+} // namespace pir
+} // namespace rir
@@ -0,0 +1,35 @@
+#pragma once
+
+#include "../../pir/pir.h"
+#include "runtime/Function.h"
+
+namespace rir {
+namespace pir {
+
+/*
+ * Template based x86-64 backend for versions which only compute on scalar
+ * reals. Runs on the lowered PIR, after pir_2_rir compiled the body.
+ *
+ * Every PIR value gets a frame slot, every instruction expands to a fixed
+ * machine code template. Supported are arguments, real constants, the four
+ * arithmetic operations and comparisons without env, type checks, phis,
+ * branches and returns. The code has no side effects, thus instead of
+ * deoptimizing it bails out and the RIR body runs from the start, which
+ * takes the same path and deoptimizes through its DeoptMetadata. The same
+ * happens on NA conditions, to raise the error.
+ *
+ * Loop heads poll for user interrupts, which long jumps out of the code.
+ *
+ * The interpreter only calls the native code with plain scalar real
+ * arguments.
+ */
+class Pir2Native {
+  public:
+    // Returns an external pointer to the code, which unmaps it when it is
+    // collected. R_NilValue for versions the backend does not support, if
+    // PIR_NATIVE is off or on other architectures.
+    static SEXP compile(ClosureVersion* cls);
+};
+
+} // namespace pir
+} // namespace rir
@@ -0,0 +1,170 @@
+#pragma once
+
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include <utility>
+#include <vector>
+
+namespace rir {
+namespace pir {
+
+/*
+ * Just enough of an x86-64 assembler for the templates of pir_2_native.
+ *
+ * The generated code has the signature of NativeCode: the arguments are
+ * read from [rdi], the result is stored to [rsi] and the status is returned
+ * in eax. Values live in a frame of 8 byte slots addressed off rsp, xmm0
+ * and xmm1 are the only registers used, besides rax for immediates and
+ * calls.
+ */
+class X86Assembler {
+  public:
+    typedef size_t Label;
+    enum Xmm : uint8_t { xmm0 = 0, xmm1 = 1 };
+    // Condition codes of jcc. After ucomisd unordered sets ZF, PF and CF.
+    enum Cond : uint8_t {
+        Below = 0x2,
+        AboveEqual = 0x3,
+        Equal = 0x4,
+        NotEqual = 0x5,
+        BelowEqual = 0x6,
+        Above = 0x7,
+        Parity = 0xa,
+    };
+    enum Arith : uint8_t { Add = 0x58, Mul = 0x59, Sub = 0x5c, Div = 0x5e };
+
+    Label mkLabel() {
+        labels.push_back(UNBOUND);
+        return labels.size() - 1;
+    }
+    void bind(Label l) {
+        assert(labels[l] == UNBOUND);
+        labels[l] = buf.size();
+    }
+
+    // Number of slots to allocate for the values, such that rsp stays 16 byte
+    // aligned for calls after pushing the two arguments
+    static size_t frameSize(size_t slots) { return slots | 1; }
+
+    // sub rsp, 8 * slots
+    void enter(size_t slots) {
+        if (slots)
+            emit({0x48, 0x81, 0xec}, imm32(8 * slots));
+    }
+    // add rsp, 8 * slots; mov eax, status; ret
+    void leave(size_t slots, uint32_t status) {
+        if (slots)
+            emit({0x48, 0x81, 0xc4}, imm32(8 * slots));
+        emit({0xb8}, imm32(status));
+        emit({0xc3});
+    }
+
+    // movsd xmm, [rdi + 8 * idx]
+    void loadArg(Xmm dst, size_t idx) {
+        emit({0xf2, 0x0f, 0x10, modrm(2, dst, 7)}, imm32(8 * idx));
+    }
+    // movsd xmm, [rsp + 8 * slot]
+    void loadSlot(Xmm dst, size_t slot) {
+        emit({0xf2, 0x0f, 0x10, modrm(2, dst, 4), 0x24}, imm32(8 * slot));
+    }
+    // movsd [rsp + 8 * slot], xmm
+    void storeSlot(size_t slot, Xmm src) {
+        emit({0xf2, 0x0f, 0x11, modrm(2, src, 4), 0x24}, imm32(8 * slot));
+    }
+    // movsd [rsi], xmm
+    void storeResult(Xmm src) { emit({0xf2, 0x0f, 0x11, modrm(0, src, 6)}); }
+    // mov rax, imm64; movq xmm, rax
+    void loadImm(Xmm dst, double d) {
+        uint64_t bits;
+        memcpy(&bits, &d, sizeof(bits));
+        movRax(bits);
+        emit({0x66, 0x48, 0x0f, 0x6e, modrm(3, dst, 0)});
+    }
+
+    // mov qword [rsp + 8 * slot], imm32
+    void storeSlotImm(size_t slot, uint32_t value) {
+        emit({0x48, 0xc7, modrm(2, 0, 4), 0x24}, imm32(8 * slot));
+        emit({}, imm32(value));
+    }
+    // sub qword [rsp + 8 * slot], 1
+    void decSlot(size_t slot) {
+        emit({0x48, 0x83, modrm(2, 5, 4), 0x24}, imm32(8 * slot));
+        emit({0x01});
+    }
+
+    // push rdi; push rsi; mov rax, fun; call rax; pop rsi; pop rdi
+    // All values live in the frame, the xmm registers are clobbered.
+    void call(void (*fun)()) {
+        emit({0x57, 0x56});
+        movRax(reinterpret_cast<uint64_t>(fun));
+        emit({0xff, 0xd0});
+        emit({0x5e, 0x5f});
+    }
+
+    // addsd, subsd, mulsd or divsd dst, src
+    void arith(Arith op, Xmm dst, Xmm src) {
+        emit({0xf2, 0x0f, op, modrm(3, dst, src)});
+    }
+    // ucomisd a, b
+    void ucomisd(Xmm a, Xmm b) { emit({0x66, 0x0f, 0x2e, modrm(3, a, b)}); }
+
+    // jcc rel32
+    void jcc(Cond c, Label target) {
+        emit({0x0f, (uint8_t)(0x80 | c)});
+        fixup(target);
+    }
+    // jmp rel32
+    void jmp(Label target) {
+        emit({0xe9});
+        fixup(target);
+    }
+
+    size_t size() const { return buf.size(); }
+
+    // Resolves all jumps and copies the code to dst
+    void copyTo(uint8_t* dst) {
+        for (auto& f : fixups) {
+            assert(labels[f.second] != UNBOUND);
+            auto rel = (int32_t)(labels[f.second] - (f.first + 4));
+            memcpy(&buf[f.first], &rel, sizeof(rel));
+        }
+        memcpy(dst, buf.data(), buf.size());
+    }
+
+  private:
+    enum : size_t { UNBOUND = SIZE_MAX };
+
+    std::vector<uint8_t> buf;
+    std::vector<size_t> labels;
+    std::vector<std::pair<size_t, Label>> fixups;
+
+    static uint8_t modrm(uint8_t mod, uint8_t reg, uint8_t rm) {
+        return (mod << 6) | (reg << 3) | rm;
+    }
+    static std::vector<uint8_t> imm32(size_t v) {
+        assert(v <= INT32_MAX);
+        return {(uint8_t)v, (uint8_t)(v >> 8), (uint8_t)(v >> 16),
+                (uint8_t)(v >> 24)};
+    }
+
+    void movRax(uint64_t imm) {
+        emit({0x48, 0xb8});
+        for (size_t i = 0; i < 8; ++i)
+            buf.push_back((imm >> (8 * i)) & 0xff);
+    }
+
+    void emit(std::initializer_list<uint8_t> bytes,
+              const std::vector<uint8_t>& imm = {}) {
+        buf.insert(buf.end(), bytes);
+        buf.insert(buf.end(), imm.begin(), imm.end());
+    }
+    void fixup(Label target) {
+        fixups.emplace_back(buf.size(), target);
+        buf.insert(buf.end(), 4, 0);
+    }
+};
+
+} // namespace pir
+} // namespace rir
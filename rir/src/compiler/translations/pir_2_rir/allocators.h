@@ -14,11 +14,15 @@ namespace pir {
  *
  * 1. Split phis with moves. This translates the IR to CSSA (see toCSSA).
  * 2. Compute liveness (see liveness.h):
- * 3. For now, just put everything on stack. (step 4 is thus skipped...)
+ * 3. Keep short lived values on the stack (see computeStackAllocation):
+ *    values used once, later in the same BB, and not buried under other stack
+ *    values at that point. They are consumed without any stack shuffling.
  * 4. Assign the remaining Instructions to local RIR variable numbers
  *    (see computeAllocation):
- *    1. Coalesce all remaining phi with their inputs. This is save since we are
+ *    1. Coalesce all phis with their inputs. This is save since we are
  *       already in CSSA. Directly allocate a register on the fly, such that.
+ *       The values copied into the phi share its slot too, if they do not
+ *       interfere, which turns the copy into a no-op.
  *    2. Traverse the dominance tree and eagerly allocate the remaining ones
  * 5. For debugging, verify the assignment with a static analysis that simulates
  *    the variable and stack usage (see verify).
@@ -55,33 +59,60 @@ class SSAAllocator {
         computeAllocation();
     }
 
-    void computeStackAllocation() {
-
-        static auto toStack = [](Instruction* i) -> bool {
-            return Phi::Cast(i) || !MkEnv::Cast(i);
+    // Is the value used exactly once, later in the same BB, with no other
+    // stack value on top of it at that point?
+    bool shortLived(BB* bb, BB::Instrs::reverse_iterator pos) const {
+        auto i = *pos;
+        auto use = i->hasSingleUse();
+        // Values copied into a phi are rather coalesced with it
+        if (!use || use->bb() != bb || Phi::Cast(use) || PirCopy::Cast(use))
+            return false;
+
+        auto argPos = [&](Value* v) {
+            size_t res = 0;
+            while (use->arg(res).val() != v)
+                res++;
+            return res;
         };
 
-        std::unordered_set<Value*> phis;
-
-        Visitor::run(code->entry, [&](Instruction* i) {
-            auto p = Phi::Cast(i);
-            if (!p || allocation.count(p))
-                return;
-            if (toStack(p)) {
-                allocation[p] = stackSlot;
-                p->eachArg(
-                    [&](BB*, Value* v) { allocation[v] = allocation[p]; });
-            } else {
-                phis.insert(p);
-                p->eachArg([&](BB*, Value* v) { phis.insert(v); });
+        // Instructions between the definition and the use leave their result
+        // above ours, unless it is consumed before, or loaded after ours
+        for (auto it = pos.base(); *it != use; ++it) {
+            auto w = *it;
+            if (!allocation.count(w) || allocation.at(w) != stackSlot ||
+                !w->producesRirResult())
+                continue;
+            auto wUse = w->hasSingleUse();
+            if (!wUse)
+                continue;
+            if (wUse->bb() != bb)
+                return false;
+            if (wUse == use) {
+                if (argPos(w) < argPos(i))
+                    return false;
+            } else if (!bb->before(wUse, use)) {
+                return false;
             }
-        });
+        }
+        return true;
+    }
 
-        Visitor::run(code->entry, [&](Instruction* i) {
-            if (allocation.count(i))
-                return;
-            if (toStack(i) && phis.count(i) == 0) {
-                allocation[i] = stackSlot;
+    void computeStackAllocation() {
+        Visitor::run(code->entry, [&](BB* bb) {
+            // Backwards, such that the values defined between a definition
+            // and its use are already allocated
+            for (auto it = bb->rbegin(); it != bb->rend(); ++it) {
+                auto i = *it;
+                if (!i->producesRirResult() || i->unused()) {
+                    allocation[i] = stackSlot;
+                    continue;
+                }
+                // Phis and their copies are coalesced in computeAllocation,
+                // environments are loaded many times
+                if (Phi::Cast(i) || PirCopy::Cast(i) || MkEnv::Cast(i))
+                    continue;
+                if (shortLived(bb, it))
+                    allocation[i] = stackSlot;
             }
         });
     }
@@ -119,6 +150,20 @@ class SSAAllocator {
                 allocation[v] = slot;
                 reverseAlloc[slot].insert(v);
             });
+
+            // Coalesce the copied values with the phi
+            p->eachArg([&](BB*, Value* v) {
+                auto cp = PirCopy::Cast(v);
+                if (!cp)
+                    return;
+                auto src = Instruction::Cast(cp->arg<0>().val());
+                if (src && !allocation.count(src) &&
+                    livenessIntervals.count(src) &&
+                    slotIsAvailable(slot, src)) {
+                    allocation[src] = slot;
+                    reverseAlloc[slot].insert(src);
+                }
+            });
         });
 
         // Traverse the dominance graph in preorder and eagerly assign slots.
@@ -0,0 +1,110 @@
+#include "layout.h"
+#include "../../pir/pir_impl.h"
+
+#include <algorithm>
+#include <unordered_map>
+
+namespace rir {
+namespace pir {
+
+BlockLayout::BlockLayout(Code* code, const std::function<bool(BB*)>& skip) {
+    auto resolve = [&](BB* bb) {
+        while (bb && skip(bb))
+            bb = bb->next();
+        return bb;
+    };
+    std::unordered_map<BB*, std::vector<BB*>> next;
+    auto computeNext = [&](BB* bb) {
+        auto& n = next[bb];
+        for (auto s : {bb->next0, bb->next1})
+            if (auto r = resolve(s))
+                n.push_back(r);
+    };
+
+    // Reverse postorder, forward edges go from lower to higher index
+    BB* entry = resolve(code->entry);
+    std::vector<BB*> rpo;
+    {
+        std::unordered_set<BB*> seen = {entry};
+        std::vector<std::pair<BB*, size_t>> todo = {{entry, 0}};
+        computeNext(entry);
+        while (!todo.empty()) {
+            auto bb = todo.back().first;
+            auto& succ = next[bb];
+            if (todo.back().second < succ.size()) {
+                auto s = succ[todo.back().second++];
+                if (seen.insert(s).second) {
+                    computeNext(s);
+                    todo.emplace_back(s, 0);
+                }
+            } else {
+                rpo.push_back(bb);
+                todo.pop_back();
+            }
+        }
+        std::reverse(rpo.begin(), rpo.end());
+    }
+    std::unordered_map<BB*, size_t> index;
+    std::unordered_map<BB*, std::vector<BB*>> preds;
+    for (size_t i = 0; i < rpo.size(); ++i) {
+        index[rpo[i]] = i;
+        for (auto s : next[rpo[i]])
+            preds[s].push_back(rpo[i]);
+    }
+
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (auto it = rpo.rbegin(); it != rpo.rend(); ++it) {
+            auto bb = *it;
+            if (cold(bb))
+                continue;
+            auto& succ = next[bb];
+            bool deopts =
+                succ.empty()
+                    ? !bb->isEmpty() && ScheduledDeopt::Cast(bb->last())
+                    : std::all_of(succ.begin(), succ.end(),
+                                  [&](BB* s) { return cold(s); });
+            if (deopts) {
+                cold_.insert(bb);
+                changed = true;
+            }
+        }
+    }
+    // The code starts with the entry, even if it always deopts
+    cold_.erase(entry);
+
+    std::unordered_set<BB*> placed;
+    auto ready = [&](BB* bb) {
+        for (auto p : preds[bb])
+            if (index.at(p) < index.at(bb) && !placed.count(p))
+                return false;
+        return true;
+    };
+    auto returns = [](BB* bb) {
+        return !bb->isEmpty() && Return::Cast(bb->last());
+    };
+    auto place = [&](bool hot) {
+        for (auto seed : rpo) {
+            if (placed.count(seed) || cold(seed) == hot)
+                continue;
+            for (BB* cur = seed; cur;) {
+                placed.insert(cur);
+                order_.push_back(cur);
+                BB* likely = nullptr;
+                for (auto s : next[cur]) {
+                    if (placed.count(s) || cold(s) == hot || !ready(s))
+                        continue;
+                    if (!likely || (returns(likely) && !returns(s)))
+                        likely = s;
+                }
+                cur = likely;
+            }
+        }
+    };
+    place(true);
+    place(false);
+}
+
+} // namespace pir
+} // namespace rir
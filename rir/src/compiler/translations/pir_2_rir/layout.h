@@ -0,0 +1,40 @@
+#pragma once
+
+#include "../../pir/pir.h"
+
+#include <functional>
+#include <unordered_set>
+#include <vector>
+
+namespace rir {
+namespace pir {
+
+/*
+ * Orders the basic blocks of a code for emitting them. Blocks for which skip
+ * holds are jumped through and not placed. Must run after lowering.
+ *
+ * Cold blocks, which inevitably end in a deopt, are moved behind all other
+ * blocks to the end of the code. The remaining blocks are chained such that
+ * every block falls through to its likely successor, if all its forward
+ * predecessors are placed already. There is no branch profile, so every
+ * successor which is not cold is likely. When both are, a successor which
+ * continues is preferred over one returning, and the true branch over the
+ * false one.
+ *
+ * Every block is placed after one of its predecessors, thus after all its
+ * dominators.
+ */
+class BlockLayout {
+  public:
+    BlockLayout(Code* code, const std::function<bool(BB*)>& skip);
+
+    const std::vector<BB*>& order() const { return order_; }
+    bool cold(BB* bb) const { return cold_.count(bb); }
+
+  private:
+    std::vector<BB*> order_;
+    std::unordered_set<BB*> cold_;
+};
+
+} // namespace pir
+} // namespace rir
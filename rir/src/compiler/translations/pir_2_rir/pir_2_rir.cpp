@@ -5,6 +5,7 @@
 #include "../../transform/bb.h"
 #include "../../util/cfg.h"
 #include "../../util/visitor.h"
+#include "../pir_2_native/pir_2_native.h"
 #include "allocators.h"
 #include "compiler/analysis/reference_count.h"
 #include "compiler/analysis/verifier.h"
@@ -13,8 +14,10 @@
 #include "interpreter/instance.h"
 #include "ir/CodeStream.h"
 #include "ir/CodeVerifier.h"
+#include "layout.h"
 #include "runtime/DispatchTable.h"
 #include "simple_instruction_list.h"
+#include "unboxing.h"
 #include "utils/FunctionWriter.h"
 
 #include "../../debugging/PerfCounter.h"
@@ -69,6 +72,11 @@ class Pir2Rir {
     bool dryRun;
     LogStream& log;
 
+    // The binding dependencies of the version, shared between the Function
+    // and the dependency checks in its code
+    SEXP dependencies();
+    SEXP dependencies_ = nullptr;
+
     class CodeBuffer {
       private:
         struct Src {
@@ -258,6 +266,40 @@ static unsigned ClosuresCompiled =
     EventCounters::instance().registerCounter("closures compiled");
 #endif
 
+// The promise passed as argument idx to cls does not outlive the call: it is
+// only forced, and cls is a leaf which could reach the promise reflectively
+static bool argumentEscapes(ClosureVersion* cls, size_t idx) {
+    return !Visitor::check(cls->entry, [&](Instruction* i) {
+        if ((CallInstruction::CastCall(i) && !CallSafeBuiltin::Cast(i)) ||
+            MkArg::Cast(i) || MkFunCls::Cast(i))
+            return false;
+        bool onlyForced = true;
+        i->eachArg([&](Value* v) {
+            auto ld = LdArg::Cast(v);
+            if (ld && ld->id == idx && !Force::Cast(i))
+                onlyForced = false;
+        });
+        return onlyForced;
+    });
+}
+
+// cls can run without a function context: it does not reflect, does not run
+// code which could (eg. by forcing a lazy promise or calling a closure) and
+// has no deopt exits, since deoptimization needs the context of the outermost
+// frame
+static bool needsContext(ClosureVersion* cls) {
+    static const Effects contextEffects =
+        Effects(Effect::Reflection) | Effect::ChangesContexts |
+        Effect::TriggerDeopt | Effect::ExecuteCode | Effect::Force;
+    return !Visitor::check(cls->entry, [&](Instruction* i) {
+        if ((CallInstruction::CastCall(i) && !CallSafeBuiltin::Cast(i)) ||
+            MkEnv::Cast(i) || PushContext::Cast(i) || MkArg::Cast(i) ||
+            MkFunCls::Cast(i) || ScheduledDeopt::Cast(i))
+            return false;
+        return Nop::Cast(i) || !i->effects.intersects(contextEffects);
+    });
+}
+
 rir::Code* Pir2Rir::compileCode(Context& ctx, Code* code) {
 #ifdef ENABLE_EVENT_COUNTERS
     if (ENABLE_EVENT_COUNTERS) {
@@ -284,6 +326,7 @@ rir::Code* Pir2Rir::compileCode(Context& ctx, Code* code) {
     log.CSSA(code);
 
     SSAAllocator alloc(code, cls, log);
+    Unboxing unboxing(code);
     log.afterAllocator(code, [&](std::ostream& o) { alloc.print(o); });
     alloc.verify();
 
@@ -302,15 +345,15 @@ rir::Code* Pir2Rir::compileCode(Context& ctx, Code* code) {
     LastEnv lastEnv(cls, code, log);
     std::unordered_map<Value*, BC::Label> pushContexts;
 
+    BlockLayout layout(code, isJumpThrough);
     std::deque<unsigned> order;
-    LoweringVisitor::run(code->entry, [&](BB* bb) {
-        if (!isJumpThrough(bb))
-            order.push_back(bb->id);
-    });
+    for (auto bb : layout.order())
+        order.push_back(bb->id);
 
     std::unordered_set<Instruction*> needsEnsureNamed;
     std::unordered_set<Instruction*> needsSetShared;
     std::unordered_set<Instruction*> needsLdVarForUpdate;
+    std::unordered_set<MkArg*> stackPromises;
     bool refcountAnalysisOverflow = false;
     {
         Visitor::run(code->entry, [&](Instruction* i) {
@@ -351,6 +394,26 @@ rir::Code* Pir2Rir::compileCode(Context& ctx, Code* code) {
             }
         });
 
+        // Evaluated promises, which are only passed to a static call of a
+        // version they do not escape, are not heap allocated
+        Visitor::run(code->entry, [&](Instruction* i) {
+            auto call = StaticCall::Cast(i);
+            if (!call)
+                return;
+            auto trg = call->tryOptimisticDispatch();
+            if (!trg || trg->owner()->formals().hasDots())
+                return;
+            size_t pos = 0;
+            call->eachCallArg([&](Value* v) {
+                auto mk = MkArg::Cast(v);
+                if (mk && mk->isEager() && mk->hasSingleUse() == call &&
+                    pos < FunctionSignature::MAX_NON_ESCAPING_ARGS &&
+                    !argumentEscapes(trg, pos))
+                    stackPromises.insert(mk);
+                pos++;
+            });
+        });
+
         StaticReferenceCount analysis(cls, log);
         if (analysis.result().overflow)
             refcountAnalysisOverflow = true;
@@ -361,16 +424,34 @@ rir::Code* Pir2Rir::compileCode(Context& ctx, Code* code) {
             }
     }
 
+    // Phis in a local and copies between values coalesced into the same local
+    // do not move anything, the value is already in place
+    auto inPlace = [&](Instruction* instr) {
+        if (!alloc.hasSlot(instr) || alloc.onStack(instr) ||
+            alloc.sa.dead(instr))
+            return false;
+        if (Phi::Cast(instr))
+            return true;
+        auto cp = PirCopy::Cast(instr);
+        if (!cp)
+            return false;
+        bool refcount =
+            (instr->minReferenceCount() < 2 && needsSetShared.count(instr)) ||
+            (instr->minReferenceCount() < 1 &&
+             (refcountAnalysisOverflow || needsEnsureNamed.count(instr)));
+        auto src = cp->arg<0>().val();
+        return !refcount && alloc.hasSlot(src) && !alloc.onStack(src) &&
+               alloc[src] == alloc[instr] &&
+               unboxing.unboxed(src) == unboxing.unboxed(instr);
+    };
+
     CodeBuffer cb(ctx.cs());
 
     const CachePosition cache(code);
     if (cache.globalEnvsCacheSize() > 0)
         cb.add(BC::clearBindingCache(0, cache.globalEnvsCacheSize()));
 
-    LoweringVisitor::run(code->entry, [&](BB* bb) {
-        if (isJumpThrough(bb))
-            return;
-
+    auto compileBB = [&](BB* bb) {
         order.pop_front();
         cb.add(bbLabels[bb]);
 
@@ -516,6 +597,9 @@ rir::Code* Pir2Rir::compileCode(Context& ctx, Code* code) {
                     cb.add(BC::pop());
                 }
 
+                if (inPlace(instr))
+                    continue;
+
                 if (auto phi = Phi::Cast(instr)) {
                     loadPhiArg(phi);
                 } else {
@@ -552,6 +636,12 @@ rir::Code* Pir2Rir::compileCode(Context& ctx, Code* code) {
                             }
                         } else {
                             loadArg(what, argNumber);
+                            if (unboxing.unboxed(what) &&
+                                !unboxing.native(instr))
+                                cb.add(BC::box());
+                            else if (!unboxing.unboxed(what) &&
+                                     unboxing.native(instr))
+                                cb.add(BC::unbox());
                         }
                         argNumber++;
                     });
@@ -562,6 +652,8 @@ rir::Code* Pir2Rir::compileCode(Context& ctx, Code* code) {
 
             case Tag::LdConst: {
                 cb.add(BC::push_from_pool(LdConst::Cast(instr)->idx));
+                if (unboxing.unboxed(instr))
+                    cb.add(BC::unbox());
                 break;
             }
 
@@ -652,9 +744,13 @@ rir::Code* Pir2Rir::compileCode(Context& ctx, Code* code) {
             }
 
             case Tag::MkArg: {
-                auto p = MkArg::Cast(instr)->prom();
-                unsigned id = ctx.cs().addPromise(getPromise(ctx, p));
-                cb.add(BC::promise(id));
+                auto mk = MkArg::Cast(instr);
+                unsigned id =
+                    ctx.cs().addPromise(getPromise(ctx, mk->prom()));
+                if (stackPromises.count(mk))
+                    cb.add(BC::stackPromise(id));
+                else
+                    cb.add(BC::promise(id));
                 break;
             }
 
@@ -714,6 +810,20 @@ rir::Code* Pir2Rir::compileCode(Context& ctx, Code* code) {
                 break;
             }
 
+            case Tag::DependenciesValid: {
+                // A vector with just this binding, such that the check does
+                // not depend on the number of dependencies of the version
+                auto dv = DependenciesValid::Cast(instr);
+                auto n = Function::DEPENDENCY_FIELDS;
+                SEXP dep = Rf_allocVector(VECSXP, n);
+                Protect p(dep);
+                SET_VECTOR_ELT(dep, 0, dv->bindingEnv);
+                SET_VECTOR_ELT(dep, 1, dv->varName);
+                SET_VECTOR_ELT(dep, 2, dv->value);
+                cb.add(BC::checkDependencies(dep));
+                break;
+            }
+
 #define EMPTY(Name)                                                            \
     case Tag::Name: {                                                          \
         break;                                                                 \
@@ -736,8 +846,6 @@ rir::Code* Pir2Rir::compileCode(Context& ctx, Code* code) {
                 SIMPLE(IsEnvStub, isstubenv);
                 SIMPLE(LOr, lglOr);
                 SIMPLE(LAnd, lglAnd);
-                SIMPLE(Inc, inc);
-                SIMPLE(Dec, dec);
                 SIMPLE(Force, force);
                 SIMPLE(AsTest, asbool);
                 SIMPLE(Length, length);
@@ -755,34 +863,64 @@ rir::Code* Pir2Rir::compileCode(Context& ctx, Code* code) {
         cb.add(BC::Factory(), instr->srcIdx);                                  \
         break;                                                                 \
     }
-                SIMPLE_WITH_SRCIDX(Add, add);
-                SIMPLE_WITH_SRCIDX(Sub, sub);
-                SIMPLE_WITH_SRCIDX(Mul, mul);
-                SIMPLE_WITH_SRCIDX(Div, div);
                 SIMPLE_WITH_SRCIDX(IDiv, idiv);
                 SIMPLE_WITH_SRCIDX(Mod, mod);
                 SIMPLE_WITH_SRCIDX(Pow, pow);
-                SIMPLE_WITH_SRCIDX(Lt, lt);
-                SIMPLE_WITH_SRCIDX(Gt, gt);
-                SIMPLE_WITH_SRCIDX(Lte, le);
-                SIMPLE_WITH_SRCIDX(Gte, ge);
-                SIMPLE_WITH_SRCIDX(Eq, eq);
-                SIMPLE_WITH_SRCIDX(Neq, ne);
                 SIMPLE_WITH_SRCIDX(Colon, colon);
                 SIMPLE_WITH_SRCIDX(AsLogical, asLogical);
                 SIMPLE_WITH_SRCIDX(Plus, uplus);
                 SIMPLE_WITH_SRCIDX(Minus, uminus);
                 SIMPLE_WITH_SRCIDX(Not, not_);
                 SIMPLE_WITH_SRCIDX(Extract1_1D, extract1_1);
-                SIMPLE_WITH_SRCIDX(Extract2_1D, extract2_1);
                 SIMPLE_WITH_SRCIDX(Extract1_2D, extract1_2);
                 SIMPLE_WITH_SRCIDX(Extract2_2D, extract2_2);
-                SIMPLE_WITH_SRCIDX(Subassign1_1D, subassign1_1);
-                SIMPLE_WITH_SRCIDX(Subassign2_1D, subassign2_1);
                 SIMPLE_WITH_SRCIDX(Subassign1_2D, subassign1_2);
                 SIMPLE_WITH_SRCIDX(Subassign2_2D, subassign2_2);
 #undef SIMPLE_WITH_SRCIDX
 
+#define UNBOXABLE(Name, Factory)                                               \
+    case Tag::Name: {                                                          \
+        if (unboxing.native(instr))                                            \
+            cb.add(BC::Factory##Unboxed(), instr->srcIdx);                     \
+        else                                                                   \
+            cb.add(BC::Factory(), instr->srcIdx);                              \
+        break;                                                                 \
+    }
+                UNBOXABLE(Add, add);
+                UNBOXABLE(Sub, sub);
+                UNBOXABLE(Mul, mul);
+                UNBOXABLE(Div, div);
+                UNBOXABLE(Lt, lt);
+                UNBOXABLE(Gt, gt);
+                UNBOXABLE(Lte, le);
+                UNBOXABLE(Gte, ge);
+                UNBOXABLE(Eq, eq);
+                UNBOXABLE(Neq, ne);
+#undef UNBOXABLE
+
+            case Tag::Inc: {
+                cb.add(unboxing.native(instr) ? BC::incUnboxed() : BC::inc());
+                break;
+            }
+
+            case Tag::Dec: {
+                cb.add(unboxing.native(instr) ? BC::decUnboxed() : BC::dec());
+                break;
+            }
+
+#define VECTOR_ACCESS(Name, Factory)                                           \
+    case Tag::Name: {                                                          \
+        if (Name::Cast(instr)->inBounds)                                       \
+            cb.add(BC::Factory##Unchecked(), instr->srcIdx);                   \
+        else                                                                   \
+            cb.add(BC::Factory(), instr->srcIdx);                              \
+        break;                                                                 \
+    }
+                VECTOR_ACCESS(Extract2_1D, extract2_1);
+                VECTOR_ACCESS(Subassign1_1D, subassign1_1);
+                VECTOR_ACCESS(Subassign2_1D, subassign2_1);
+#undef VECTOR_ACCESS
+
             case Tag::Call: {
                 auto call = Call::Cast(instr);
                 cb.add(BC::call(call->nCallArgs(), Pool::get(call->srcIdx),
@@ -850,6 +988,17 @@ rir::Code* Pir2Rir::compileCode(Context& ctx, Code* code) {
                 break;
             }
 
+            case Tag::FusedArith: {
+                auto fused = FusedArith::Cast(instr);
+                SEXP kernel = Rf_allocVector(INTSXP, fused->kernel.size());
+                Protect p(kernel);
+                std::copy(fused->kernel.begin(), fused->kernel.end(),
+                          INTEGER(kernel));
+                cb.add(BC::push(kernel));
+                cb.add(BC::fused(fused->nargs()), instr->srcIdx);
+                break;
+            }
+
             case Tag::PushContext: {
                 if (!pushContexts.count(instr))
                     pushContexts[instr] = ctx.cs().mkLabel();
@@ -866,6 +1015,16 @@ rir::Code* Pir2Rir::compileCode(Context& ctx, Code* code) {
                 break;
             }
 
+            case Tag::PushLoopContext: {
+                cb.add(BC::pushLoopContext());
+                break;
+            }
+
+            case Tag::PopLoopContext: {
+                cb.add(BC::popLoopContext());
+                break;
+            }
+
             case Tag::MkEnv: {
                 auto mkenv = MkEnv::Cast(instr);
                 cb.add(BC::mkEnv(mkenv->varName, mkenv->context, mkenv->stub));
@@ -892,7 +1051,7 @@ rir::Code* Pir2Rir::compileCode(Context& ctx, Code* code) {
             case Tag::Branch: {
                 auto trueBranch = jumpThroughEmpty(bb->trueBranch());
                 auto falseBranch = jumpThroughEmpty(bb->falseBranch());
-                if (trueBranch->id == order.front()) {
+                if (!order.empty() && trueBranch->id == order.front()) {
                     cb.add(BC::brfalse(bbLabels[falseBranch]));
                     cb.add(BC::br(bbLabels[trueBranch]));
                 } else {
@@ -957,16 +1116,27 @@ rir::Code* Pir2Rir::compileCode(Context& ctx, Code* code) {
             }
             }
 
-            if (instr->minReferenceCount() < 2 && needsSetShared.count(instr))
-                cb.add(BC::setShared());
-            else if (instr->minReferenceCount() < 1 &&
-                     (refcountAnalysisOverflow ||
-                      needsEnsureNamed.count(instr)))
-                cb.add(BC::ensureNamed());
+            // Native arithmetic does not set the visibility
+            if (unboxing.native(instr) && instr->hasVisibility())
+                cb.add(BC::visible());
+            if (unboxing.native(instr) && !PirCopy::Cast(instr) &&
+                !unboxing.unboxed(instr))
+                cb.add(BC::box());
+
+            // Unboxed values are copied, they are never shared
+            if (!unboxing.unboxed(instr)) {
+                if (instr->minReferenceCount() < 2 &&
+                    needsSetShared.count(instr))
+                    cb.add(BC::setShared());
+                else if (instr->minReferenceCount() < 1 &&
+                         (refcountAnalysisOverflow ||
+                          needsEnsureNamed.count(instr)))
+                    cb.add(BC::ensureNamed());
+            }
 
             // Check the return type
             if (pir::Parameter::RIR_CHECK_PIR_TYPES > 0 &&
-                instr->type != PirType::voyd() &&
+                !unboxing.unboxed(instr) && instr->type != PirType::voyd() &&
                 instr->type != NativeType::context && !CastType::Cast(instr) &&
                 Visitor::check(code->entry, [&](Instruction* i) {
                     if (auto cast = CastType::Cast(i)) {
@@ -1003,7 +1173,9 @@ rir::Code* Pir2Rir::compileCode(Context& ctx, Code* code) {
         assert(bb->isJmp());
         auto next = jumpThroughEmpty(bb->trueBranch());
         cb.add(BC::br(bbLabels[next]));
-    });
+    };
+    for (auto bb : layout.order())
+        compileBB(bb);
     cb.flush();
 
     auto localsCnt = alloc.slots();
@@ -1156,6 +1328,22 @@ rir::Code* Pir2Rir::getPromise(Context& ctx, Promise* p) {
     return promises.at(p);
 }
 
+SEXP Pir2Rir::dependencies() {
+    if (dependencies_)
+        return dependencies_;
+    auto& deps = cls->bindingDependencies();
+    auto n = Function::DEPENDENCY_FIELDS;
+    dependencies_ = Rf_allocVector(VECSXP, deps.size() * n);
+    // Keeps the vector alive
+    Pool::insert(dependencies_);
+    for (size_t i = 0; i < deps.size(); ++i) {
+        SET_VECTOR_ELT(dependencies_, i * n, deps[i].env);
+        SET_VECTOR_ELT(dependencies_, i * n + 1, deps[i].sym);
+        SET_VECTOR_ELT(dependencies_, i * n + 2, deps[i].value);
+    }
+    return dependencies_;
+}
+
 rir::Function* Pir2Rir::finalize() {
     // TODO: keep track of source ast indices in the source pool
     // (for now, calls, promises and operators do)
@@ -1169,16 +1357,35 @@ rir::Function* Pir2Rir::finalize() {
                                 cls->assumptions());
 
     // PIR does not support default args currently.
+    auto& formals = cls->owner()->formals();
     for (size_t i = 0; i < cls->nargs(); ++i) {
         function.addArgWithoutDefault();
-        signature.pushDefaultArgument();
+        if (formals.names()[i] == R_DotsSymbol) {
+            // See Rir2PirCompiler::compileClosure
+            assert(i + 1 == cls->nargs() && "... has to be the last formal");
+            signature.pushDotsArgument();
+        } else {
+            signature.pushDefaultArgument();
+        }
     }
 
     assert(signature.formalNargs() == cls->nargs());
     ctx.push(R_NilValue);
     auto body = compileCode(ctx, cls);
     log.finalPIR(cls);
+    if (!signature.hasDotsFormals) {
+        auto n = std::min(cls->nargs(),
+                          (size_t)FunctionSignature::MAX_NON_ESCAPING_ARGS);
+        for (size_t i = 0; i < n; ++i)
+            if (!argumentEscapes(cls, i))
+                signature.nonEscapingArgs |= 1u << i;
+    }
+    signature.contextFree = !needsContext(cls);
     function.finalize(body, signature);
+    function.function()->nativeCode(Pir2Native::compile(cls));
+
+    if (!cls->bindingDependencies().empty())
+        function.function()->dependencies(dependencies());
 #ifdef ENABLE_SLOWASSERT
     CodeVerifier::verifyFunctionLayout(function.function()->container(),
                                        globalContext());
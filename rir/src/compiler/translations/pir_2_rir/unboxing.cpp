@@ -0,0 +1,170 @@
+#include "unboxing.h"
+#include "../../pir/pir_impl.h"
+#include "../../util/visitor.h"
+#include "R/r.h"
+
+#include <unordered_map>
+
+namespace rir {
+namespace pir {
+
+// Arithmetic and comparisons which have an unboxed RIR instruction
+static bool isNativeOp(Instruction* i) {
+    switch (i->tag) {
+    case Tag::Inc:
+    case Tag::Dec:
+        // The unboxed versions only handle plain integers
+        return i->arg(0).val()->type.isA(PirType::simpleScalarInt());
+    case Tag::Add:
+    case Tag::Sub:
+    case Tag::Mul:
+    case Tag::Div:
+    case Tag::Lt:
+    case Tag::Gt:
+    case Tag::Lte:
+    case Tag::Gte:
+    case Tag::Eq:
+    case Tag::Neq:
+        break;
+    default:
+        return false;
+    }
+    auto num = PirType::simpleScalarInt() | PirType::simpleScalarReal();
+    return i->env() == Env::elided() && i->arg(0).val()->type.isA(num) &&
+           i->arg(1).val()->type.isA(num);
+}
+
+// Scalars which cannot have attributes, if all their inputs have none
+static bool mayBePlain(Instruction* i) {
+    if (!i->type.isA(PirType::simpleScalar()))
+        return false;
+    switch (i->tag) {
+    case Tag::LdConst: {
+        SEXP c = LdConst::Cast(i)->c();
+        return IS_SIMPLE_SCALAR(c, INTSXP) || IS_SIMPLE_SCALAR(c, REALSXP) ||
+               IS_SIMPLE_SCALAR(c, LGLSXP);
+    }
+    case Tag::Length:
+    case Tag::ForSeqSize:
+    case Tag::Phi:
+    case Tag::PirCopy:
+        return true;
+    case Tag::Extract2_1D:
+    case Tag::Extract2_2D:
+        // [[ drops the attributes of atomic vectors
+        return i->arg(0).val()->type.isA(
+            (PirType(RType::logical) | RType::integer | RType::real)
+                .notObject());
+    default:
+        return isNativeOp(i);
+    }
+}
+
+Unboxing::Unboxing(Code* code) {
+#ifdef TYPED_STACK
+    std::unordered_set<Instruction*> plain;
+    std::unordered_map<Value*, std::vector<PirCopy*>> copies;
+    Visitor::run(code->entry, [&](Instruction* i) {
+        if (mayBePlain(i))
+            plain.insert(i);
+        if (auto cp = PirCopy::Cast(i))
+            copies[cp->arg<0>().val()].push_back(cp);
+    });
+
+    // Optimistically assume that loop carried values are plain, until one of
+    // the inputs is not
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (auto it = plain.begin(); it != plain.end();) {
+            auto i = *it;
+            bool keep = true;
+            if (Phi::Cast(i) || PirCopy::Cast(i) || isNativeOp(i)) {
+                i->eachArg([&](Value* v) {
+                    if (i->hasEnv() && v == i->env())
+                        return;
+                    auto arg = Instruction::Cast(v);
+                    if (!arg || !plain.count(arg))
+                        keep = false;
+                });
+            }
+            if (keep) {
+                it++;
+            } else {
+                it = plain.erase(it);
+                changed = true;
+            }
+        }
+    }
+
+    for (auto i : plain)
+        if (isNativeOp(i))
+            native_.insert(i);
+
+    // Keeping a result unboxed only pays off if it does not have to be boxed
+    // multiple times
+    std::unordered_map<Instruction*, size_t> boxedUses;
+    Visitor::run(code->entry, [&](Instruction* i) {
+        if (native_.count(i))
+            return;
+        i->eachArg([&](Value* v) {
+            if (auto arg = Instruction::Cast(v))
+                boxedUses[arg]++;
+        });
+    });
+    for (auto i : native_)
+        if (boxedUses[i] <= 1)
+            unboxed_.insert(i);
+
+    // Phis, their inputs and copies share the representation. Unbox phis
+    // with an unboxed incoming value.
+    changed = true;
+    while (changed) {
+        changed = false;
+        for (auto i : plain) {
+            auto phi = Phi::Cast(i);
+            if (!phi || unboxed_.count(phi))
+                continue;
+            bool profitable = false;
+            phi->eachArg([&](BB*, Value* in) {
+                if (auto cp = PirCopy::Cast(in))
+                    in = cp->arg<0>().val();
+                if (unboxed_.count(in))
+                    profitable = true;
+            });
+            if (!profitable)
+                continue;
+
+            unboxed_.insert(phi);
+            phi->eachArg([&](BB*, Value* in) {
+                unboxed_.insert(in);
+                if (auto cp = PirCopy::Cast(in))
+                    native_.insert(cp);
+            });
+            for (auto cp : copies[phi]) {
+                unboxed_.insert(cp);
+                native_.insert(cp);
+            }
+            changed = true;
+        }
+    }
+
+    // With boxed operands and a boxed result, the native version would only
+    // unbox the operands to box the result right away
+    for (auto it = native_.begin(); it != native_.end();) {
+        auto i = *it;
+        bool profitable = PirCopy::Cast(i) || unboxed_.count(i);
+        i->eachArg([&](Value* v) {
+            if (unboxed_.count(v))
+                profitable = true;
+        });
+        if (profitable)
+            it++;
+        else
+            it = native_.erase(it);
+    }
+#endif
+}
+
+} // namespace pir
+} // namespace rir
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "../../pir/pir.h"
+
+#include <unordered_set>
+
+namespace rir {
+namespace pir {
+
+/*
+ * Decides which scalar integers, reals and logicals are kept unboxed in
+ * their stack cell or local when lowering to RIR. Lowering runs it after
+ * toCSSA. On code not in CSSA form (eg. in PirCheck) the inputs of phis are
+ * the values themselves, which is good enough to tell what gets boxed.
+ *
+ * Results of arithmetic and comparisons on scalars are computed natively
+ * and phis (ie. their copies and inputs) carrying such results stay unboxed.
+ * Every other consumer sees a boxed value, thus values are boxed when they
+ * escape to environments, calls, deopts or are returned. A result with more
+ * than one such use is boxed once, right after it is computed. Ops with only
+ * boxed operands and a boxed result stay boxed. Since PirType does
+ * not know about attributes, only values which provably have none are
+ * unboxed.
+ *
+ * Unboxed values need a typed stack, without it nothing is unboxed.
+ */
+class Unboxing {
+  public:
+    explicit Unboxing(Code* code);
+
+    // The value lives unboxed in its stack cell or local
+    bool unboxed(Value* v) const { return unboxed_.count(v); }
+    // The instruction expects its arguments unboxed
+    bool native(Instruction* i) const { return native_.count(i); }
+
+  private:
+    std::unordered_set<Value*> unboxed_;
+    std::unordered_set<Instruction*> native_;
+};
+
+} // namespace pir
+} // namespace rir
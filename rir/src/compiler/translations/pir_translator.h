@@ -13,12 +13,25 @@ class PirTranslator {
   public:
     explicit PirTranslator(const std::string& name) : name(name) {}
 
-    virtual void apply(RirCompiler&, ClosureVersion* function,
+    // Returns true if the pass changed the IR. The scheduler relies on this to
+    // detect a fixpoint, so a pass must not report a change if it did nothing.
+    virtual bool apply(RirCompiler&, ClosureVersion* function,
                        LogStream&) const = 0;
     std::string getName() const { return this->name; }
     virtual ~PirTranslator() {}
 
     virtual bool isPhaseMarker() const { return false; }
+    // Interprocedural passes also depend on other versions in the module (eg.
+    // the inliner looks at its callees), so they cannot be skipped just
+    // because the version itself did not change.
+    virtual bool isInterprocedural() const { return false; }
+    // Passes which never add or remove basic blocks or edges keep the cached
+    // analyses of the version (see AnalysisManager) valid.
+    virtual bool preservesCFG() const { return false; }
+    // Parallelizable passes can run on several versions at the same time (see
+    // ThreadPool). They must only touch the version they are applied to and
+    // must not allocate on the R heap (eg. by creating constants).
+    virtual bool isParallelizable() const { return false; }
 
   protected:
     std::string name;
@@ -7,6 +7,7 @@
 #include "../../util/arg_match.h"
 #include "../../util/builder.h"
 #include "../../util/cfg.h"
+#include "../../util/safe_builtins_list.h"
 #include "../../util/visitor.h"
 #include "R/Funtab.h"
 #include "R/RList.h"
@@ -16,6 +17,7 @@
 #include "simple_instruction_list.h"
 #include "utils/FormalArgs.h"
 
+#include <algorithm>
 #include <sstream>
 #include <unordered_map>
 #include <vector>
@@ -49,6 +51,17 @@ struct Matcher {
     }
 };
 
+// A loop context pushed at the beginloop_ of the loop starting at head. It
+// spans all iterations and is left when the translation jumps to the endloop_
+// at exit, or out of the loop.
+struct LoopContext {
+    PushLoopContext* push;
+    Opcode* head;
+    Opcode* exit;
+
+    bool contains(Opcode* pc) const { return pc >= head && pc < exit; }
+};
+
 struct State {
     bool seen = false;
     BB* entryBB = nullptr;
@@ -58,7 +71,8 @@ struct State {
     State(State&&) = default;
     State(const State&) = delete;
     State(const State& other, bool seen, BB* entryBB, Opcode* entryPC)
-        : seen(seen), entryBB(entryBB), entryPC(entryPC), stack(other.stack){};
+        : seen(seen), entryBB(entryBB), entryPC(entryPC), stack(other.stack),
+          loopContexts(other.loopContexts){};
 
     void operator=(const State&) = delete;
     State& operator=(State&&) = default;
@@ -68,11 +82,13 @@ struct State {
 
     void clear() {
         stack.clear();
+        loopContexts.clear();
         entryBB = nullptr;
         entryPC = nullptr;
     }
 
     RirStack stack;
+    std::vector<LoopContext> loopContexts;
 };
 
 void State::createMergepoint(Builder& insert) {
@@ -88,6 +104,7 @@ void State::createMergepoint(Builder& insert) {
 
 void State::mergeIn(const State& incom, BB* incomBB) {
     assert(stack.size() == incom.stack.size());
+    assert(loopContexts.size() == incom.loopContexts.size());
 
     for (size_t i = 0; i < stack.size(); ++i) {
         Phi* p = Phi::Cast(stack.at(i));
@@ -110,6 +127,20 @@ std::unordered_set<Opcode*> findMergepoints(rir::Code* srcCode) {
         }
         pc = BC::next(pc);
     }
+
+    std::unordered_set<Opcode*> mergepoints;
+    // The head and the end of a loop with a context are reached from the
+    // handler for non-local break and next, so they always have to be
+    // mergepoints.
+    for (auto pc = srcCode->code(); pc != srcCode->endCode();) {
+        BC bc = BC::decodeShallow(pc);
+        if (bc.bc == Opcode::beginloop_) {
+            mergepoints.insert(BC::next(pc));
+            mergepoints.insert(bc.jmpTarget(pc));
+        }
+        pc = BC::next(pc);
+    }
+
     // Mark falltrough to label
     for (auto pc = srcCode->code(); pc != srcCode->endCode();) {
         BC bc = BC::decodeShallow(pc);
@@ -121,7 +152,6 @@ std::unordered_set<Opcode*> findMergepoints(rir::Code* srcCode) {
         pc = BC::next(pc);
     }
 
-    std::unordered_set<Opcode*> mergepoints;
     // Create mergepoints
     for (auto m : incom)
         // The first position must also be considered a mergepoint in case it
@@ -131,6 +161,35 @@ std::unordered_set<Opcode*> findMergepoints(rir::Code* srcCode) {
     return mergepoints;
 }
 
+// Could executing the code create a local binding for sym? We look for
+// assignments and calls to functions which can assign reflectively. Callees
+// assigning into the parent frame are not considered, like the GNU R byte
+// code compiler does not.
+bool mayBindLocally(rir::Code* code, SEXP sym) {
+    for (auto pc = code->code(); pc != code->endCode(); pc = BC::next(pc)) {
+        BC bc = BC::decodeShallow(pc);
+        switch (bc.bc) {
+        case Opcode::stvar_:
+        case Opcode::stvar_cached_:
+            if (bc.immediateConst() == sym)
+                return true;
+            break;
+        case Opcode::ldfun_:
+            if (!SafeBuiltinsList::forLocalBindings(bc.immediateConst()))
+                return true;
+            break;
+        default:
+            break;
+        }
+    }
+    for (size_t i = 0; i < code->extraPoolSize; ++i) {
+        auto inner = rir::Code::check(code->getExtraPoolEntry(i));
+        if (inner && mayBindLocally(inner, sym))
+            return true;
+    }
+    return false;
+}
+
 } // namespace
 
 namespace rir {
@@ -141,8 +200,9 @@ Checkpoint* Rir2Pir::addCheckpoint(rir::Code* srcCode, Opcode* pos,
                                    Builder& insert) const {
     // Checkpoints in promises are badly supported (cannot inline promises
     // anymore) and checkpoints in eagerly inlined promises are wrong. So for
-    // now we do not emit them in promises!
-    assert(!inPromise());
+    // now we do not emit them in promises! Neither in loop contexts, see
+    // canDeopt.
+    assert(canDeopt());
     return insert.emitCheckpoint(srcCode, pos, stack);
 }
 
@@ -209,7 +269,7 @@ bool Rir2Pir::compileBC(const BC& bc, Opcode* pos, Opcode* nextPos,
     case Opcode::ldvar_for_update_cache_:
         v = insert(new LdVar(bc.immediateConst(), env));
         // Checkpoint might be useful if we end up inlining this force
-        if (!inPromise())
+        if (canDeopt())
             addCheckpoint(srcCode, pos, stack, insert);
         push(insert(new Force(v, env)));
         break;
@@ -286,6 +346,9 @@ bool Rir2Pir::compileBC(const BC& bc, Opcode* pos, Opcode* nextPos,
     }
 
     case Opcode::nop_:
+    // The loop context is left by the translation of the jumps to the end of
+    // the loop, see Rir2Pir::tryTranslate
+    case Opcode::endloop_:
         break;
 
     case Opcode::pop_:
@@ -315,13 +378,19 @@ bool Rir2Pir::compileBC(const BC& bc, Opcode* pos, Opcode* nextPos,
         Value* callee = top();
         SEXP monomorphic = nullptr;
 
-        // TODO: Support ...
-        for (auto argi : bc.callExtra().immediateCallArguments) {
-            if (argi == DOTS_ARG_IDX) {
-                log.warn("Cannot compile call with ... arguments");
-                return false;
-            }
-        }
+        // A ... argument is passed as the value of the ellipsis, named `...`.
+        // The interpreter flattens it into the actual arguments. Since the
+        // number and names of arguments are only known at runtime, we do not
+        // speculate on the target of such calls.
+        auto& callArgs = bc.callExtra().immediateCallArguments;
+        bool hasDotsArgs = std::find(callArgs.begin(), callArgs.end(),
+                                     DOTS_ARG_IDX) != callArgs.end();
+
+        // Call sites with two or three closure targets are compiled to a
+        // switch over the observed targets
+        std::vector<SEXP> polymorphic;
+        // Calls per invocation of this function, if we have feedback
+        double frequency = -1;
 
         // See if the call feedback suggests a monomorphic target
         // TODO: Deopts in promises are not supported by the promise inliner. So
@@ -330,7 +399,7 @@ bool Rir2Pir::compileBC(const BC& bc, Opcode* pos, Opcode* nextPos,
             auto& feedback = callTargetFeedback.at(callee);
             // If this call was never executed. Might as well compile an
             // unconditional deopt
-            if (!inPromise() && srcCode->funInvocationCount > 1 &&
+            if (canDeopt() && srcCode->funInvocationCount > 1 &&
                 feedback.taken == 0) {
                 // To avoid deoptimization loops, we must ensure that on
                 // deoptimization we actually record the new call target.
@@ -347,6 +416,26 @@ bool Rir2Pir::compileBC(const BC& bc, Opcode* pos, Opcode* nextPos,
 
             if (feedback.taken > 1 && feedback.numTargets == 1)
                 monomorphic = feedback.getTarget(srcCode, 0);
+
+            auto invocations = srcFunction->body()->funInvocationCount;
+            frequency = (double)feedback.taken / std::max(invocations, 1u);
+
+            if (canDeopt() && feedback.taken > 1 && feedback.numTargets > 1 &&
+                bc.bc == Opcode::call_implicit_ && !hasDotsArgs) {
+                size_t nargs = callArgs.size();
+                for (size_t i = 0; i < feedback.numTargets; ++i) {
+                    auto target = feedback.getTarget(srcCode, i);
+                    if (!isValidClosureSEXP(target) ||
+                        DispatchTable::unpack(BODY(target))
+                            ->baseline()
+                            ->unoptimizable ||
+                        RList(FORMALS(target)).length() < nargs) {
+                        polymorphic.clear();
+                        break;
+                    }
+                    polymorphic.push_back(target);
+                }
+            }
         }
 
         bool monomorphicClosure =
@@ -371,7 +460,7 @@ bool Rir2Pir::compileBC(const BC& bc, Opcode* pos, Opcode* nextPos,
         }
 
         auto ldfun = LdFun::Cast(callee);
-        if (inPromise()) {
+        if (!canDeopt()) {
             if (ldfun) {
                 ldfun->hint =
                     monomorphic ? monomorphic : symbol::ambiguousCallTarget;
@@ -379,10 +468,62 @@ bool Rir2Pir::compileBC(const BC& bc, Opcode* pos, Opcode* nextPos,
             monomorphicBuiltin = monomorphicClosure = false;
             monomorphic = nullptr;
         }
+        if (hasDotsArgs)
+            monomorphicBuiltin = monomorphicClosure = false;
+
+        // If the targets array is full, there might have been more targets,
+        // which are handled by a generic call. Otherwise we deopt on a new one.
+        bool polymorphicComplete =
+            polymorphic.size() < ObservedCallees::MaxTargets;
+        Value* polymorphicCallee = callee;
+        Checkpoint* polymorphicCp = nullptr;
+        if (!polymorphic.empty() && ldfun && ldfun->varName != symbol::c) {
+            // See below why ldvar. Arguments are bound to promises though,
+            // which ldvar does not force. For them we compare the result of
+            // the ldfun.
+            auto& formals = insert.function->owner()->formals().names();
+            bool mayBeArg = ldfun->env() != insert.env ||
+                            std::find(formals.begin(), formals.end(),
+                                      ldfun->varName) != formals.end();
+            if (!mayBeArg)
+                polymorphicCallee =
+                    insert(new LdVar(ldfun->varName, ldfun->env()));
+        }
+        if (!polymorphic.empty() && polymorphicComplete)
+            polymorphicCp = addCheckpoint(srcCode, pos, stack, insert);
+
+        // If the target is bound in a locked namespace binding, we depend on
+        // the binding instead of guarding it. The compiled version is
+        // discarded when the binding is changed. Frames which are already
+        // running check the binding before calling the target, and look
+        // it up again in the deopt branch.
+        bool constantTarget = false;
+        ClosureVersion::BindingDependency dep;
+        Env* closureEnv = nullptr;
+        if ((monomorphicBuiltin || monomorphicClosure) && ldfun &&
+            ldfun->env() == insert.env) {
+            closureEnv = insert.function->owner()->closureEnv();
+            auto& formals = insert.function->owner()->formals().names();
+            constantTarget =
+                closureEnv != Env::notClosed() && closureEnv->rho &&
+                std::find(formals.begin(), formals.end(), ldfun->varName) ==
+                    formals.end() &&
+                !mayBindLocally(srcFunction->body(), ldfun->varName) &&
+                insert.function->dependOnBinding(
+                    closureEnv->rho, ldfun->varName, monomorphic, dep);
+        }
+        if (constantTarget) {
+            auto cp = addCheckpoint(srcCode, pos, stack, insert);
+            insert(new Assume(insert(new DependenciesValid(closureEnv, dep.env,
+                                                           dep.sym, dep.value)),
+                              cp));
+            pop();
+            push(insert(new LdConst(monomorphic)));
+        }
 
         Assume* assumption = nullptr;
         // Insert a guard if we want to speculate
-        if (monomorphicBuiltin || monomorphicClosure) {
+        if (!constantTarget && (monomorphicBuiltin || monomorphicClosure)) {
             Value* expected = insert(new LdConst(monomorphic));
             Value* given = callee;
             // We use ldvar instead of ldfun for the guard. The reason is that
@@ -392,9 +533,8 @@ bool Rir2Pir::compileBC(const BC& bc, Opcode* pos, Opcode* nextPos,
             // If we find a non-function binding with the same name, we will
             // deopt unneccessarily. In the case of `c` this is guaranteed to
             // cause problems, since many variables are called "c". Therefore we
-            // keep the ldfun in this case.
-            // TODO: Implement this with a dependency on the binding cell
-            // instead of an eager check.
+            // keep the ldfun in this case. Locked bindings do not need this
+            // check, see constantTarget above.
             if (ldfun && ldfun->varName != symbol::c)
                 given = insert(new LdVar(ldfun->varName, ldfun->env()));
             Value* t = insert(new Identical(given, expected));
@@ -410,8 +550,10 @@ bool Rir2Pir::compileBC(const BC& bc, Opcode* pos, Opcode* nextPos,
         given.add(Assumption::NoExplicitlyMissingArgs);
         {
             size_t i = 0;
-            for (auto argi : bc.callExtra().immediateCallArguments) {
-                if (argi == MISSING_ARG_IDX) {
+            for (auto argi : callArgs) {
+                if (argi == DOTS_ARG_IDX) {
+                    args.push_back(insert(new LdVar(R_DotsSymbol, env)));
+                } else if (argi == MISSING_ARG_IDX) {
                     args.push_back(MissingArg::instance());
                     given.remove(Assumption::NoExplicitlyMissingArgs);
                 } else {
@@ -442,9 +584,9 @@ bool Rir2Pir::compileBC(const BC& bc, Opcode* pos, Opcode* nextPos,
 
             if (!correctOrder || needed < args.size()) {
                 monomorphicClosure = false;
-                assert(assumption);
                 // Kill unnecessary speculation
-                assumption->arg<0>().val() = True::instance();
+                if (assumption)
+                    assumption->arg<0>().val() = True::instance();
             }
 
             missingArgs = needed - args.size();
@@ -453,21 +595,98 @@ bool Rir2Pir::compileBC(const BC& bc, Opcode* pos, Opcode* nextPos,
         // Emit the actual call
         auto ast = bc.immediate.callFixedArgs.ast;
         auto insertGenericCall = [&]() {
-            if (bc.bc == Opcode::named_call_implicit_) {
+            if (hasDotsArgs) {
+                std::vector<BC::PoolIdx> names;
+                for (size_t i = 0; i < callArgs.size(); ++i) {
+                    if (callArgs[i] == DOTS_ARG_IDX)
+                        names.push_back(Pool::insert(R_DotsSymbol));
+                    else if (bc.bc == Opcode::named_call_implicit_)
+                        names.push_back(bc.callExtra().callArgumentNames[i]);
+                    else
+                        names.push_back(Pool::insert(R_NilValue));
+                }
+                push(insert(
+                    new NamedCall(insert.env, pop(), args, names, ast)));
+            } else if (bc.bc == Opcode::named_call_implicit_) {
                 push(insert(new NamedCall(insert.env, pop(), args,
                                           bc.callExtra().callArgumentNames,
                                           ast)));
             } else {
                 auto callee = pop();
                 Value* fs = nullptr;
-                if (inPromise())
+                if (!canDeopt())
                     fs = Tombstone::framestate();
                 else
                     fs = insert.registerFrameState(srcCode, nextPos, stack);
-                push(insert(new Call(insert.env, callee, args, fs, ast)));
+                auto call = insert(new Call(insert.env, callee, args, fs, ast));
+                call->frequency = frequency;
+                push(call);
             }
         };
-        if (monomorphicClosure) {
+        if (!polymorphic.empty()) {
+            std::string name = "";
+            if (ldfun)
+                name = CHAR(PRINTNAME(ldfun->varName));
+
+            // Each arm ends in a static call, which the inliner can pick up
+            BB* join = insert.createBB();
+            auto res = new Phi;
+            auto leaveArm = [&]() {
+                res->addInput(insert.getCurrentBB(), pop());
+                insert.getCurrentBB()->setNext(join);
+            };
+            for (size_t i = 0; i < polymorphic.size(); ++i) {
+                auto target = polymorphic[i];
+                auto expected = insert(new LdConst(target));
+                auto t = insert(new Identical(polymorphicCallee, expected));
+                BB* other = nullptr;
+                if (polymorphicComplete && i == polymorphic.size() - 1) {
+                    insert(new Assume(t, polymorphicCp));
+                } else {
+                    insert(new Branch(t));
+                    BB* arm = insert.createBB();
+                    other = insert.createBB();
+                    insert.setBranch(arm, other);
+                    insert.enterBB(arm);
+                }
+
+                Assumptions givenTarget = given;
+                givenTarget.numMissing(RList(FORMALS(target)).length() -
+                                       args.size());
+                givenTarget.add(Assumption::NotTooFewArguments);
+                givenTarget.add(Assumption::NotTooManyArguments);
+                givenTarget.add(Assumption::CorrectOrderOfArguments);
+                auto calleeOnStack = top();
+                compiler.compileClosure(
+                    target, name, givenTarget,
+                    [&](ClosureVersion* f) {
+                        pop();
+                        auto fs =
+                            insert.registerFrameState(srcCode, nextPos, stack);
+                        auto call = insert(new StaticCall(
+                            insert.env, f->owner(), args, fs, ast));
+                        call->frequency = frequency / polymorphic.size();
+                        push(call);
+                    },
+                    insertGenericCall);
+                leaveArm();
+
+                if (other) {
+                    push(calleeOnStack);
+                    insert.enterBB(other);
+                }
+            }
+            if (!polymorphicComplete) {
+                insertGenericCall();
+                leaveArm();
+            }
+
+            insert.enterBB(join);
+            insert(res);
+            res->updateType();
+            push(res);
+            addCheckpoint(srcCode, nextPos, stack, insert);
+        } else if (monomorphicClosure) {
             std::string name = "";
             if (ldfun)
                 name = CHAR(PRINTNAME(ldfun->varName));
@@ -481,8 +700,10 @@ bool Rir2Pir::compileBC(const BC& bc, Opcode* pos, Opcode* nextPos,
                     pop();
                     auto fs =
                         insert.registerFrameState(srcCode, nextPos, stack);
-                    push(insert(
-                        new StaticCall(insert.env, f->owner(), args, fs, ast)));
+                    auto call = insert(
+                        new StaticCall(insert.env, f->owner(), args, fs, ast));
+                    call->frequency = frequency;
+                    push(call);
                 },
                 insertGenericCall);
         } else if (monomorphicBuiltin) {
@@ -524,7 +745,7 @@ bool Rir2Pir::compileBC(const BC& bc, Opcode* pos, Opcode* nextPos,
                                       bc.immediate.callFixedArgs.ast)));
         } else {
             Value* fs = nullptr;
-            if (inPromise())
+            if (!canDeopt())
                 fs = Tombstone::framestate();
             else
                 fs = insert.registerFrameState(srcCode, nextPos, stack);
@@ -562,7 +783,7 @@ bool Rir2Pir::compileBC(const BC& bc, Opcode* pos, Opcode* nextPos,
         break;
 
     case Opcode::extract1_1_: {
-        if (!inPromise()) {
+        if (canDeopt()) {
             forceIfPromised(1); // <- ensure forced captured in framestate
             forceIfPromised(0);
             addCheckpoint(srcCode, pos, stack, insert);
@@ -574,7 +795,7 @@ bool Rir2Pir::compileBC(const BC& bc, Opcode* pos, Opcode* nextPos,
     }
 
     case Opcode::extract2_1_: {
-        if (!inPromise()) {
+        if (canDeopt()) {
             forceIfPromised(
                 1); // <- ensure forced version are captured in framestate
             forceIfPromised(0);
@@ -673,7 +894,7 @@ bool Rir2Pir::compileBC(const BC& bc, Opcode* pos, Opcode* nextPos,
 
 #define BINOP(Name, Op)                                                        \
     case Opcode::Op: {                                                         \
-        if (!inPromise()) {                                                    \
+        if (canDeopt()) {                                                      \
             forceIfPromised(1);                                                \
             forceIfPromised(0);                                                \
             addCheckpoint(srcCode, pos, stack, insert);                        \
@@ -826,16 +1047,34 @@ bool Rir2Pir::compileBC(const BC& bc, Opcode* pos, Opcode* nextPos,
     case Opcode::static_call_:
     case Opcode::pop_context_:
     case Opcode::push_context_:
+    case Opcode::pop_loop_context_:
+    case Opcode::push_loop_context_:
     case Opcode::ldvar_noforce_stubbed_:
     case Opcode::stvar_stubbed_:
     case Opcode::assert_type_:
+    case Opcode::check_dependencies_:
+    case Opcode::box_:
+    case Opcode::unbox_:
+    case Opcode::add_unboxed_:
+    case Opcode::sub_unboxed_:
+    case Opcode::mul_unboxed_:
+    case Opcode::div_unboxed_:
+    case Opcode::lt_unboxed_:
+    case Opcode::gt_unboxed_:
+    case Opcode::le_unboxed_:
+    case Opcode::ge_unboxed_:
+    case Opcode::eq_unboxed_:
+    case Opcode::ne_unboxed_:
+    case Opcode::inc_unboxed_:
+    case Opcode::dec_unboxed_:
+    case Opcode::fused_:
+    case Opcode::stack_promise_:
         log.unsupportedBC("Unsupported BC (are you recompiling?)", bc);
         assert(false && "Recompiling PIR not supported for now.");
 
     // Unsupported opcodes:
     case Opcode::asast_:
     case Opcode::beginloop_:
-    case Opcode::endloop_:
     case Opcode::ldddvar_:
         log.unsupportedBC("Unsupported BC", bc);
         return false;
@@ -889,12 +1128,22 @@ Value* Rir2Pir::tryTranslate(rir::Code* srcCode, Builder& insert) const {
     auto pushWorklist = [&](BB* bb, Opcode* pos) {
         worklist.push_back(State(cur, false, bb, pos));
     };
+    auto popLoopContexts = [&](Opcode* pc) {
+        while (!cur.loopContexts.empty() &&
+               (!pc || !cur.loopContexts.back().contains(pc))) {
+            insert(new PopLoopContext(cur.loopContexts.back().push));
+            cur.loopContexts.pop_back();
+        }
+    };
 
     while (finger != end || !worklist.empty()) {
         if (finger == end)
             finger = popWorklist();
         assert(finger != end);
 
+        // Jumping out of a loop leaves its context
+        popLoopContexts(finger);
+
         if (mergepoints.count(finger)) {
             State& other = mergepoints.at(finger);
             if (other.seen) {
@@ -908,6 +1157,7 @@ Value* Rir2Pir::tryTranslate(rir::Code* srcCode, Builder& insert) const {
             cur.createMergepoint(insert);
             other = State(cur, true, insert.getCurrentBB(), finger);
         }
+
         const auto pos = finger;
         BC bc = BC::advance(&finger, srcCode);
         const auto nextPos = finger;
@@ -933,9 +1183,38 @@ Value* Rir2Pir::tryTranslate(rir::Code* srcCode, Builder& insert) const {
                 insert(new Branch(v));
                 break;
             }
-            case Opcode::beginloop_:
-                log.warn("Cannot compile Function. Unsupported beginloop bc");
-                return nullptr;
+            case Opcode::beginloop_: {
+                // One context for all iterations. The push returns a second
+                // time after a non-local break or next, with the symbol
+                // telling us where to continue. The handler still runs in the
+                // context, the jump to the exit leaves it.
+                auto push = insert(new PushLoopContext(insert.env));
+                cur.loopContexts.push_back({push, nextPos, trg});
+                auto entered = insert(new Identical(push, Nil::instance()));
+                insert(new Branch(entered));
+
+                BB* body = insert.createBB();
+                BB* handler = insert.createBB();
+                insert.setBranch(body, handler);
+
+                insert.enterBB(handler);
+                auto isNext = insert(
+                    new Identical(push, insert(new LdConst(symbol::Next))));
+                insert(new Branch(isNext));
+                BB* next = insert.createBB();
+                BB* brk = insert.createBB();
+                insert.setBranch(next, brk);
+                // Both targets are mergepoints, split the edges
+                for (auto bb : {next, brk}) {
+                    BB* split = insert.createBB();
+                    bb->setNext(split);
+                }
+                pushWorklist(next->next(), nextPos);
+                pushWorklist(brk->next(), trg);
+
+                insert.enterBB(body);
+                continue;
+            }
             default:
                 assert(false);
             }
@@ -994,6 +1273,7 @@ Value* Rir2Pir::tryTranslate(rir::Code* srcCode, Builder& insert) const {
                 assert(false);
             }
             assert(cur.stack.empty());
+            popLoopContexts(nullptr);
             results.push_back(ReturnSite(insert.getCurrentBB(), tos));
             // Setting the position to end, will either terminate the loop, or
             // pop from the worklist
@@ -1069,13 +1349,14 @@ Value* Rir2Pir::tryTranslate(rir::Code* srcCode, Builder& insert) const {
 
         if (!skip) {
             int size = cur.stack.size();
+            inLoopContext_ = !cur.loopContexts.empty();
             if (!compileBC(bc, pos, nextPos, srcCode, cur.stack, insert,
                            callTargetFeedback)) {
                 log.failed("Abort r2p due to unsupported bc");
                 return nullptr;
             }
 
-            if (!inPromise() && !insert.getCurrentBB()->isEmpty()) {
+            if (canDeopt() && !insert.getCurrentBB()->isEmpty()) {
                 auto last = insert.getCurrentBB()->last();
 
                 if (Deopt::Cast(last)) {
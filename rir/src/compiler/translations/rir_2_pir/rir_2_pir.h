@@ -54,12 +54,16 @@ class Rir2Pir {
                    rir::Code* srcCode, RirStack&, Builder&,
                    CallTargetFeedback&) const;
     virtual bool inPromise() const { return inPromise_; }
+    // Deoptimization would resume the baseline code without the loop contexts
+    // pushed by the optimized code, so no deopt points inside of them.
+    bool canDeopt() const { return !inPromise() && !inLoopContext_; }
 
     Checkpoint* addCheckpoint(rir::Code* srcCode, Opcode* pos,
                               const RirStack& stack, Builder& insert) const;
 
   private:
     bool inPromise_ = false;
+    mutable bool inLoopContext_ = false;
 };
 
 class PromiseRir2Pir : public Rir2Pir {
@@ -5,6 +5,7 @@
 
 #include "compiler/parameter.h"
 
+#include "../../analysis/analysis_manager.h"
 #include "../../analysis/query.h"
 #include "../../analysis/verifier.h"
 #include "../../opt/pass_definitions.h"
@@ -14,8 +15,11 @@
 #include "../../debugging/PerfCounter.h"
 
 #include "compiler/opt/pass_scheduler.h"
+#include "compiler/util/thread_pool.h"
 
 #include <chrono>
+#include <map>
+#include <unordered_map>
 
 namespace rir {
 namespace pir {
@@ -93,8 +97,11 @@ void Rir2PirCompiler::compileClosure(Closure* closure,
         fail_();
     };
 
-    if (closure->formals().hasDots()) {
-        logger.warn("no support for ...");
+    // The arguments for a trailing ... are packed by the caller (see
+    // packDotsArgs in the interpreter), anywhere else we would need the full
+    // GNU R argument matching.
+    if (closure->formals().hasDots() && !closure->formals().hasTrailingDots()) {
+        logger.warn("no support for ... before other formals");
         return fail();
     }
 
@@ -181,35 +188,156 @@ std::unique_ptr<CompilerPerf> PERF = std::unique_ptr<CompilerPerf>(
 void Rir2PirCompiler::optimizeModule() {
     logger.flush();
     size_t passnr = 0;
-    for (const auto& translation : PassScheduler::instance()) {
-        module->eachPirClosure([&](Closure* c) {
-            c->eachVersion([&](ClosureVersion* v) {
-                auto& log = logger.get(v);
-                log.pirOptimizationsHeader(v, translation.get(), passnr++);
-
-                if (MEASURE_COMPILER_PERF)
-                    startTime = std::chrono::high_resolution_clock::now();
-
-                translation->apply(*this, v, log);
-                if (MEASURE_COMPILER_PERF) {
-                    endTime = std::chrono::high_resolution_clock::now();
-                    std::chrono::duration<double> passDuration =
-                        endTime - startTime;
-                    PERF->addTime(translation->getName(), passDuration.count());
-                }
 
-                log.pirOptimizations(v, translation.get());
+    // Every change to a version bumps its generation (and the generation of
+    // the module). A pass which ran on a version without changing it does not
+    // need to run again, until the generation it depends on changes.
+    std::unordered_map<ClosureVersion*, size_t> generation;
+    size_t moduleGeneration = 0;
+    std::map<std::pair<std::string, ClosureVersion*>, size_t> unchangedAt;
+
+    // Versions might have been changed outside of the pass pipeline (eg. by
+    // the rir2pir translation) since they were last optimized.
+    auto invalidateAnalyses = [&]() {
+        module->eachPirClosureVersion(
+            [&](ClosureVersion* v) { v->analyses().invalidate(); });
+    };
+    invalidateAnalyses();
+
+    auto isUnchanged = [&](const PirTranslator* translation,
+                           ClosureVersion* v) {
+        if (translation->isPhaseMarker())
+            return false;
+        auto key = std::make_pair(translation->getName(), v);
+        auto current = translation->isInterprocedural() ? moduleGeneration
+                                                        : generation[v];
+        auto last = unchangedAt.find(key);
+        if (last != unchangedAt.end() && last->second == current) {
+            if (MEASURE_COMPILER_PERF)
+                PERF->addSkip(translation->getName());
+            return true;
+        }
+        return false;
+    };
+
+    // Runs the pass and nothing else, thus this might be called from a worker
+    // thread for parallelizable passes
+    auto runPass = [&](const PirTranslator* translation, ClosureVersion* v,
+                       LogStream& log, double& duration) {
+        std::chrono::time_point<std::chrono::high_resolution_clock> start;
+        if (MEASURE_COMPILER_PERF)
+            start = std::chrono::high_resolution_clock::now();
+
+        bool changed = translation->apply(*this, v, log);
+
+        if (MEASURE_COMPILER_PERF) {
+            std::chrono::duration<double> passDuration =
+                std::chrono::high_resolution_clock::now() - start;
+            duration = passDuration.count();
+        }
+        return changed;
+    };
+
+    auto finishPass = [&](const PirTranslator* translation, ClosureVersion* v,
+                          bool changed, double duration) {
+        if (MEASURE_COMPILER_PERF)
+            PERF->addTime(translation->getName(), duration);
+
+        logger.get(v).pirOptimizations(v, translation);
 
 #ifdef FULLVERIFIER
-                Verify::apply(v, true);
+        Verify::apply(v, true);
 #else
 #ifdef ENABLE_SLOWASSERT
-                Verify::apply(v);
+        Verify::apply(v);
 #endif
 #endif
-            });
+
+        if (changed) {
+            if (!translation->preservesCFG())
+                v->analyses().invalidate();
+            generation[v]++;
+            moduleGeneration++;
+        } else {
+            unchangedAt[std::make_pair(translation->getName(), v)] =
+                translation->isInterprocedural() ? moduleGeneration
+                                                 : generation[v];
+        }
+        return changed;
+    };
+
+    auto applyPass = [&](const PirTranslator* translation, ClosureVersion* v) {
+        if (isUnchanged(translation, v))
+            return false;
+        auto& log = logger.get(v);
+        log.pirOptimizationsHeader(v, translation, passnr++);
+        double duration = 0;
+        bool changed = runPass(translation, v, log, duration);
+        return finishPass(translation, v, changed, duration);
+    };
+
+    // Runs a parallelizable pass on all versions, which changed since it last
+    // ran, at the same time. Everything except for the pass itself (logging
+    // headers, verification, bookkeeping) happens on this thread.
+    auto applyPassInParallel = [&](const PirTranslator* translation,
+                                   const std::vector<ClosureVersion*>& all) {
+        std::vector<ClosureVersion*> versions;
+        std::vector<LogStream*> logs;
+        for (auto v : all) {
+            if (isUnchanged(translation, v))
+                continue;
+            auto& log = logger.get(v);
+            log.pirOptimizationsHeader(v, translation, passnr++);
+            versions.push_back(v);
+            logs.push_back(&log);
+        }
+
+        // not a vector<bool>, since every task writes its own entry
+        std::vector<char> changed(versions.size(), false);
+        std::vector<double> durations(versions.size(), 0);
+        ThreadPool::instance().parallelFor(versions.size(), [&](size_t i) {
+            changed[i] =
+                runPass(translation, versions[i], *logs[i], durations[i]);
         });
+
+        bool anyChange = false;
+        for (size_t i = 0; i < versions.size(); ++i)
+            if (finishPass(translation, versions[i], changed[i], durations[i]))
+                anyChange = true;
+        return anyChange;
+    };
+
+    bool parallel = ThreadPool::instance().size() > 1 && logger.isThreadSafe();
+
+    for (const auto& phase : PassScheduler::instance()) {
+        for (unsigned round = 0; round < phase.budget; ++round) {
+            if (MEASURE_COMPILER_PERF)
+                PERF->addPhaseRound();
+            bool changed = false;
+            for (const auto& translation : phase.passes) {
+                // Versions might be added while we iterate, eg. by EagerCalls
+                std::vector<ClosureVersion*> versions;
+                module->eachPirClosureVersion(
+                    [&](ClosureVersion* v) { versions.push_back(v); });
+                if (parallel && translation->isParallelizable()) {
+                    if (applyPassInParallel(translation.get(), versions))
+                        changed = true;
+                    continue;
+                }
+                for (auto v : versions)
+                    if (applyPass(translation.get(), v))
+                        changed = true;
+            }
+            if (!changed)
+                break;
+        }
+        module->eachPirClosureVersion(
+            [&](ClosureVersion* v) { applyPass(phase.marker.get(), v); });
     }
+
+    // Free the cached analyses, they are not needed after optimization
+    invalidateAnalyses();
+
     if (MEASURE_COMPILER_PERF)
         startTime = std::chrono::high_resolution_clock::now();
 
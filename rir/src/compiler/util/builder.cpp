@@ -91,9 +91,13 @@ Builder::Builder(ClosureVersion* version, Value* closureEnv)
     auto& assumptions = version->assumptions();
     std::vector<Value*> args(closure->nargs());
     size_t nargs = closure->nargs() - assumptions.numMissing();
+    auto& names = closure->formals().names();
     for (long i = nargs - 1; i >= 0; --i) {
         args[i] = this->operator()(new LdArg(i));
-        readArgTypeFromAssumptions(assumptions, args[i]->type, i);
+        // The caller packs the arguments for ... into a DOTSXP, the
+        // assumptions are about the first of them
+        if (names[i] != R_DotsSymbol)
+            readArgTypeFromAssumptions(assumptions, args[i]->type, i);
     }
     for (size_t i = nargs; i < closure->nargs(); ++i)
         args[i] = MissingArg::instance();
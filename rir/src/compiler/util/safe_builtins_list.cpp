@@ -329,5 +329,30 @@ bool SafeBuiltinsList::forInlineByName(SEXP name) {
     return true;
 }
 
+#define REFLECTIVE_ASSIGN_BUILTINS(V)                                          \
+    V(assign)                                                                  \
+    V(delayedAssign)                                                           \
+    V(makeActiveBinding)                                                       \
+    V(eval)                                                                    \
+    V(evalq)                                                                   \
+    V(local)                                                                   \
+    V(list2env)                                                                \
+    V(environment)                                                             \
+    V(sys.function)                                                            \
+    V(sys.frame)
+
+bool SafeBuiltinsList::forLocalBindings(SEXP name) {
+    static SEXP reflectiveBuiltins[] = {
+#define V(name) Rf_install(#name),
+        REFLECTIVE_ASSIGN_BUILTINS(V)
+#undef V
+    };
+
+    for (auto i : reflectiveBuiltins)
+        if (i == name)
+            return false;
+    return true;
+}
+
 } // namespace pir
 } // namespace rir
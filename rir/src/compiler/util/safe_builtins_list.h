@@ -14,6 +14,8 @@ class SafeBuiltinsList {
     static bool nonObject(int builtin);
     static bool forInline(int builtin);
     static bool forInlineByName(SEXP name);
+    // Calling this function cannot create bindings in the caller's env
+    static bool forLocalBindings(SEXP name);
 };
 
 } // namespace pir
@@ -0,0 +1,76 @@
+#include "thread_pool.h"
+#include "../parameter.h"
+
+#include <cassert>
+#include <cstdlib>
+
+namespace rir {
+namespace pir {
+
+unsigned Parameter::PIR_OPT_THREADS =
+    getenv("PIR_OPT_THREADS") ? atoi(getenv("PIR_OPT_THREADS")) : 1;
+
+ThreadPool& ThreadPool::instance() {
+    static ThreadPool pool(Parameter::PIR_OPT_THREADS);
+    return pool;
+}
+
+ThreadPool::ThreadPool(size_t threads) {
+    for (size_t i = 1; i < threads; ++i)
+        workers.emplace_back([this]() { work(); });
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (auto& w : workers)
+        w.join();
+}
+
+void ThreadPool::parallelFor(size_t n, const Task& t) {
+    if (workers.empty() || n < 2) {
+        for (size_t i = 0; i < n; ++i)
+            t(i);
+        return;
+    }
+
+    std::unique_lock<std::mutex> guard(lock);
+    assert(!task && "parallelFor is not reentrant");
+    task = &t;
+    next = 0;
+    total = n;
+    finished = 0;
+    wake.notify_all();
+
+    runTasks(guard);
+    done.wait(guard, [&]() { return finished == total; });
+    task = nullptr;
+}
+
+void ThreadPool::runTasks(std::unique_lock<std::mutex>& guard) {
+    while (task && next < total) {
+        auto t = task;
+        auto i = next++;
+        guard.unlock();
+        (*t)(i);
+        guard.lock();
+        if (++finished == total)
+            done.notify_all();
+    }
+}
+
+void ThreadPool::work() {
+    std::unique_lock<std::mutex> guard(lock);
+    while (true) {
+        wake.wait(guard, [&]() { return stopping || (task && next < total); });
+        if (stopping)
+            return;
+        runTasks(guard);
+    }
+}
+
+} // namespace pir
+} // namespace rir
@@ -0,0 +1,63 @@
+#ifndef PIR_THREAD_POOL_H
+#define PIR_THREAD_POOL_H
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace rir {
+namespace pir {
+
+/*
+ * A fixed set of worker threads to run independent compiler tasks
+ * concurrently. The number of threads (including the calling thread) is
+ * configured with PIR_OPT_THREADS and defaults to 1, ie. everything runs on
+ * the calling thread.
+ *
+ * Tasks run while the R thread waits for them, so they must neither allocate
+ * on the R heap nor touch any other state shared with the rest of the
+ * compiler.
+ */
+class ThreadPool {
+  public:
+    typedef std::function<void(size_t)> Task;
+
+    static ThreadPool& instance();
+
+    // Number of threads working on a parallelFor
+    size_t size() const { return workers.size() + 1; }
+
+    // Calls task(i) for every i < n and returns once all of them are done.
+    // The calling thread takes part in the work.
+    void parallelFor(size_t n, const Task& task);
+
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+  private:
+    explicit ThreadPool(size_t threads);
+
+    void work();
+    void runTasks(std::unique_lock<std::mutex>& guard);
+
+    std::vector<std::thread> workers;
+    std::mutex lock;
+    std::condition_variable wake;
+    std::condition_variable done;
+
+    // The current parallelFor, protected by lock
+    const Task* task = nullptr;
+    size_t next = 0;
+    size_t total = 0;
+    size_t finished = 0;
+    bool stopping = false;
+};
+
+} // namespace pir
+} // namespace rir
+
+#endif
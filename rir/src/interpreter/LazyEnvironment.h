@@ -12,11 +12,16 @@
 
 namespace rir {
 
+struct Code;
+
 #define LAZY_ENVIRONMENT_MAGIC 0xe4210e47
 
 /**
  * EnvironmentStub holds the information needed to create an
- * environment lazily.
+ * environment lazily. Variables are stored in slots, indexed by the position
+ * of their name. Once the environment is materialized, the stub points to it
+ * and the slots hold the binding cells of the variables instead of their
+ * values, such that slot accesses still go to the materialized environment.
  */
 struct LazyEnvironment
     : public RirRuntimeObject<LazyEnvironment, LAZY_ENVIRONMENT_MAGIC> {
@@ -24,24 +29,34 @@ struct LazyEnvironment
     LazyEnvironment(const LazyEnvironment&) = delete;
     LazyEnvironment& operator=(const LazyEnvironment&) = delete;
 
-    LazyEnvironment(SEXP parent, Immediate* names, size_t nargs, void* frameEnd,
-                    InterpreterInstance* ctx)
-        : RirRuntimeObject(sizeof(LazyEnvironment), nargs + 1),
-          frameEnd(frameEnd), nargs(nargs), names(names) {
+    LazyEnvironment(SEXP parent, Immediate* names, size_t nargs,
+                    InterpreterInstance* ctx, Code* code, Opcode* pc)
+        : RirRuntimeObject(sizeof(LazyEnvironment), nargs + 2), nargs(nargs),
+          names(names), code(code), pc(pc) {
         setEntry(0, parent);
+        setEntry(1, R_NilValue);
         for (long i = nargs - 1; i >= 0; --i) {
             setArg(i, ostack_pop(ctx));
         }
     }
 
-    void* frameEnd;
     size_t nargs;
     Immediate* names;
+    // The instruction creating the stub, materializing it is attributed to it
+    // by the allocation profiler. Like names, it points into the code.
+    Code* code;
+    Opcode* pc;
 
-    SEXP getArg(size_t i) { return getEntry(i + 1); }
-    void setArg(size_t i, SEXP val) { setEntry(i + 1, val); }
+    SEXP getArg(size_t i) { return getEntry(i + 2); }
+    void setArg(size_t i, SEXP val) { setEntry(i + 2, val); }
 
     SEXP getParent() { return getEntry(0); }
+
+    SEXP materialized() {
+        SEXP env = getEntry(1);
+        return env == R_NilValue ? nullptr : env;
+    }
+    void materialized(SEXP env) { setEntry(1, env); }
 };
 } // namespace rir
 
@@ -0,0 +1,226 @@
+#include "alloc_profiler.h"
+#include "R/Printing.h"
+#include "interp_incl.h"
+#include "ir/BC.h"
+#include "runtime/Code.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <vector>
+
+namespace rir {
+
+size_t AllocationProfiler::allocatedSize(SEXP s) {
+    size_t elt = 0;
+    switch (TYPEOF(s)) {
+    case LGLSXP:
+    case INTSXP:
+        elt = sizeof(int);
+        break;
+    case REALSXP:
+        elt = sizeof(double);
+        break;
+    case CPLXSXP:
+        elt = sizeof(Rcomplex);
+        break;
+    case STRSXP:
+    case VECSXP:
+    case EXPRSXP:
+        elt = sizeof(SEXP);
+        break;
+    case RAWSXP:
+    case CHARSXP:
+    case EXTERNALSXP:
+        elt = 1;
+        break;
+    default:
+        // Everything else is a fixed size node
+        return sizeof(SEXPREC);
+    }
+    if (ALTREP(s))
+        return sizeof(SEXPREC);
+
+    // Like allocVector: the data is allocated in units of VECREC (the size of
+    // a double), small vectors are rounded up to the next node class
+    size_t bytes = elt * XLENGTH(s);
+    // Strings are zero terminated
+    if (TYPEOF(s) == CHARSXP)
+        bytes++;
+    size_t units = (bytes + sizeof(double) - 1) / sizeof(double);
+    static const size_t smallNodeClasses[] = {1, 2, 4, 8, 16};
+    for (auto size : smallNodeClasses) {
+        if (units <= size) {
+            units = size;
+            break;
+        }
+    }
+    return sizeof(SEXPREC_ALIGN) + units * sizeof(double);
+}
+
+void AllocationProfiler::record(const Code* c, Opcode* pc, SEXP allocated) {
+    // Deparsing the source of a new site allocates
+    PROTECT(allocated);
+    add(c, pc, 1, allocatedSize(allocated));
+    UNPROTECT(1);
+}
+
+void AllocationProfiler::recordNodes(const Code* c, Opcode* pc,
+                                     size_t nodes) {
+    add(c, pc, nodes, nodes * sizeof(SEXPREC));
+}
+
+// Finds the srcref of the innermost statement of a brace containing ast
+static bool findSrcref(SEXP expr, SEXP ast, SEXP& srcref) {
+    if (expr == ast)
+        return true;
+    if (TYPEOF(expr) != LANGSXP)
+        return false;
+    SEXP refs = CAR(expr) == R_BraceSymbol
+                    ? Rf_getAttrib(expr, R_SrcrefSymbol)
+                    : R_NilValue;
+    R_xlen_t i = 0;
+    for (SEXP e = expr; e != R_NilValue; e = CDR(e), ++i) {
+        if (findSrcref(CAR(e), ast, srcref)) {
+            if (srcref == R_NilValue && TYPEOF(refs) == VECSXP &&
+                i < XLENGTH(refs))
+                srcref = VECTOR_ELT(refs, i);
+            return true;
+        }
+    }
+    return false;
+}
+
+// Returns "file:line" of ast inside the source of a code object, if the
+// source was kept
+static std::string sourceLocation(SEXP code, SEXP ast) {
+    SEXP srcref = R_NilValue;
+    if (!findSrcref(code, ast, srcref) || TYPEOF(srcref) != INTSXP)
+        return "";
+    std::string file = "?";
+    SEXP srcfile = Rf_getAttrib(srcref, R_SrcfileSymbol);
+    if (TYPEOF(srcfile) == ENVSXP) {
+        SEXP name = Rf_findVarInFrame(srcfile, Rf_install("filename"));
+        if (TYPEOF(name) == STRSXP && XLENGTH(name) > 0)
+            file = CHAR(STRING_ELT(name, 0));
+    }
+    return file + ":" + std::to_string(INTEGER(srcref)[0]);
+}
+
+void AllocationProfiler::add(const Code* c, Opcode* pc, size_t count,
+                             size_t bytes) {
+    SEXP code = c ? c->container() : nullptr;
+    unsigned srcIdx = 0;
+    Opcode opcode = Opcode::invalid_;
+    if (c) {
+        if (preserved.insert(code).second)
+            keepAlive(code);
+        srcIdx = c->src;
+    }
+    if (c && pc) {
+        PcKey pcKey(code, pc - c->code());
+        auto i = instructions.find(pcKey);
+        if (i == instructions.end()) {
+            // Find the start of the instruction containing pc
+            Opcode* start = c->code();
+            while (start < c->endCode() && BC::next(start) < pc)
+                start = BC::next(start);
+            unsigned idx = c->getSrcIdxAt(start, true);
+            i = instructions
+                    .emplace(pcKey, std::make_pair(idx ? idx : c->src, *start))
+                    .first;
+        }
+        srcIdx = i->second.first;
+        opcode = i->second.second;
+    }
+
+    SiteKey key(code, srcIdx, opcode);
+    auto s = sites.find(key);
+    if (s == sites.end()) {
+        Site site;
+        if (c) {
+            SEXP ast = src_pool_at(globalContext(), srcIdx);
+            site.source = dumpSexp(ast, 80);
+            site.location =
+                sourceLocation(src_pool_at(globalContext(), c->src), ast);
+        } else {
+            site.source = "<no code>";
+        }
+        s = sites.emplace(key, site).first;
+    }
+    s->second.total.count += count;
+    s->second.total.bytes += bytes;
+}
+
+void AllocationProfiler::keepAlive(SEXP code) {
+    size_t n = preserved.size() - 1;
+    if (!codeObjects || n == (size_t)XLENGTH(codeObjects)) {
+        SEXP grown = Rf_allocVector(VECSXP, codeObjects ? 2 * n : 64);
+        for (size_t i = 0; i < n; ++i)
+            SET_VECTOR_ELT(grown, i, VECTOR_ELT(codeObjects, i));
+        R_PreserveObject(grown);
+        if (codeObjects)
+            R_ReleaseObject(codeObjects);
+        codeObjects = grown;
+    }
+    SET_VECTOR_ELT(codeObjects, n, code);
+}
+
+void AllocationProfiler::reset() {
+    if (codeObjects)
+        R_ReleaseObject(codeObjects);
+    codeObjects = nullptr;
+    preserved.clear();
+    instructions.clear();
+    sites.clear();
+}
+
+void AllocationProfiler::print(std::ostream& out, size_t maxSites) const {
+    std::vector<std::pair<SiteKey, const Site*>> ordered;
+    std::map<Opcode, Counter> byOpcode;
+    Counter total;
+    for (auto& s : sites) {
+        ordered.emplace_back(s.first, &s.second);
+        auto& op = byOpcode[std::get<2>(s.first)];
+        op.count += s.second.total.count;
+        op.bytes += s.second.total.bytes;
+        total.count += s.second.total.count;
+        total.bytes += s.second.total.bytes;
+    }
+    std::sort(ordered.begin(), ordered.end(),
+              [](const std::pair<SiteKey, const Site*>& a,
+                 const std::pair<SiteKey, const Site*>& b) {
+                  return a.second->total.bytes > b.second->total.bytes;
+              });
+
+    out << "=== RIR allocation profile: " << total.count << " allocations, "
+        << total.bytes << " bytes\n";
+    out << "--- by opcode:\n";
+    std::vector<std::pair<Opcode, Counter>> ops(byOpcode.begin(),
+                                                byOpcode.end());
+    std::sort(ops.begin(), ops.end(),
+              [](const std::pair<Opcode, Counter>& a,
+                 const std::pair<Opcode, Counter>& b) {
+                  return a.second.bytes > b.second.bytes;
+              });
+    for (auto& op : ops) {
+        out << std::setw(14) << op.second.bytes << std::setw(12)
+            << op.second.count << "  "
+            << (op.first == Opcode::invalid_ ? "<call>" : BC::name(op.first))
+            << "\n";
+    }
+    out << "--- by site:\n";
+    size_t n = 0;
+    for (auto& s : ordered) {
+        if (n++ == maxSites)
+            break;
+        auto site = s.second;
+        auto opcode = std::get<2>(s.first);
+        out << std::setw(14) << site->total.bytes << std::setw(12)
+            << site->total.count << "  "
+            << (site->location.empty() ? "?" : site->location) << "  "
+            << (opcode == Opcode::invalid_ ? "<call>" : BC::name(opcode))
+            << "  " << site->source << "\n";
+    }
+}
+
+} // namespace rir
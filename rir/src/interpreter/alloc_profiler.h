@@ -0,0 +1,102 @@
+#ifndef RIR_ALLOC_PROFILER_H
+#define RIR_ALLOC_PROFILER_H
+
+#include "R/r.h"
+#include "ir/BC_inc.h"
+
+#include <iostream>
+#include <map>
+#include <set>
+#include <string>
+#include <tuple>
+#include <utility>
+
+namespace rir {
+
+struct Code;
+
+/*
+ * Counts R heap allocations performed by the interpreter, attributed to the
+ * instruction that caused them.
+ *
+ * Only allocations made by the RIR interpreter itself are counted. Whatever
+ * the R runtime allocates (eg. in builtins, in the AST interpreter or when
+ * matching arguments) is not covered, since R has no hook to report it.
+ *
+ * Allocation sites are keyed by the code object, the source index of the
+ * allocating instruction and its opcode. Code objects seen by the profiler are
+ * kept alive in one preserved vector until the next reset, so a new code
+ * object cannot reuse the address of a collected one. The instruction containing a pc is decoded only
+ * the first time the pc allocates. For new sites we deparse the source AST
+ * and look up its line in the srcrefs of the enclosing braces, which are only
+ * available for code parsed with keep.source.
+ *
+ * Enabled by setting RIR_PROFILE_ALLOCATIONS=1. The report is printed to
+ * stderr at exit and can be requested (and reset) from R with
+ * rir.printAllocationProfile().
+ */
+class AllocationProfiler {
+  public:
+    struct Counter {
+        size_t count = 0;
+        size_t bytes = 0;
+    };
+
+    struct Site {
+        std::string source;
+        std::string location;
+        Counter total;
+    };
+
+    static bool enabled() {
+        static bool isEnabled = getenv("RIR_PROFILE_ALLOCATIONS") &&
+                                *getenv("RIR_PROFILE_ALLOCATIONS") == '1';
+        return isEnabled;
+    }
+
+    static AllocationProfiler& instance() {
+        static AllocationProfiler p;
+        return p;
+    }
+
+    // The pc can point anywhere inside the instruction (or just after it),
+    // since the interpreter has usually already consumed the immediates when
+    // it allocates. A null pc attributes the allocation to the code object as
+    // a whole, which is used by helpers that do not know the current pc.
+    void record(const Code* c, Opcode* pc, SEXP allocated);
+    void recordNodes(const Code* c, Opcode* pc, size_t nodes);
+
+    void print(std::ostream& out, size_t maxSites = 50) const;
+    void reset();
+
+    // The number of bytes R allocated for s
+    static size_t allocatedSize(SEXP s);
+
+    ~AllocationProfiler() {
+        if (enabled())
+            print(std::cerr);
+    }
+
+  private:
+    AllocationProfiler() {}
+
+    // Code container, source index and opcode of the allocating instruction
+    typedef std::tuple<SEXP, unsigned, Opcode> SiteKey;
+    std::map<SiteKey, Site> sites;
+
+    // Source index and opcode of the instruction containing a pc
+    typedef std::pair<SEXP, ptrdiff_t> PcKey;
+    std::map<PcKey, std::pair<unsigned, Opcode>> instructions;
+
+    // The code objects in preserved, the vector is preserved and grows as
+    // needed
+    std::set<SEXP> preserved;
+    SEXP codeObjects = nullptr;
+
+    void keepAlive(SEXP code);
+    void add(const Code* c, Opcode* pc, size_t count, size_t bytes);
+};
+
+} // namespace rir
+
+#endif
@@ -67,6 +67,14 @@ struct CallContext {
     const SEXP callee;
     Assumptions givenAssumptions;
     SEXP arglist = nullptr;
+    // Supplied arguments bound to a trailing `...` formal of an optimized
+    // callee, packed into a DOTSXP (see packDotsArgs)
+    SEXP dots = nullptr;
+    size_t dotsIdx = 0;
+    // The args of a named call were reordered to the order of the formals
+    // (see reorderNamedArgs). The names are kept for re-matching, eg. by
+    // UseMethod.
+    bool argsMatched = false;
 
     bool hasStackArgs() const { return stackArgs != nullptr; }
     bool hasEagerCallee() const { return TYPEOF(callee) == BUILTINSXP; }
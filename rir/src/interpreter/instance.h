@@ -159,6 +159,16 @@ RIR_INLINE void rl_append(ResizeableList* l, SEXP val, SEXP parent,
     } while (0)
 #endif
 
+#ifdef TYPED_STACK
+// Copies the whole cell, such that unboxed values stay unboxed
+#define ostack_push_cell(c, cell)                                              \
+    do {                                                                       \
+        R_bcstack_t __tmp__ = *(cell);                                         \
+        *R_BCNodeStackTop = __tmp__;                                           \
+        ++R_BCNodeStackTop;                                                    \
+    } while (0)
+#endif
+
 RIR_INLINE void ostack_ensureSize(InterpreterInstance* c, unsigned minFree) {
     if ((R_BCNodeStackTop + minFree) >= R_BCNodeStackEnd) {
         // TODO....
@@ -201,12 +211,21 @@ class Locals final {
                    "Attempt to store invalid local variable.");
 #ifdef TYPED_STACK
         (base + offset)->u.sxpval = val;
-        SLOWASSERT((base + offset)->tag == 0);
+        // The local might have held an unboxed value before
+        (base + offset)->tag = 0;
 #else
         base[offset] = val;
 #endif
     }
 
+#ifdef TYPED_STACK
+    R_bcstack_t* cell(unsigned offset) {
+        SLOWASSERT(offset < localsCount &&
+                   "Attempt to access invalid local variable.");
+        return base + offset;
+    }
+#endif
+
     Locals(Locals const&) = delete;
     Locals(Locals&&) = delete;
     Locals& operator=(Locals const&) = delete;
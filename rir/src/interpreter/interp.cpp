@@ -4,11 +4,13 @@
 #include "R/Funtab.h"
 #include "R/RList.h"
 #include "R/Symbols.h"
+#include "alloc_profiler.h"
 #include "cache.h"
 #include "compiler/parameter.h"
 #include "compiler/translations/rir_2_pir/rir_2_pir_compiler.h"
 #include "event_counters.h"
 #include "ir/Deoptimization.h"
+#include "ir/FusedKernel.h"
 #include "runtime/TypeFeedback_inl.h"
 #include "safe_force.h"
 #include "utils/Pool.h"
@@ -76,6 +78,18 @@ static RIR_INLINE SEXP getSrcForCall(Code* c, Opcode* pc,
 
 #define readConst(ctx, idx) (cp_pool_at(ctx, idx))
 
+#define RECORD_ALLOCATION(c, pc, sexp)                                         \
+    do {                                                                       \
+        if (AllocationProfiler::enabled())                                     \
+            AllocationProfiler::instance().record(c, pc, sexp);                \
+    } while (false)
+
+#define RECORD_NODE_ALLOCATIONS(c, pc, n)                                      \
+    do {                                                                       \
+        if (AllocationProfiler::enabled())                                     \
+            AllocationProfiler::instance().recordNodes(c, pc, n);              \
+    } while (false)
+
 void initClosureContext(SEXP ast, RCNTXT* cntxt, SEXP rho, SEXP sysparent,
                         SEXP arglist, SEXP op) {
     /*  If we have a generic function we need to use the sysparent of
@@ -151,33 +165,200 @@ static RIR_INLINE void __listAppend(SEXP* front, SEXP* last, SEXP value,
     *last = app;
 }
 
+/*
+ * Evaluated promises passed to static calls they do not escape, see
+ * stack_promise_. Like the fake SEXPs of createFakeSEXP they are invisible to
+ * the GC, thus their values are kept alive in a preserved vector. Slots are
+ * taken at the top and freed after the call, the top shrinks over freed
+ * slots.
+ *
+ * The callee might still be reflected upon, eg. by a condition handler
+ * calling sys.frames. Promises which are captured when its arguments or
+ * environment are materialized are copied to the heap, see
+ * boxCapturedStackPromise. The stack slot stays valid, since the callee
+ * might refer to it. Slots which are not freed after their call are
+ * released when the closure context of the frame ends, by rirCallTrampoline
+ * or, on a longjmp through it, by the cend hook of the context.
+ */
+class StackPromises {
+  public:
+    static constexpr size_t SIZE = 256;
+
+    SEXP alloc(SEXP code, SEXP value) {
+        if (top == SIZE)
+            return nullptr;
+        if (!values) {
+            values = Rf_allocVector(VECSXP, SIZE);
+            R_PreserveObject(values);
+        }
+        size_t i = top++;
+        live[i] = true;
+        SET_VECTOR_ELT(values, i, value);
+        SEXP p = &slots[i];
+        // Like createFakeSEXP, but without stale bits (eg. PRSEEN)
+        memset(p, 0, sizeof(SEXPREC));
+        p->attrib = R_NilValue;
+        p->gengc_next_node = R_NilValue;
+        p->gengc_prev_node = R_NilValue;
+        p->sxpinfo.gcgen = 1;
+        p->sxpinfo.mark = 1;
+        p->sxpinfo.named = 2;
+        p->sxpinfo.type = PROMSXP;
+        p->u.promsxp.value = value;
+        p->u.promsxp.expr = code;
+        p->u.promsxp.env = R_NilValue;
+        return p;
+    }
+
+    bool contains(SEXP p) const {
+        return p >= &slots[0] && p < &slots[SIZE];
+    }
+
+    void free(SEXP p) {
+        size_t i = p - &slots[0];
+        live[i] = false;
+        SET_VECTOR_ELT(values, i, R_NilValue);
+        while (top > 0 && !live[top - 1])
+            top--;
+    }
+
+    size_t mark() const { return top; }
+
+    void release(size_t mark) {
+        for (size_t i = mark; i < top; ++i)
+            if (live[i])
+                free(&slots[i]);
+    }
+
+  private:
+    SEXPREC slots[SIZE];
+    bool live[SIZE] = {};
+    size_t top = 0;
+    SEXP values = nullptr;
+};
+static StackPromises STACK_PROMISES;
+
+static void releaseStackPromises(void* mark) {
+    STACK_PROMISES.release((uintptr_t)mark);
+}
+
+static SEXP boxCapturedStackPromise(SEXP p, const Code* c, Opcode* pc) {
+    if (!STACK_PROMISES.contains(p))
+        return p;
+    SEXP copy = Rf_mkPROMISE(PRCODE(p), R_NilValue);
+    SET_PRVALUE(copy, PRVALUE(p));
+    RECORD_ALLOCATION(c, pc, copy);
+    return copy;
+}
+
+static void boxCapturedStackPromises(const CallContext& call) {
+    if (!call.hasStackArgs())
+        return;
+    for (size_t i = 0; i < call.passedArgs; ++i) {
+        auto cell = const_cast<R_bcstack_t*>(call.stackArgs + i);
+        ostack_at_cell(cell) =
+            boxCapturedStackPromise(ostack_at_cell(cell), call.caller, nullptr);
+    }
+}
+
+// Copies the stack promises passed to a callee which might capture them to
+// the heap
+static void boxStackPromises(const CallContext& call, unsigned nonEscaping) {
+    for (size_t i = 0; i < call.suppliedArgs; ++i) {
+        SEXP p = call.stackArg(i);
+        if (!STACK_PROMISES.contains(p) ||
+            (i < FunctionSignature::MAX_NON_ESCAPING_ARGS &&
+             (nonEscaping & (1u << i))))
+            continue;
+        SEXP copy = Rf_mkPROMISE(PRCODE(p), R_NilValue);
+        SET_PRVALUE(copy, PRVALUE(p));
+        ostack_at_cell(const_cast<R_bcstack_t*>(call.stackArgs + i)) = copy;
+        STACK_PROMISES.free(p);
+        RECORD_ALLOCATION(call.caller, nullptr, copy);
+    }
+}
+
+static void freeStackPromises(const CallContext& call) {
+    for (size_t i = 0; i < call.suppliedArgs; ++i) {
+        SEXP p = call.stackArg(i);
+        if (STACK_PROMISES.contains(p))
+            STACK_PROMISES.free(p);
+    }
+}
+
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wcast-align"
 
 SEXP createEnvironment(InterpreterInstance* ctx, SEXP wrapper_) {
     auto wrapper = LazyEnvironment::unpack(wrapper_);
+    if (auto env = wrapper->materialized())
+        return env;
 
     SEXP arglist = R_NilValue;
     auto names = wrapper->names;
     for (size_t i = 0; i < wrapper->nargs; ++i) {
-        SEXP val = wrapper->getArg(i);
+        SEXP val = PROTECT(boxCapturedStackPromise(
+            wrapper->getArg(i), wrapper->code, wrapper->pc));
         SEXP name = cp_pool_at(ctx, names[i]);
         arglist = CONS_NR(val, arglist);
+        UNPROTECT(1);
         SET_TAG(arglist, name);
         SET_MISSING(arglist, val == R_MissingArg ? 2 : 0);
+        // From now on the slot refers to the binding
+        wrapper->setArg(i, arglist);
     }
 
     SEXP environment =
         Rf_NewEnvironment(R_NilValue, arglist, wrapper->getParent());
-    auto finger = R_BCNodeStackTop;
-    while (finger > wrapper->frameEnd) {
-        if (finger->tag == 0 && finger->u.sxpval == wrapper_)
-            finger->u.sxpval = environment;
-        finger--;
-    }
+    wrapper->materialized(environment);
+    RECORD_ALLOCATION(wrapper->code, wrapper->pc, environment);
+    RECORD_NODE_ALLOCATIONS(wrapper->code, wrapper->pc, wrapper->nargs);
     return environment;
 }
 
+// Slot accesses on a materialized stub go through the binding cells. R
+// unbinds and locks the cells of removed variables, then we fall back to a
+// lookup by name.
+static SEXP lazyEnvGetVar(LazyEnvironment* le, size_t i) {
+    SEXP env = le->materialized();
+    if (!env)
+        return le->getArg(i);
+
+    SEXP cell = le->getArg(i);
+    if (CAR(cell) != R_UnboundValue && !IS_ACTIVE_BINDING(cell))
+        return CAR(cell);
+
+    SEXP sym = Pool::get(le->names[i]);
+    R_varloc_t loc = R_findVarLocInFrame(env, sym);
+    if (R_VARLOC_IS_NULL(loc))
+        return Rf_findVar(sym, ENCLOS(env));
+    le->setArg(i, loc.cell);
+    return Rf_findVarInFrame(env, sym);
+}
+
+static void lazyEnvSetVar(LazyEnvironment* le, size_t i, SEXP val) {
+    SEXP env = le->materialized();
+    if (!env) {
+        le->setArg(i, val);
+        return;
+    }
+
+    SEXP cell = le->getArg(i);
+    if (BINDING_IS_LOCKED(cell) || IS_ACTIVE_BINDING(cell)) {
+        SEXP sym = Pool::get(le->names[i]);
+        rirDefineVarWrapper(sym, val, env);
+        R_varloc_t loc = R_findVarLocInFrame(env, sym);
+        if (!R_VARLOC_IS_NULL(loc))
+            le->setArg(i, loc.cell);
+        return;
+    }
+    if (CAR(cell) == val)
+        return;
+    INCREMENT_NAMED(val);
+    SETCAR(cell, val);
+    SET_MISSING(cell, 0);
+}
+
 static SEXP materializeCallerEnv(CallContext& callCtx,
                                  InterpreterInstance* ctx) {
     if (LazyEnvironment::check(callCtx.callerEnv))
@@ -191,6 +372,7 @@ SEXP createLegacyArgsListFromStackValues(CallContext& call, bool eagerCallee,
                                          InterpreterInstance* ctx) {
     SEXP result = R_NilValue;
     SEXP pos = result;
+    size_t nodes = 0;
 
     for (size_t i = 0; i < call.suppliedArgs; ++i) {
 
@@ -198,12 +380,31 @@ SEXP createLegacyArgsListFromStackValues(CallContext& call, bool eagerCallee,
 
         SEXP arg = call.stackArg(i);
 
+        // Optimized code forwards `...` as one argument named `...`, holding
+        // the value of the ellipsis. Flatten it here.
+        if (name == R_DotsSymbol) {
+            if (TYPEOF(arg) != DOTSXP)
+                continue;
+            for (SEXP ellipsis = arg; ellipsis != R_NilValue;
+                 ellipsis = CDR(ellipsis)) {
+                SEXP elem = CAR(ellipsis);
+                if (eagerCallee && TYPEOF(elem) == PROMSXP)
+                    elem = Rf_eval(elem, materializeCallerEnv(call, ctx));
+                __listAppend(&result, &pos, elem, TAG(ellipsis));
+                nodes++;
+            }
+            continue;
+        }
+
         if (eagerCallee && TYPEOF(arg) == PROMSXP) {
             arg = Rf_eval(arg, materializeCallerEnv(call, ctx));
         }
         __listAppend(&result, &pos, arg, name);
+        nodes++;
     }
 
+    // Recording can allocate, so do it while the list is still protected
+    RECORD_NODE_ALLOCATIONS(call.caller, nullptr, nodes);
     if (result != R_NilValue)
         UNPROTECT(1);
 
@@ -214,6 +415,7 @@ static SEXP createLegacyArgsList(CallContext& call, bool eagerCallee,
                                  InterpreterInstance* ctx) {
     SEXP result = R_NilValue;
     SEXP pos = result;
+    size_t nodes = 0;
 
     // loop through the arguments and create a promise, unless it is a missing
     // argument
@@ -241,6 +443,7 @@ static SEXP createLegacyArgsList(CallContext& call, bool eagerCallee,
                         SEXP promise = Rf_mkPROMISE(
                             CAR(ellipsis), materializeCallerEnv(call, ctx));
                         __listAppend(&result, &pos, promise, name);
+                        nodes++;
                     }
                     ellipsis = CDR(ellipsis);
                 }
@@ -260,10 +463,14 @@ static SEXP createLegacyArgsList(CallContext& call, bool eagerCallee,
                 SEXP promise =
                     createPromise(arg, materializeCallerEnv(call, ctx));
                 __listAppend(&result, &pos, promise, name);
+                nodes++;
             }
         }
     }
 
+    RECORD_NODE_ALLOCATIONS(call.caller, nullptr,
+                            nodes + (result == R_NilValue ? 0
+                                                          : Rf_length(result)));
     if (result != R_NilValue)
         UNPROTECT(1);
     return result;
@@ -271,6 +478,7 @@ static SEXP createLegacyArgsList(CallContext& call, bool eagerCallee,
 
 SEXP materialize(void* rirDataWrapper) {
     if (auto promargs = ArgsLazyData::cast(rirDataWrapper)) {
+        boxCapturedStackPromises(*promargs->callContext);
         return promargs->createArgsLists();
     } else if (LazyEnvironment::check((SEXP)rirDataWrapper)) {
         return createEnvironment(globalContext(), (SEXP)rirDataWrapper);
@@ -285,7 +493,9 @@ SEXP* keepAliveSEXPs(void* rirDataWrapper) {
 }
 
 SEXP lazyPromargsCreation(void* rirDataWrapper) {
-    return ArgsLazyData::cast(rirDataWrapper)->createArgsLists();
+    auto promargs = ArgsLazyData::cast(rirDataWrapper);
+    boxCapturedStackPromises(*promargs->callContext);
+    return promargs->createArgsLists();
 }
 
 static RIR_INLINE SEXP createLegacyLazyArgsList(CallContext& call,
@@ -323,6 +533,29 @@ static SEXP rirCallTrampoline_(RCNTXT& cntxt, const CallContext& call,
     return evalRirCode(code, ctx, env, &call);
 }
 
+// Runs the machine code of fun if all arguments are plain scalar reals.
+// Returns nullptr if it cannot run or bails out, the body then computes the
+// result again (and deoptimizes).
+static SEXP callNativeCode(const CallContext& call, Function* fun) {
+    size_t nargs = fun->signature().formalNargs();
+    if (!call.hasStackArgs() || call.dots || call.passedArgs != nargs)
+        return nullptr;
+    double args[Function::MAX_NATIVE_ARGS];
+    for (size_t i = 0; i < nargs; ++i) {
+        SEXP arg = call.stackArg(i);
+        if (TYPEOF(arg) == PROMSXP)
+            arg = PRVALUE(arg);
+        if (!IS_SIMPLE_SCALAR(arg, REALSXP) || OBJECT(arg))
+            return nullptr;
+        args[i] = REAL(arg)[0];
+    }
+    double result;
+    if (fun->nativeCodeAddr(args, &result) != 0)
+        return nullptr;
+    R_Visible = TRUE;
+    return Rf_ScalarReal(result);
+}
+
 static RIR_INLINE SEXP rirCallTrampoline(const CallContext& call, Function* fun,
                                          SEXP env, SEXP arglist,
                                          InterpreterInstance* ctx) {
@@ -330,18 +563,40 @@ static RIR_INLINE SEXP rirCallTrampoline(const CallContext& call, Function* fun,
            fun->signature().envCreation ==
                FunctionSignature::Environment::CalleeCreated);
 
-    RCNTXT cntxt;
-
     // This code needs to be protected, because its slot in the dispatch table
     // could get overwritten while we are executing it.
     PROTECT(fun->container());
 
+    if (fun->nativeCodeAddr && !RDEBUG(call.callee)) {
+        SEXP result = callNativeCode(call, fun);
+        if (result) {
+            UNPROTECT(1);
+            return result;
+        }
+    }
+
+    // Neither reflection, non-local returns nor deoptimization can observe
+    // the context of a contextFree version. Errors unwind to the caller.
+    if (fun->signature().contextFree && !RDEBUG(call.callee)) {
+        SEXP result = evalRirCode(fun->body(), ctx, env, &call);
+        UNPROTECT(1);
+        return result;
+    }
+
+    RCNTXT cntxt;
+
     initClosureContext(call.ast, &cntxt, env, call.callerEnv, arglist,
                        call.callee);
     R_Srcref = getAttrib(call.callee, symbol::srcref);
 
     closureDebug(call.ast, call.callee, env, R_NilValue, &cntxt);
 
+    // Stack promises of this frame, which were not freed after their call,
+    // are released when it ends. R calls cend when it unwinds the context.
+    void* stackPromisesMark = (void*)(uintptr_t)STACK_PROMISES.mark();
+    cntxt.cend = &releaseStackPromises;
+    cntxt.cenddata = stackPromisesMark;
+
     // Warning: call.popArgs() between initClosureContext and trampoline will
     // result in broken stack on non-local returns.
 
@@ -351,6 +606,9 @@ static RIR_INLINE SEXP rirCallTrampoline(const CallContext& call, Function* fun,
     SEXP result = rirCallTrampoline_(cntxt, call, code, env, ctx);
     PROTECT(result);
 
+    cntxt.cend = nullptr;
+    releaseStackPromises(stackPromisesMark);
+
     endClosureDebug(call.ast, call.callee, env);
     endClosureContext(&cntxt, result);
 
@@ -407,6 +665,32 @@ static void loopTrampoline(Code* c, InterpreterInstance* ctx, SEXP env,
     assert(res == loopTrampolineMarker);
     Rf_endcontext(&cntxt);
 }
+
+// Like loopTrampoline, but for optimized code. The code after
+// push_loop_context_ runs in the context until it reaches a
+// pop_loop_context_, which returns its pc. After a non-local break or next
+// the code after the push runs again (still in the same context) with the
+// status pushed, and decides where to continue. Returns the pc to continue
+// at after the context is left.
+static Opcode* loopContextTrampoline(Code* c, InterpreterInstance* ctx,
+                                     SEXP env, const CallContext* callCtxt,
+                                     Opcode* pc, R_bcstack_t* localsBase,
+                                     BindingCache* cache) {
+    assert(TYPEOF(env) == ENVSXP);
+
+    RCNTXT cntxt;
+    Rf_begincontext(&cntxt, CTXT_LOOP, R_NilValue, env, R_BaseEnv, R_NilValue,
+                    R_NilValue);
+
+    SEXP status = R_NilValue;
+    if (int s = SETJMP(cntxt.cjmpbuf))
+        status = s == CTXT_BREAK ? symbol::Break : symbol::Next;
+
+    ostack_push(ctx, status);
+    SEXP res = evalRirCode(c, ctx, env, callCtxt, pc, localsBase, cache);
+    Rf_endcontext(&cntxt);
+    return reinterpret_cast<Opcode*>(res);
+}
 #pragma GCC diagnostic pop
 
 static SEXP inlineContextTrampoline(Code* c, const CallContext* callCtx,
@@ -507,6 +791,8 @@ static SEXP closureArgumentAdaptor(const CallContext& call, SEXP arglist,
 
     SEXP actuals = Rf_matchArgs(FORMALS(op), arglist, call.ast);
     PROTECT(newrho = Rf_NewEnvironment(FORMALS(op), actuals, CLOENV(op)));
+    RECORD_ALLOCATION(call.caller, nullptr, newrho);
+    RECORD_NODE_ALLOCATIONS(call.caller, nullptr, Rf_length(actuals));
 
     /* Turn on reference counting for the binding cells so local
        assignments arguments increment REFCNT values */
@@ -538,6 +824,7 @@ static SEXP closureArgumentAdaptor(const CallContext& call, SEXP arglist,
                 assert(c != nullptr && "No more compiled formals available.");
                 SETCAR(a, createPromise(c, newrho));
                 SET_MISSING(a, 2);
+                RECORD_NODE_ALLOCATIONS(call.caller, nullptr, 1);
             }
             // Either just used the compiled formal or it was not needed.
             // Skip over current compiled formal and find the next default arg.
@@ -574,7 +861,7 @@ static SEXP findRootPromise(SEXP p) {
 static void addDynamicAssumptionsFromContext(CallContext& call) {
     Assumptions& given = call.givenAssumptions;
 
-    if (!call.hasNames())
+    if (!call.hasNames() || call.argsMatched)
         given.add(Assumption::CorrectOrderOfArguments);
 
     given.add(Assumption::NoExplicitlyMissingArgs);
@@ -635,7 +922,9 @@ static RIR_INLINE Assumptions addDynamicAssumptionsForOneTarget(
             given.add(Assumption::NotTooFewArguments);
     }
 
-    if (call.suppliedArgs <= signature.formalNargs())
+    // Surplus arguments are bound to the trailing `...` by packDotsArgs
+    if (call.suppliedArgs <= signature.formalNargs() ||
+        signature.hasDotsFormals)
         given.add(Assumption::NotTooManyArguments);
 
     return given;
@@ -692,6 +981,46 @@ static RIR_INLINE void supplyMissingArgs(CallContext& call,
     }
 }
 
+// Optimized code expects the arguments supplied for a trailing `...` formal
+// packed into one DOTSXP, just like the GNU R argument matcher would bind
+// them. The arglist is only needed if the arguments are not on the stack.
+// Returns the packed arguments (or R_NilValue), which the caller needs to
+// protect for the duration of the call.
+static SEXP packDotsArgs(CallContext& call, const Function* fun,
+                         SEXP arglist) {
+    auto& signature = fun->signature();
+    if (!signature.hasDotsFormals ||
+        signature.envCreation != FunctionSignature::Environment::CalleeCreated)
+        return R_NilValue;
+
+    size_t dotsIdx = signature.formalNargs() - 1;
+    // If nothing is supplied for `...`, it is a missing argument
+    if (call.suppliedArgs <= dotsIdx)
+        return R_NilValue;
+
+    assert(!call.hasNames() || call.argsMatched);
+    SEXP dots = R_NilValue;
+    SEXP pos = dots;
+    if (call.hasStackArgs()) {
+        for (size_t i = dotsIdx; i < call.suppliedArgs; ++i)
+            __listAppend(&dots, &pos, call.stackArg(i), R_NilValue);
+    } else {
+        assert(TYPEOF(arglist) == LISTSXP);
+        SEXP arg = arglist;
+        for (size_t i = 0; i < dotsIdx; ++i)
+            arg = CDR(arg);
+        for (; arg != R_NilValue; arg = CDR(arg))
+            __listAppend(&dots, &pos, CAR(arg), R_NilValue);
+    }
+    SET_TYPEOF(dots, DOTSXP);
+    RECORD_NODE_ALLOCATIONS(call.caller, nullptr, call.suppliedArgs - dotsIdx);
+    UNPROTECT(1);
+
+    call.dots = dots;
+    call.dotsIdx = dotsIdx;
+    return dots;
+}
+
 static Function* dispatch(const CallContext& call, DispatchTable* vt) {
     // Find the most specific version of the function that can be called given
     // the current call context.
@@ -699,6 +1028,12 @@ static Function* dispatch(const CallContext& call, DispatchTable* vt) {
     for (int i = vt->size() - 1; i >= 0; i--) {
         auto candidate = vt->get(i);
         if (matches(call, candidate->signature())) {
+            // A binding this version relies on was changed, it is gone for
+            // good
+            if (!candidate->dependenciesValid()) {
+                vt->remove(candidate->body());
+                continue;
+            }
             fun = candidate;
             break;
         }
@@ -708,6 +1043,229 @@ static Function* dispatch(const CallContext& call, DispatchTable* vt) {
     return fun;
 };
 
+/*
+ * Argument matching plans for named calls. A plan lists for every position of
+ * the matched argument list the supplied argument bound there, as computed by
+ * the GNU R matcher (exact, partial, then positional). The formals that are
+ * not supplied form the missing bucket, which supplyMissingArgs pads, and the
+ * positions from the `...` formal on form the dots bucket, which packDotsArgs
+ * packs. Plans are only created if the reordered, unnamed args are matched
+ * the same way, ie. the supplied formals have no gaps and args bound to `...`
+ * are unnamed. Otherwise, and for calls which fail to match, the plan is
+ * empty and the named call is left to the matcher.
+ */
+class ArgMatchPlanCache {
+  public:
+    static constexpr size_t MAX_ARGS = 16;
+
+    struct Plan {
+        std::vector<uint8_t> order;
+        // Partial matching is subject to the warnPartialMatchArgs option
+        bool partial = false;
+    };
+
+    const Plan& plan(SEXP formals, const CallContext& call,
+                     InterpreterInstance* ctx) {
+        if (!keep) {
+            keep = Rf_allocVector(VECSXP, SIZE);
+            R_PreserveObject(keep);
+        }
+
+        size_t n = call.suppliedArgs;
+        size_t h = std::hash<SEXP>()(formals);
+        for (size_t i = 0; i < n; ++i)
+            h = hash_combine(h, call.name(i, ctx));
+        size_t idx = h % SIZE;
+        auto& entry = entries[idx];
+
+        if (entry.formals == formals && entry.names.size() == n) {
+            bool same = true;
+            for (size_t i = 0; same && i < n; ++i)
+                same = entry.names[i] == call.name(i, ctx);
+            if (same)
+                return entry.plan;
+        }
+
+        // Keeps the formals alive, such that they are not confused with a
+        // new pairlist at the same address
+        SET_VECTOR_ELT(keep, idx, formals);
+        entry.formals = formals;
+        entry.names.clear();
+        for (size_t i = 0; i < n; ++i)
+            entry.names.push_back(call.name(i, ctx));
+        entry.plan = Plan();
+        if (!compute(formals, entry.names, entry.plan))
+            entry.plan = Plan();
+        return entry.plan;
+    }
+
+  private:
+    static bool compute(SEXP formals, const std::vector<SEXP>& names,
+                        Plan& plan) {
+        size_t n = names.size();
+        if (n > MAX_ARGS)
+            return false;
+
+        std::vector<SEXP> fs;
+        long dots = -1;
+        for (SEXP f = formals; f != R_NilValue; f = CDR(f)) {
+            if (TAG(f) == R_DotsSymbol)
+                dots = fs.size();
+            fs.push_back(TAG(f));
+        }
+
+        for (auto name : names)
+            if (name == R_DotsSymbol ||
+                (name != R_NilValue && !*CHAR(PRINTNAME(name))))
+                return false;
+
+        static const int NONE = -1;
+        std::vector<int> bound(fs.size(), NONE);
+        std::vector<bool> used(n, false);
+
+        // Exact matches
+        for (size_t f = 0; f < fs.size(); ++f) {
+            if ((long)f == dots)
+                continue;
+            for (size_t a = 0; a < n; ++a) {
+                if (names[a] != fs[f])
+                    continue;
+                if (bound[f] != NONE)
+                    return false;
+                bound[f] = a;
+                used[a] = true;
+            }
+        }
+
+        // Partial matches, only for formals before `...`. An arg matching
+        // several formals is an error, which we leave to the matcher.
+        std::vector<bool> exact = used;
+        size_t partialEnd = dots == -1 ? fs.size() : dots;
+        for (size_t f = 0; f < partialEnd; ++f) {
+            if (bound[f] != NONE)
+                continue;
+            const char* formal = CHAR(PRINTNAME(fs[f]));
+            for (size_t a = 0; a < n; ++a) {
+                if (exact[a] || names[a] == R_NilValue)
+                    continue;
+                const char* tag = CHAR(PRINTNAME(names[a]));
+                if (strncmp(formal, tag, strlen(tag)) != 0)
+                    continue;
+                if (used[a] || bound[f] != NONE)
+                    return false;
+                bound[f] = a;
+            }
+            if (bound[f] != NONE) {
+                used[bound[f]] = true;
+                plan.partial = true;
+            }
+        }
+
+        // Positional matches
+        size_t a = 0;
+        for (size_t f = 0; f < partialEnd; ++f) {
+            if (bound[f] != NONE)
+                continue;
+            while (a < n && (used[a] || names[a] != R_NilValue))
+                a++;
+            if (a == n)
+                break;
+            bound[f] = a;
+            used[a++] = true;
+        }
+
+        // Everything else goes to `...`, it has to be unnamed and the formals
+        // before it must all be supplied, to not shift the dots by position
+        std::vector<uint8_t> rest;
+        for (size_t a = 0; a < n; ++a)
+            if (!used[a])
+                rest.push_back(a);
+        if (!rest.empty() && dots == -1)
+            return false;
+        for (auto a : rest)
+            if (names[a] != R_NilValue)
+                return false;
+
+        size_t end = dots == -1 ? fs.size() : dots;
+        bool gap = false;
+        for (size_t f = 0; f < end; ++f) {
+            if (bound[f] == NONE) {
+                gap = true;
+                continue;
+            }
+            if (gap)
+                return false;
+            plan.order.push_back(bound[f]);
+        }
+        if (!rest.empty() && gap)
+            return false;
+        for (size_t f = end + 1; f < fs.size(); ++f)
+            if (bound[f] != NONE)
+                return false;
+        plan.order.insert(plan.order.end(), rest.begin(), rest.end());
+        assert(plan.order.size() == n);
+        return true;
+    }
+
+    static constexpr size_t SIZE = 128;
+    struct Entry {
+        SEXP formals = nullptr;
+        std::vector<SEXP> names;
+        Plan plan;
+    };
+    std::array<Entry, SIZE> entries;
+    SEXP keep = nullptr;
+};
+static ArgMatchPlanCache ARG_MATCH_PLAN_CACHE;
+
+// Replays the matching plan for a named call by reordering its arguments.
+// Afterwards the call can be dispatched to versions which assume the correct
+// order of arguments. The names are reordered too, since UseMethod and
+// NextMethod match the args of the call again. Implicit args and names are
+// reordered into buf and namesBuf, which need to live as long as the call.
+static RIR_INLINE void reorderNamedArgs(CallContext& call, Immediate* buf,
+                                        Immediate* namesBuf,
+                                        InterpreterInstance* ctx) {
+    if (!call.hasNames() || call.arglist ||
+        call.suppliedArgs > ArgMatchPlanCache::MAX_ARGS)
+        return;
+    // The matcher treats formals bound to an explicitly missing arg as not
+    // supplied, and `...` expands to an unknown number of args
+    for (size_t i = 0; i < call.suppliedArgs; ++i) {
+        if (call.hasStackArgs() ? call.stackArg(i) == R_MissingArg
+                                : call.implicitArgIdx(i) == DOTS_ARG_IDX ||
+                                      call.missingArg(i))
+            return;
+    }
+
+    auto& plan = ARG_MATCH_PLAN_CACHE.plan(FORMALS(call.callee), call, ctx);
+    if (plan.order.empty() ||
+        (plan.partial &&
+         Rf_asLogical(Rf_GetOption1(symbol::warnPartialMatchArgs)) == TRUE))
+        return;
+
+    size_t n = call.suppliedArgs;
+    for (size_t i = 0; i < n; ++i)
+        namesBuf[i] = call.names[plan.order[i]];
+    if (call.hasStackArgs()) {
+        R_bcstack_t args[ArgMatchPlanCache::MAX_ARGS];
+        auto stackArgs = const_cast<R_bcstack_t*>(call.stackArgs);
+        for (size_t i = 0; i < n; ++i)
+            args[i] = stackArgs[i];
+        for (size_t i = 0; i < n; ++i)
+            stackArgs[i] = args[plan.order[i]];
+    } else {
+        for (size_t i = 0; i < n; ++i)
+            buf[i] = call.implicitArgs[plan.order[i]];
+        call.implicitArgs = buf;
+    }
+    call.names = namesBuf;
+    call.argsMatched = true;
+    // Type assumptions from the caller refer to the supplied order, the ones
+    // for stack args are recomputed by addDynamicAssumptionsFromContext
+    call.givenAssumptions.clearArgTypes();
+}
+
 unsigned pir::Parameter::RIR_WARMUP =
     getenv("PIR_WARMUP") ? atoi(getenv("PIR_WARMUP")) : 3;
 
@@ -730,6 +1288,9 @@ RIR_INLINE SEXP rirCall(CallContext& call, InterpreterInstance* ctx) {
 
     auto table = DispatchTable::unpack(body);
 
+    Immediate reordered[ArgMatchPlanCache::MAX_ARGS];
+    Immediate reorderedNames[ArgMatchPlanCache::MAX_ARGS];
+    reorderNamedArgs(call, reordered, reorderedNames, ctx);
     addDynamicAssumptionsFromContext(call);
     Function* fun = dispatch(call, table);
     fun->registerInvocation();
@@ -785,13 +1346,16 @@ RIR_INLINE SEXP rirCall(CallContext& call, InterpreterInstance* ctx) {
             if (!arglist)
                 arglist = (SEXP)&lazyArgs;
             supplyMissingArgs(call, fun);
+            PROTECT(packDotsArgs(call, fun, arglist));
             result = rirCallTrampoline(call, fun, arglist, ctx);
+            UNPROTECT(1);
         } else {
             if (!arglist)
                 arglist = createLegacyArgsList(call, ctx);
             PROTECT(arglist);
+            PROTECT(packDotsArgs(call, fun, arglist));
             result = rirCallTrampoline(call, fun, arglist, ctx);
-            UNPROTECT(1);
+            UNPROTECT(2);
         }
     }
 
@@ -895,6 +1459,276 @@ static SEXP doCall(CallContext& call, InterpreterInstance* ctx) {
     return R_NilValue;
 }
 
+// Looks up an S3 method for a generic defined in base, like R_LookupMethod:
+// from the caller to its top level environment top, then in the methods
+// registered with base, and finally in the rest of the environments. Sets cell
+// to the binding the method was found in, or nullptr for active bindings.
+static SEXP lookupS3Method(SEXP method, SEXP callerEnv, SEXP top,
+                           SEXP& cell) {
+    auto inFrame = [&](SEXP rho, SEXP evalEnv) -> SEXP {
+        R_varloc_t loc = R_findVarLocInFrame(rho, method);
+        if (R_VARLOC_IS_NULL(loc))
+            return R_UnboundValue;
+        SEXP fun;
+        if (IS_ACTIVE_BINDING(loc.cell)) {
+            cell = nullptr;
+            fun = Rf_findVarInFrame3(rho, method, TRUE);
+        } else {
+            cell = loc.cell;
+            // Bindings of base live in the symbol
+            fun = TYPEOF(cell) == SYMSXP ? SYMVALUE(cell) : CAR(cell);
+        }
+        if (TYPEOF(fun) == PROMSXP) {
+            PROTECT(fun);
+            fun = Rf_eval(fun, evalEnv);
+            UNPROTECT(1);
+        }
+        return fun;
+    };
+    auto findFun = [&](SEXP from, SEXP to) -> SEXP {
+        for (SEXP rho = from; rho != R_EmptyEnv; rho = ENCLOS(rho)) {
+            SEXP fun = inFrame(rho, rho);
+            if (TYPEOF(fun) == CLOSXP || TYPEOF(fun) == BUILTINSXP ||
+                TYPEOF(fun) == SPECIALSXP)
+                return fun;
+            if (rho == to)
+                break;
+        }
+        return R_UnboundValue;
+    };
+
+    SEXP fun = findFun(callerEnv, top);
+    if (fun != R_UnboundValue)
+        return fun;
+
+    SEXP table = Rf_findVarInFrame3(R_BaseEnv, symbol::S3MethodsTable, TRUE);
+    if (TYPEOF(table) == PROMSXP)
+        table = Rf_eval(table, R_BaseEnv);
+    if (TYPEOF(table) == ENVSXP) {
+        fun = inFrame(table, callerEnv);
+        if (fun != R_UnboundValue)
+            return fun;
+    }
+
+    return findFun(ENCLOS(top), R_EmptyEnv);
+}
+
+/*
+ * S3 dispatch of the internal generics, keyed on the generic and the class
+ * attribute. An entry holds the method names ("generic.class", built and
+ * installed only once) and the last method found for them, with the top level
+ * environment of the caller and the binding it was found in.
+ *
+ * The method found is reused if the binding still holds it, none of the
+ * caller's local frames binds one of the names up to it, and neither the
+ * global env nor the methods registered with base got a binding for a more
+ * specific name. Additionally, stores of RIR code into the global env or
+ * namespaces bump the epoch, which drops all of them (see noteStore). R does
+ * not tell us about its own stores, the checks above cover the global env and
+ * the registered methods. A more specific method added by R to some other
+ * environment on the search path is not noticed.
+ */
+class S3MethodCache {
+  public:
+    static size_t epoch;
+
+    // Returns the method of generic for klass, and sets method and idx to its
+    // name and to its position in klass (XLENGTH(klass) for the default).
+    // Returns nullptr if there is no method, and R_UnboundValue if it cannot
+    // be called directly.
+    SEXP lookup(SEXP generic, SEXP klass, SEXP callerEnv, SEXP& method,
+                size_t& idx) {
+        if (!store) {
+            store = Rf_allocVector(VECSXP, SIZE * FIELDS);
+            R_PreserveObject(store);
+        }
+
+        size_t n = XLENGTH(klass);
+        size_t h = std::hash<SEXP>()(generic);
+        for (size_t i = 0; i < n; ++i)
+            h = hash_combine(h, STRING_ELT(klass, i));
+        size_t pos = h % SIZE;
+        size_t base = pos * FIELDS;
+        auto& entry = entries[pos];
+
+        // Strings are cached, thus equal classes have the same CHARSXPs
+        SEXP cached = VECTOR_ELT(store, base + CLASS);
+        bool same = entry.generic == generic && (size_t)XLENGTH(cached) == n;
+        for (size_t i = 0; same && i < n; ++i)
+            same = STRING_ELT(cached, i) == STRING_ELT(klass, i);
+
+        if (!same) {
+            // Copy, since the class attribute might be modified in place
+            SET_VECTOR_ELT(store, base + CLASS, Rf_duplicate(klass));
+            entry.generic = generic;
+            entry.resolved = false;
+            entry.methods.clear();
+            const char* g = CHAR(PRINTNAME(generic));
+            char buf[512];
+            for (size_t i = 0; i <= n; ++i) {
+                const char* c =
+                    i < n ? Rf_translateChar(STRING_ELT(klass, i)) : "default";
+                if (snprintf(buf, sizeof(buf), "%s.%s", g, c) >=
+                    (int)sizeof(buf)) {
+                    entry.methods.clear();
+                    break;
+                }
+                entry.methods.push_back(Rf_install(buf));
+            }
+        }
+        if (entry.methods.empty())
+            return R_UnboundValue;
+
+        SEXP top = Rf_topenv(R_NilValue, callerEnv);
+        if (entry.resolved && entry.epoch == epoch &&
+            VECTOR_ELT(store, base + TOP) == top &&
+            stillFound(entry, base, callerEnv, top)) {
+            method = entry.methods[entry.idx];
+            idx = entry.idx;
+            return VECTOR_ELT(store, base + FUN);
+        }
+
+        // Copy, lookups might dispatch and replace the entry
+        auto methods = entry.methods;
+        SEXP key = VECTOR_ELT(store, base + CLASS);
+        size_t resolvedAt = epoch;
+        for (size_t i = 0; i < methods.size(); ++i) {
+            SEXP cell;
+            SEXP fun = lookupS3Method(methods[i], callerEnv, top, cell);
+            if (fun == R_UnboundValue)
+                continue;
+            if (TYPEOF(fun) != CLOSXP)
+                return R_UnboundValue;
+            method = methods[i];
+            idx = i;
+            if (VECTOR_ELT(store, base + CLASS) != key)
+                return fun;
+            entry.resolved = cell != nullptr;
+            if (cell) {
+                PROTECT(fun);
+                entry.epoch = resolvedAt;
+                entry.idx = i;
+                SET_VECTOR_ELT(store, base + TOP, top);
+                SET_VECTOR_ELT(store, base + CELL, cell);
+                SET_VECTOR_ELT(store, base + VALUE, bindingValue(cell));
+                SET_VECTOR_ELT(store, base + FUN, fun);
+                UNPROTECT(1);
+            }
+            return fun;
+        }
+        return nullptr;
+    }
+
+  private:
+    static constexpr size_t SIZE = 64;
+    // Per entry in store: the class vector, the top level environment of the
+    // caller, the binding, its value and the method (the value, or the value
+    // of the promise in the binding)
+    enum { CLASS, TOP, CELL, VALUE, FUN, FIELDS };
+    struct Entry {
+        SEXP generic = nullptr;
+        std::vector<SEXP> methods;
+        bool resolved = false;
+        size_t idx = 0;
+        size_t epoch = 0;
+    };
+    std::array<Entry, SIZE> entries;
+    SEXP store = nullptr;
+
+    static SEXP bindingValue(SEXP cell) {
+        // Bindings of base live in the symbol
+        return TYPEOF(cell) == SYMSXP ? SYMVALUE(cell) : CAR(cell);
+    }
+
+    bool stillFound(const Entry& entry, size_t base, SEXP callerEnv,
+                    SEXP top) {
+        // R unbinds removed variables, thus this fails for them
+        SEXP cell = VECTOR_ELT(store, base + CELL);
+        if (bindingValue(cell) != VECTOR_ELT(store, base + VALUE))
+            return false;
+
+        SEXP table =
+            Rf_findVarInFrame3(R_BaseEnv, symbol::S3MethodsTable, TRUE);
+        for (size_t i = 0; i <= entry.idx; ++i) {
+            SEXP m = entry.methods[i];
+            for (SEXP rho = callerEnv; rho != top && rho != R_EmptyEnv;
+                 rho = ENCLOS(rho))
+                if (R_existsVarInFrame(rho, m))
+                    return false;
+            R_varloc_t loc = R_findVarLocInFrame(R_GlobalEnv, m);
+            if (!R_VARLOC_IS_NULL(loc) && loc.cell != cell)
+                return false;
+            if (TYPEOF(table) == ENVSXP) {
+                loc = R_findVarLocInFrame(table, m);
+                if (!R_VARLOC_IS_NULL(loc) && loc.cell != cell)
+                    return false;
+            }
+        }
+        return true;
+    }
+};
+size_t S3MethodCache::epoch = 0;
+static S3MethodCache S3_METHOD_CACHE;
+
+// Stores into hashed environments, ie. the global env, namespaces and package
+// environments, can change which S3 method is found.
+static RIR_INLINE void noteStore(SEXP env) {
+    if (HASHTAB(env) != R_NilValue)
+        ++S3MethodCache::epoch;
+}
+
+// Calls the S3 method like usemethod does, but without materializing a frame
+// for the internal generic. Returns nullptr if there is no method, and
+// R_UnboundValue if the generic dispatch has to handle it.
+static SEXP dispatchS3(SEXP ast, SEXP klass, SEXP actuals, SEXP selector,
+                       SEXP callerEnv) {
+    SEXP method;
+    size_t i;
+    SEXP fun = S3_METHOD_CACHE.lookup(selector, klass, callerEnv, method, i);
+    if (!fun || fun == R_UnboundValue)
+        return fun;
+    PROTECT(fun);
+
+    size_t nclass = XLENGTH(klass);
+    SEXP dotClass = klass;
+    if (i == nclass) {
+        dotClass = R_NilValue;
+    } else if (i > 0) {
+        dotClass = Rf_allocVector(STRSXP, nclass - i);
+        for (size_t j = i; j < nclass; ++j)
+            SET_STRING_ELT(dotClass, j - i, STRING_ELT(klass, j));
+        PROTECT(dotClass);
+        Rf_setAttrib(dotClass, R_PreviousSymbol, klass);
+        UNPROTECT(1);
+    }
+    PROTECT(dotClass);
+
+    // The dispatch variables, see createS3Vars
+    SEXP newvars = R_NilValue;
+    PROTECT_INDEX ipx;
+    PROTECT_WITH_INDEX(newvars, &ipx);
+    auto addVar = [&](SEXP tag, SEXP val) {
+        REPROTECT(newvars = CONS(val, newvars), ipx);
+        SET_TAG(newvars, tag);
+    };
+    addVar(symbol::DotGenericDefEnv, R_BaseEnv);
+    addVar(symbol::DotGenericCallEnv, callerEnv);
+    addVar(symbol::DotGroup, R_BlankScalarString);
+    addVar(symbol::DotMethod, Rf_mkString(CHAR(PRINTNAME(method))));
+    addVar(symbol::DotClass, dotClass);
+    addVar(symbol::DotGeneric, Rf_mkString(CHAR(PRINTNAME(selector))));
+
+    SEXP newcall = PROTECT(Rf_shallow_duplicate(ast));
+    SETCAR(newcall, method);
+    SEXP result;
+    if (TYPEOF(BODY(fun)) == EXTERNALSXP)
+        result = rirApplyClosure(newcall, fun, actuals, callerEnv, newvars);
+    else
+        result = Rf_applyClosure(newcall, fun, actuals, callerEnv, newvars);
+    UNPROTECT(4);
+    return result;
+}
+
 static SEXP dispatchApply(SEXP ast, SEXP obj, SEXP actuals, SEXP selector,
                           SEXP callerEnv, InterpreterInstance* ctx) {
     SEXP op = SYMVALUE(selector);
@@ -908,7 +1742,16 @@ static SEXP dispatchApply(SEXP ast, SEXP obj, SEXP actuals, SEXP selector,
     }
 
     // ===============================================
-    // Then try S3
+    // Then try S3, S4 objects take the generic path since they dispatch on
+    // the classes they extend
+    SEXP klass = Rf_getAttrib(obj, R_ClassSymbol);
+    if (!IS_S4_OBJECT(obj) && TYPEOF(callerEnv) == ENVSXP &&
+        TYPEOF(klass) == STRSXP && XLENGTH(klass) > 0) {
+        SEXP result = dispatchS3(ast, klass, actuals, selector, callerEnv);
+        if (result != R_UnboundValue)
+            return result;
+    }
+
     const char* generic = CHAR(PRINTNAME(selector));
     SEXP rho1 = Rf_NewEnvironment(R_NilValue, R_NilValue, callerEnv);
     PROTECT(rho1);
@@ -994,11 +1837,11 @@ static SEXPREC createFakeCONS(SEXP cdr) {
     return res;
 }
 
-#define CHECK_INTEGER_OVERFLOW(ans, naflag)                                    \
+// The call is only looked up if the operation overflowed
+#define CHECK_INTEGER_OVERFLOW(call, ans, naflag)                              \
     do {                                                                       \
         if (naflag) {                                                          \
             PROTECT(ans);                                                      \
-            SEXP call = getSrcForCall(c, pc - 1, ctx);                         \
             Rf_warningcall(call, INTEGER_OVERFLOW_WARNING);                    \
             UNPROTECT(1);                                                      \
         }                                                                      \
@@ -1028,6 +1871,7 @@ static SEXPREC createFakeCONS(SEXP cdr) {
         } else {                                                               \
             SEXP arglist = CONS_NR(lhs, CONS_NR(rhs, R_NilValue));             \
             ostack_push(ctx, arglist);                                         \
+            RECORD_NODE_ALLOCATIONS(c, pc, 2);                                 \
             res = blt(call, prim, arglist, env);                               \
             ostack_pop(ctx);                                                   \
         }                                                                      \
@@ -1069,7 +1913,8 @@ static SEXPREC createFakeCONS(SEXP cdr) {
                     break;                                                     \
                 }                                                              \
                 res_type = INTSXP;                                             \
-                CHECK_INTEGER_OVERFLOW(R_NilValue, naflag);                    \
+                CHECK_INTEGER_OVERFLOW(getSrcForCall(c, pc - 1, ctx),          \
+                                       R_NilValue, naflag);                    \
             } else if (IS_SIMPLE_SCALAR(rhs, REALSXP)) {                       \
                 res_type = REALSXP;                                            \
                 real_res =                                                     \
@@ -1096,6 +1941,7 @@ static SEXPREC createFakeCONS(SEXP cdr) {
         } else {                                                               \
             ostack_pop(ctx);                                                   \
             ostack_at(ctx, 0) = res = Rf_allocVector(res_type, 1);             \
+            RECORD_ALLOCATION(c, pc, res);                                     \
         }                                                                      \
         switch (res_type) {                                                    \
         case INTSXP:                                                           \
@@ -1169,6 +2015,7 @@ static R_INLINE int R_integer_uminus(int x, Rboolean* pnaflag) {
         SEXP call = getSrcForCall(c, pc - 1, ctx);                             \
         SEXP argslist = CONS_NR(val, R_NilValue);                              \
         ostack_push(ctx, argslist);                                            \
+        RECORD_NODE_ALLOCATIONS(c, pc, 1);                                     \
         if (flag < 2)                                                          \
             R_Visible = static_cast<Rboolean>(flag != 1);                      \
         res = blt(call, prim, argslist, env);                                  \
@@ -1181,11 +2028,13 @@ static R_INLINE int R_integer_uminus(int x, Rboolean* pnaflag) {
     do {                                                                       \
         if (IS_SIMPLE_SCALAR(val, REALSXP)) {                                  \
             res = Rf_allocVector(REALSXP, 1);                                  \
+            RECORD_ALLOCATION(c, pc, res);                                     \
             *REAL(res) = (*REAL(val) == NA_REAL) ? NA_REAL : op * REAL(val);   \
             R_Visible = (Rboolean) true;                                       \
         } else if (IS_SIMPLE_SCALAR(val, INTSXP)) {                            \
             Rboolean naflag = FALSE;                                           \
             res = Rf_allocVector(INTSXP, 1);                                   \
+            RECORD_ALLOCATION(c, pc, res);                                     \
             switch (op2) {                                                     \
             case PLUSOP:                                                       \
                 *INTEGER(res) = R_integer_uplus(*INTEGER(val), &naflag);       \
@@ -1194,7 +2043,8 @@ static R_INLINE int R_integer_uminus(int x, Rboolean* pnaflag) {
                 *INTEGER(res) = R_integer_uminus(*INTEGER(val), &naflag);      \
                 break;                                                         \
             }                                                                  \
-            CHECK_INTEGER_OVERFLOW(res, naflag);                               \
+            CHECK_INTEGER_OVERFLOW(getSrcForCall(c, pc - 1, ctx), res,         \
+                                   naflag);                                    \
             R_Visible = (Rboolean) true;                                       \
         } else {                                                               \
             UNOP_FALLBACK(#op);                                                \
@@ -1256,6 +2106,208 @@ static R_INLINE int R_integer_uminus(int x, Rboolean* pnaflag) {
         BINOP_FALLBACK(#op);                                                   \
     } while (false)
 
+#ifdef TYPED_STACK
+// Unboxed scalars live in stack cells tagged with their SEXPTYPE, the GC only
+// looks at cells with tag 0. Logicals use the integer representation.
+static RIR_INLINE double unboxedReal(R_bcstack_t* cell) {
+    if (cell->tag == REALSXP)
+        return cell->u.dval;
+    return cell->u.ival == NA_INTEGER ? NA_REAL : cell->u.ival;
+}
+
+static RIR_INLINE void setUnboxedInt(R_bcstack_t* cell, SEXPTYPE type, int i) {
+    cell->tag = type;
+    cell->u.ival = i;
+}
+
+static RIR_INLINE void setUnboxedReal(R_bcstack_t* cell, double d) {
+    cell->tag = REALSXP;
+    cell->u.dval = d;
+}
+
+#define DO_UNBOXED_BINOP(op, op2)                                              \
+    do {                                                                       \
+        R_bcstack_t* lhs = ostack_cell_at(ctx, 1);                             \
+        R_bcstack_t* rhs = ostack_cell_at(ctx, 0);                             \
+        if (lhs->tag != REALSXP && rhs->tag != REALSXP) {                      \
+            Rboolean naflag = FALSE;                                           \
+            int int_res = NA_INTEGER;                                          \
+            switch (op2) {                                                     \
+            case PLUSOP:                                                       \
+                int_res =                                                      \
+                    R_integer_plus(lhs->u.ival, rhs->u.ival, &naflag);         \
+                break;                                                         \
+            case MINUSOP:                                                      \
+                int_res =                                                      \
+                    R_integer_minus(lhs->u.ival, rhs->u.ival, &naflag);        \
+                break;                                                         \
+            case TIMESOP:                                                      \
+                int_res =                                                      \
+                    R_integer_times(lhs->u.ival, rhs->u.ival, &naflag);        \
+                break;                                                         \
+            }                                                                  \
+            CHECK_INTEGER_OVERFLOW(getSrcForCall(c, pc - 1, ctx), R_NilValue,  \
+                                   naflag);                                    \
+            setUnboxedInt(lhs, INTSXP, int_res);                               \
+        } else {                                                               \
+            /* IEEE arithmetic propagates NA and NaN */                        \
+            setUnboxedReal(lhs, unboxedReal(lhs) op unboxedReal(rhs));         \
+        }                                                                      \
+        ostack_popn(ctx, 1);                                                   \
+    } while (false)
+
+#define DO_UNBOXED_RELOP(op)                                                   \
+    do {                                                                       \
+        R_bcstack_t* lhs = ostack_cell_at(ctx, 1);                             \
+        R_bcstack_t* rhs = ostack_cell_at(ctx, 0);                             \
+        int lgl_res;                                                           \
+        if (lhs->tag != REALSXP && rhs->tag != REALSXP) {                      \
+            lgl_res = (lhs->u.ival == NA_INTEGER || rhs->u.ival == NA_INTEGER) \
+                          ? NA_LOGICAL                                         \
+                          : lhs->u.ival op rhs->u.ival;                        \
+        } else {                                                               \
+            double l = unboxedReal(lhs);                                       \
+            double r = unboxedReal(rhs);                                       \
+            lgl_res = (ISNAN(l) || ISNAN(r)) ? NA_LOGICAL : l op r;            \
+        }                                                                      \
+        setUnboxedInt(lhs, LGLSXP, lgl_res);                                   \
+        ostack_popn(ctx, 1);                                                   \
+    } while (false)
+#endif
+
+// Evaluates a fused kernel in a single pass over the operands, without
+// temporary vectors. Handles attribute free real vectors of the same length
+// and real scalars. Returns nullptr if the kernel has to be evaluated by the
+// builtins, e.g. since they would warn or recycle.
+static SEXP fusedFastPath(SEXP kernel, SEXP* args, size_t nargs) {
+    const double* in[MAX_FUSED_OPERANDS];
+    R_xlen_t stride[MAX_FUSED_OPERANDS];
+    R_xlen_t n = 1;
+    for (size_t i = 0; i < nargs; ++i) {
+        SEXP a = args[i];
+        if (TYPEOF(a) != REALSXP || ATTRIB(a) != R_NilValue)
+            return nullptr;
+        R_xlen_t len = XLENGTH(a);
+        if (len == 0 || (len != 1 && n != 1 && len != n))
+            return nullptr;
+        if (len != 1)
+            n = len;
+        in[i] = REAL(a);
+        stride[i] = len == 1 ? 0 : 1;
+    }
+
+    const int* prog = INTEGER(kernel);
+    int progLength = LENGTH(kernel);
+    auto last = static_cast<FusedOp>(prog[progLength - 1]);
+    bool logical = last >= FusedOp::Lt && last <= FusedOp::Ne;
+    SEXP res = PROTECT(Rf_allocVector(logical ? LGLSXP : REALSXP, n));
+
+    double stack[MAX_FUSED_DEPTH];
+    for (R_xlen_t i = 0; i < n; ++i) {
+        size_t sp = 0;
+        for (int k = 0; k < progLength; ++k) {
+            double l = sp > 1 ? stack[sp - 2] : 0;
+            double r = sp > 0 ? stack[sp - 1] : 0;
+            switch (static_cast<FusedOp>(prog[k])) {
+            case FusedOp::Arg: {
+                int a = prog[++k];
+                stack[sp++] = in[a][i * stride[a]];
+                continue;
+            }
+            case FusedOp::Sqrt:
+                // sqrt warns about NaNs produced
+                if (r < 0) {
+                    UNPROTECT(1);
+                    return nullptr;
+                }
+                stack[sp - 1] = sqrt(r);
+                continue;
+            case FusedOp::Exp:
+                stack[sp - 1] = exp(r);
+                continue;
+            case FusedOp::Abs:
+                stack[sp - 1] = fabs(r);
+                continue;
+#define FUSED_BINOP(Op, op)                                                    \
+    case FusedOp::Op:                                                          \
+        stack[sp - 2] = l op r;                                                \
+        break;
+                FUSED_BINOP(Add, +);
+                FUSED_BINOP(Sub, -);
+                FUSED_BINOP(Mul, *);
+                FUSED_BINOP(Div, /);
+#undef FUSED_BINOP
+#define FUSED_RELOP(Op, op)                                                    \
+    case FusedOp::Op:                                                          \
+        stack[sp - 2] = (ISNAN(l) || ISNAN(r)) ? NA_REAL : l op r;             \
+        break;
+                FUSED_RELOP(Lt, <);
+                FUSED_RELOP(Gt, >);
+                FUSED_RELOP(Le, <=);
+                FUSED_RELOP(Ge, >=);
+                FUSED_RELOP(Eq, ==);
+                FUSED_RELOP(Ne, !=);
+#undef FUSED_RELOP
+            }
+            sp--;
+        }
+        if (logical)
+            LOGICAL(res)[i] = ISNAN(stack[0]) ? NA_LOGICAL : (int)stack[0];
+        else
+            REAL(res)[i] = stack[0];
+    }
+    UNPROTECT(1);
+    return res;
+}
+
+// Evaluates a fused kernel operation by operation with the builtins
+static SEXP fusedFallback(SEXP kernel, SEXP* args, SEXP call) {
+    // Indexed by FusedOp
+    static const char* names[] = {nullptr, "+",    "-",   "*",  "/",
+                                  "<",     ">",    "<=",  ">=", "==",
+                                  "!=",    "sqrt", "exp", "abs"};
+    static SEXP prims[sizeof(names) / sizeof(names[0])] = {};
+
+    const int* prog = INTEGER(kernel);
+    int progLength = LENGTH(kernel);
+    SEXP stack = PROTECT(Rf_allocVector(VECSXP, MAX_FUSED_DEPTH));
+    size_t sp = 0;
+    for (int k = 0; k < progLength; ++k) {
+        auto op = static_cast<FusedOp>(prog[k]);
+        if (op == FusedOp::Arg) {
+            SET_VECTOR_ELT(stack, sp++, args[prog[++k]]);
+            continue;
+        }
+
+        auto idx = static_cast<int>(op);
+        if (!prims[idx]) {
+            // The kernel was fused from the base functions, user definitions
+            // of the same name must not be picked up. Bindings of base live
+            // in the symbol.
+            prims[idx] = SYMVALUE(Rf_install(names[idx]));
+            assert(TYPEOF(prims[idx]) == BUILTINSXP);
+        }
+        SEXP prim = prims[idx];
+
+        SEXP arglist;
+        if (op >= FusedOp::Sqrt) {
+            arglist = CONS_NR(VECTOR_ELT(stack, sp - 1), R_NilValue);
+            sp--;
+        } else {
+            arglist = CONS_NR(VECTOR_ELT(stack, sp - 2),
+                              CONS_NR(VECTOR_ELT(stack, sp - 1), R_NilValue));
+            sp -= 2;
+        }
+        PROTECT(arglist);
+        SET_VECTOR_ELT(stack, sp++,
+                       getBuiltin(prim)(call, prim, arglist, R_BaseEnv));
+        UNPROTECT(1);
+    }
+    SEXP res = VECTOR_ELT(stack, 0);
+    UNPROTECT(1);
+    return res;
+}
+
 static SEXP seq_int(int n1, int n2) {
     int n = n1 <= n2 ? n2 - n1 + 1 : n1 - n2 + 1;
     SEXP ans = Rf_allocVector(INTSXP, n);
@@ -1270,6 +2322,44 @@ static SEXP seq_int(int n1, int n2) {
     return ans;
 }
 
+// Stores the scalar val into vec[i], if this needs no coercion of vec.
+// Returns false if the generic subassign has to handle it.
+static RIR_INLINE bool setVectorElt(SEXP vec, R_xlen_t i, SEXP val) {
+    switch (TYPEOF(vec)) {
+    case REALSXP:
+        switch (TYPEOF(val)) {
+        case REALSXP:
+            REAL(vec)[i] = *REAL(val);
+            return true;
+        case INTSXP:
+        case LGLSXP:
+            REAL(vec)[i] =
+                *INTEGER(val) == NA_INTEGER ? NA_REAL : *INTEGER(val);
+            return true;
+        default:
+            return false;
+        }
+    case INTSXP:
+        if (TYPEOF(val) != INTSXP && TYPEOF(val) != LGLSXP)
+            return false;
+        INTEGER(vec)[i] = *INTEGER(val);
+        return true;
+    case LGLSXP:
+        if (TYPEOF(val) != LGLSXP)
+            return false;
+        LOGICAL(vec)[i] = *LOGICAL(val);
+        return true;
+    case VECSXP:
+        // Avoid recursive vectors
+        if (val == vec)
+            val = Rf_shallow_duplicate(val);
+        SET_VECTOR_ELT(vec, i, val);
+        return true;
+    default:
+        return false;
+    }
+}
+
 RIR_INLINE static void castInt(bool ceil_, Code* c, Opcode* pc,
                                InterpreterInstance* ctx) {
     SEXP val = ostack_top(ctx);
@@ -1350,6 +2440,7 @@ RIR_INLINE static void castInt(bool ceil_, Code* c, Opcode* pc,
     *INTEGER(res) = x;
     ostack_pop(ctx);
     ostack_push(ctx, res);
+    RECORD_ALLOCATION(c, pc, res);
 }
 
 #pragma GCC diagnostic push
@@ -1635,6 +2726,8 @@ SEXP evalRirCode(Code* c, InterpreterInstance* ctx, SEXP env,
             }
             ostack_push(ctx, res);
             UNPROTECT(1);
+            RECORD_ALLOCATION(c, pc, res);
+            RECORD_NODE_ALLOCATIONS(c, pc, n);
 
 #ifdef ENABLE_EVENT_COUNTERS
             if (ENABLE_EVENT_COUNTERS)
@@ -1669,11 +2762,12 @@ SEXP evalRirCode(Code* c, InterpreterInstance* ctx, SEXP env,
             auto names = pc;
             advanceImmediateN(n);
             SEXP wrapper = Rf_allocVector(
-                EXTERNALSXP, sizeof(LazyEnvironment) + sizeof(SEXP) * (n + 1));
+                EXTERNALSXP, sizeof(LazyEnvironment) + sizeof(SEXP) * (n + 2));
             new (DATAPTR(wrapper))
-                LazyEnvironment(parent, (Immediate*)names, n, localsBase, ctx);
+                LazyEnvironment(parent, (Immediate*)names, n, ctx, c, pc);
 
             ostack_push(ctx, wrapper);
+            RECORD_ALLOCATION(c, pc, wrapper);
             if (contextPos > 0) {
                 if (auto cptr = getFunctionContext(contextPos - 1))
                     cptr->cloenv = wrapper;
@@ -1818,12 +2912,13 @@ SEXP evalRirCode(Code* c, InterpreterInstance* ctx, SEXP env,
             auto le = LazyEnvironment::check(env);
             assert(le);
 
-            auto res = le->getArg(pos);
+            auto res = lazyEnvGetVar(le, pos);
 
             if (res == R_UnboundValue) {
                 Rf_error("object \"%s\" not found",
                          CHAR(PRINTNAME(Pool::get(le->names[pos]))));
-            } else if (res == R_MissingArg) {
+            } else if (res == R_MissingArg &&
+                       Pool::get(le->names[pos]) != R_DotsSymbol) {
                 Rf_error("argument \"%s\" is missing, with no default",
                          CHAR(PRINTNAME(Pool::get(le->names[pos]))));
             }
@@ -1891,7 +2986,8 @@ SEXP evalRirCode(Code* c, InterpreterInstance* ctx, SEXP env,
 
             if (res == R_UnboundValue) {
                 Rf_error("object \"%s\" not found", CHAR(PRINTNAME(sym)));
-            } else if (res == R_MissingArg) {
+            } else if (res == R_MissingArg && sym != R_DotsSymbol) {
+                // An empty `...` is missing, optimized code forwards it as is
                 Rf_error("argument \"%s\" is missing, with no default",
                          CHAR(PRINTNAME(sym)));
             }
@@ -1913,7 +3009,8 @@ SEXP evalRirCode(Code* c, InterpreterInstance* ctx, SEXP env,
             if (res == R_UnboundValue) {
                 SEXP sym = cp_pool_at(ctx, id);
                 Rf_error("object \"%s\" not found", CHAR(PRINTNAME(sym)));
-            } else if (res == R_MissingArg) {
+            } else if (res == R_MissingArg &&
+                       cp_pool_at(ctx, id) != R_DotsSymbol) {
                 SEXP sym = cp_pool_at(ctx, id);
                 Rf_error("argument \"%s\" is missing, with no default",
                          CHAR(PRINTNAME(sym)));
@@ -1996,7 +3093,9 @@ SEXP evalRirCode(Code* c, InterpreterInstance* ctx, SEXP env,
             advanceImmediate();
             assert(callCtxt);
 
-            if (callCtxt->hasStackArgs()) {
+            if (callCtxt->dots && idx == callCtxt->dotsIdx) {
+                ostack_push(ctx, callCtxt->dots);
+            } else if (callCtxt->hasStackArgs()) {
                 ostack_push(ctx, callCtxt->stackArg(idx));
             } else {
                 if (callCtxt->missingArg(idx)) {
@@ -2005,6 +3104,7 @@ SEXP evalRirCode(Code* c, InterpreterInstance* ctx, SEXP env,
                     Code* arg = callCtxt->implicitArg(idx);
                     assert(!LazyEnvironment::check(callCtxt->callerEnv));
                     res = createPromise(arg, callCtxt->callerEnv);
+                    RECORD_ALLOCATION(c, pc, res);
                 }
                 ostack_push(ctx, res);
             }
@@ -2014,8 +3114,12 @@ SEXP evalRirCode(Code* c, InterpreterInstance* ctx, SEXP env,
         INSTRUCTION(ldloc_) {
             Immediate offset = readImmediate();
             advanceImmediate();
+#ifdef TYPED_STACK
+            ostack_push_cell(ctx, locals.cell(offset));
+#else
             res = locals.load(offset);
             ostack_push(ctx, res);
+#endif
             NEXT();
         }
 
@@ -2026,7 +3130,7 @@ SEXP evalRirCode(Code* c, InterpreterInstance* ctx, SEXP env,
 
             auto le = LazyEnvironment::check(env);
             assert(le);
-            le->setArg(pos, val);
+            lazyEnvSetVar(le, pos, val);
             ostack_pop(ctx);
             NEXT();
         }
@@ -2040,6 +3144,7 @@ SEXP evalRirCode(Code* c, InterpreterInstance* ctx, SEXP env,
             assert(!LazyEnvironment::check(env));
 
             rirDefineVarWrapper(sym, val, env);
+            noteStore(env);
             ostack_pop(ctx);
             NEXT();
         }
@@ -2054,6 +3159,7 @@ SEXP evalRirCode(Code* c, InterpreterInstance* ctx, SEXP env,
             assert(!LazyEnvironment::check(env));
 
             cachedSetVar(val, env, id, cacheIndex, ctx, bindingCache);
+            noteStore(env);
             NEXT();
         }
 
@@ -2105,14 +3211,24 @@ SEXP evalRirCode(Code* c, InterpreterInstance* ctx, SEXP env,
             advanceImmediate();
             SLOWASSERT(TYPEOF(sym) == SYMSXP);
             SEXP val = ostack_pop(ctx);
-            rirSetVarWrapper(sym, val, ENCLOS(env));
+            SEXP parent = ENCLOS(env);
+            // Unless the binding is in the parent, we do not know where it
+            // ends up
+            if (HASHTAB(parent) != R_NilValue ||
+                !R_existsVarInFrame(parent, sym))
+                ++S3MethodCache::epoch;
+            rirSetVarWrapper(sym, val, parent);
             NEXT();
         }
 
         INSTRUCTION(stloc_) {
             Immediate offset = readImmediate();
             advanceImmediate();
+#ifdef TYPED_STACK
+            *locals.cell(offset) = *ostack_cell_at(ctx, 0);
+#else
             locals.store(offset, ostack_top(ctx));
+#endif
             ostack_pop(ctx);
             NEXT();
         }
@@ -2122,7 +3238,11 @@ SEXP evalRirCode(Code* c, InterpreterInstance* ctx, SEXP env,
             advanceImmediate();
             Immediate source = readImmediate();
             advanceImmediate();
+#ifdef TYPED_STACK
+            *locals.cell(target) = *locals.cell(source);
+#else
             locals.store(target, locals.load(source));
+#endif
             NEXT();
         }
 
@@ -2294,7 +3414,9 @@ SEXP evalRirCode(Code* c, InterpreterInstance* ctx, SEXP env,
                              given, ctx);
             auto fun = Function::unpack(version);
             addDynamicAssumptionsFromContext(call);
-            bool dispatchFail = !fun->dead && !matches(call, fun->signature());
+            bool dispatchFail =
+                (!fun->dead && !matches(call, fun->signature())) ||
+                !fun->dependenciesValid();
             if (fun->invocationCount() % pir::Parameter::RIR_WARMUP == 0) {
                 Assumptions assumptions =
                     addDynamicAssumptionsForOneTarget(call, fun->signature());
@@ -2311,16 +3433,23 @@ SEXP evalRirCode(Code* c, InterpreterInstance* ctx, SEXP env,
             }
             advanceImmediate();
 
-            if (fun->signature().envCreation ==
-                FunctionSignature::Environment::CallerProvided) {
+            bool callerEnv = fun->signature().envCreation ==
+                             FunctionSignature::Environment::CallerProvided;
+            boxStackPromises(call, callerEnv
+                                       ? 0
+                                       : fun->signature().nonEscapingArgs);
+            if (callerEnv) {
                 res = doCall(call, ctx);
             } else {
                 ArgsLazyData lazyArgs(&call, ctx);
                 fun->registerInvocation();
                 supplyMissingArgs(call, fun);
+                PROTECT(packDotsArgs(call, fun, nullptr));
                 res = rirCallTrampoline(call, fun, symbol::delayedEnv,
                                         (SEXP)&lazyArgs, ctx);
+                UNPROTECT(1);
             }
+            freeStackPromises(call);
             ostack_popn(ctx, call.passedArgs);
             ostack_push(ctx, res);
 
@@ -2342,6 +3471,7 @@ SEXP evalRirCode(Code* c, InterpreterInstance* ctx, SEXP env,
             Rf_setAttrib(res, Rf_install("srcref"), srcref);
             ostack_popn(ctx, 3);
             ostack_push(ctx, res);
+            RECORD_ALLOCATION(c, pc, res);
             NEXT();
         }
 
@@ -2369,6 +3499,22 @@ SEXP evalRirCode(Code* c, InterpreterInstance* ctx, SEXP env,
             SEXP prom = Rf_mkPROMISE(c->getPromise(id)->container(), env);
             SET_PRVALUE(prom, ostack_pop(ctx));
             ostack_push(ctx, prom);
+            RECORD_ALLOCATION(c, pc, prom);
+            NEXT();
+        }
+
+        INSTRUCTION(stack_promise_) {
+            Immediate id = readImmediate();
+            advanceImmediate();
+            SEXP code = c->getPromise(id)->container();
+            SEXP prom = STACK_PROMISES.alloc(code, ostack_top(ctx));
+            if (!prom) {
+                prom = Rf_mkPROMISE(code, env);
+                SET_PRVALUE(prom, ostack_top(ctx));
+                RECORD_ALLOCATION(c, pc, prom);
+            }
+            ostack_pop(ctx);
+            ostack_push(ctx, prom);
             NEXT();
         }
 
@@ -2398,13 +3544,22 @@ SEXP evalRirCode(Code* c, InterpreterInstance* ctx, SEXP env,
         }
 
         INSTRUCTION(dup_) {
+#ifdef TYPED_STACK
+            ostack_push_cell(ctx, ostack_cell_at(ctx, 0));
+#else
             ostack_push(ctx, ostack_top(ctx));
+#endif
             NEXT();
         }
 
         INSTRUCTION(dup2_) {
+#ifdef TYPED_STACK
+            ostack_push_cell(ctx, ostack_cell_at(ctx, 1));
+            ostack_push_cell(ctx, ostack_cell_at(ctx, 1));
+#else
             ostack_push(ctx, ostack_at(ctx, 1));
             ostack_push(ctx, ostack_at(ctx, 1));
+#endif
             NEXT();
         }
 
@@ -2421,10 +3576,16 @@ SEXP evalRirCode(Code* c, InterpreterInstance* ctx, SEXP env,
         }
 
         INSTRUCTION(swap_) {
+#ifdef TYPED_STACK
+            R_bcstack_t tmp = *ostack_cell_at(ctx, 0);
+            *ostack_cell_at(ctx, 0) = *ostack_cell_at(ctx, 1);
+            *ostack_cell_at(ctx, 1) = tmp;
+#else
             SEXP lhs = ostack_pop(ctx);
             SEXP rhs = ostack_pop(ctx);
             ostack_push(ctx, lhs);
             ostack_push(ctx, rhs);
+#endif
             NEXT();
         }
 
@@ -2433,12 +3594,12 @@ SEXP evalRirCode(Code* c, InterpreterInstance* ctx, SEXP env,
             advanceImmediate();
             R_bcstack_t* pos = ostack_cell_at(ctx, 0);
 #ifdef TYPED_STACK
-            SEXP val = pos->u.sxpval;
+            R_bcstack_t val = *pos;
             while (i--) {
-                pos->u.sxpval = (pos - 1)->u.sxpval;
+                *pos = *(pos - 1);
                 pos--;
             }
-            pos->u.sxpval = val;
+            *pos = val;
 #else
             SEXP val = *pos;
             while (i--) {
@@ -2455,12 +3616,12 @@ SEXP evalRirCode(Code* c, InterpreterInstance* ctx, SEXP env,
             advanceImmediate();
             R_bcstack_t* pos = ostack_cell_at(ctx, i);
 #ifdef TYPED_STACK
-            SEXP val = pos->u.sxpval;
+            R_bcstack_t val = *pos;
             while (i--) {
-                pos->u.sxpval = (pos + 1)->u.sxpval;
+                *pos = *(pos + 1);
                 pos++;
             }
-            pos->u.sxpval = val;
+            *pos = val;
 #else
             SEXP val = *pos;
             while (i--) {
@@ -2475,8 +3636,12 @@ SEXP evalRirCode(Code* c, InterpreterInstance* ctx, SEXP env,
         INSTRUCTION(pull_) {
             Immediate i = readImmediate();
             advanceImmediate();
+#ifdef TYPED_STACK
+            ostack_push_cell(ctx, ostack_cell_at(ctx, i));
+#else
             SEXP val = ostack_at(ctx, i);
             ostack_push(ctx, val);
+#endif
             NEXT();
         }
 
@@ -2502,6 +3667,7 @@ SEXP evalRirCode(Code* c, InterpreterInstance* ctx, SEXP env,
                 SEXP n = Rf_allocVector(INTSXP, 1);
                 INTEGER(n)[0] = i + 1;
                 ostack_push(ctx, n);
+                RECORD_ALLOCATION(c, pc, n);
             } else {
                 INTEGER(val)[0]++;
             }
@@ -2517,6 +3683,7 @@ SEXP evalRirCode(Code* c, InterpreterInstance* ctx, SEXP env,
                 SEXP n = Rf_allocVector(INTSXP, 1);
                 INTEGER(n)[0] = i - 1;
                 ostack_push(ctx, n);
+                RECORD_ALLOCATION(c, pc, n);
             } else {
                 INTEGER(val)[0]--;
             }
@@ -2717,6 +3884,141 @@ SEXP evalRirCode(Code* c, InterpreterInstance* ctx, SEXP env,
             NEXT();
         }
 
+        INSTRUCTION(box_) {
+#ifdef TYPED_STACK
+            R_bcstack_t* cell = ostack_cell_at(ctx, 0);
+            switch (cell->tag) {
+            case 0:
+                break;
+            case LGLSXP:
+                ostack_set(ctx, 0, Rf_ScalarLogical(cell->u.ival));
+                break;
+            case INTSXP:
+                res = Rf_ScalarInteger(cell->u.ival);
+                RECORD_ALLOCATION(c, pc, res);
+                ostack_set(ctx, 0, res);
+                break;
+            case REALSXP:
+                res = Rf_ScalarReal(cell->u.dval);
+                RECORD_ALLOCATION(c, pc, res);
+                ostack_set(ctx, 0, res);
+                break;
+            default:
+                assert(false);
+            }
+#else
+            assert(false && "unboxed values need a typed stack");
+#endif
+            NEXT();
+        }
+
+        INSTRUCTION(unbox_) {
+#ifdef TYPED_STACK
+            R_bcstack_t* cell = ostack_cell_at(ctx, 0);
+            if (cell->tag == 0) {
+                SEXP val = cell->u.sxpval;
+                switch (TYPEOF(val)) {
+                case LGLSXP:
+                case INTSXP:
+                    setUnboxedInt(cell, TYPEOF(val), INTEGER(val)[0]);
+                    break;
+                case REALSXP:
+                    setUnboxedReal(cell, REAL(val)[0]);
+                    break;
+                default:
+                    assert(false);
+                }
+            }
+#else
+            assert(false && "unboxed values need a typed stack");
+#endif
+            NEXT();
+        }
+
+#ifdef TYPED_STACK
+#define UNBOXED_BINOP(name, op, op2)                                           \
+    INSTRUCTION(name) {                                                        \
+        DO_UNBOXED_BINOP(op, op2);                                             \
+        NEXT();                                                                \
+    }
+#define UNBOXED_RELOP(name, op)                                                \
+    INSTRUCTION(name) {                                                        \
+        DO_UNBOXED_RELOP(op);                                                  \
+        NEXT();                                                                \
+    }
+#else
+#define UNBOXED_BINOP(name, op, op2)                                           \
+    INSTRUCTION(name) {                                                        \
+        assert(false && "unboxed values need a typed stack");                  \
+        NEXT();                                                                \
+    }
+#define UNBOXED_RELOP(name, op) UNBOXED_BINOP(name, op, 0)
+#endif
+        UNBOXED_BINOP(add_unboxed_, +, PLUSOP)
+        UNBOXED_BINOP(sub_unboxed_, -, MINUSOP)
+        UNBOXED_BINOP(mul_unboxed_, *, TIMESOP)
+        UNBOXED_RELOP(lt_unboxed_, <)
+        UNBOXED_RELOP(gt_unboxed_, >)
+        UNBOXED_RELOP(le_unboxed_, <=)
+        UNBOXED_RELOP(ge_unboxed_, >=)
+        UNBOXED_RELOP(eq_unboxed_, ==)
+        UNBOXED_RELOP(ne_unboxed_, !=)
+#undef UNBOXED_BINOP
+#undef UNBOXED_RELOP
+
+        INSTRUCTION(div_unboxed_) {
+#ifdef TYPED_STACK
+            // Division always produces a real, also for integers
+            R_bcstack_t* lhs = ostack_cell_at(ctx, 1);
+            double l = unboxedReal(lhs);
+            double r = unboxedReal(ostack_cell_at(ctx, 0));
+            setUnboxedReal(lhs, l / r);
+            ostack_popn(ctx, 1);
+#else
+            assert(false && "unboxed values need a typed stack");
+#endif
+            NEXT();
+        }
+
+        INSTRUCTION(inc_unboxed_) {
+#ifdef TYPED_STACK
+            SLOWASSERT(ostack_cell_at(ctx, 0)->tag == INTSXP);
+            ostack_cell_at(ctx, 0)->u.ival++;
+#else
+            assert(false && "unboxed values need a typed stack");
+#endif
+            NEXT();
+        }
+
+        INSTRUCTION(dec_unboxed_) {
+#ifdef TYPED_STACK
+            SLOWASSERT(ostack_cell_at(ctx, 0)->tag == INTSXP);
+            ostack_cell_at(ctx, 0)->u.ival--;
+#else
+            assert(false && "unboxed values need a typed stack");
+#endif
+            NEXT();
+        }
+
+        INSTRUCTION(fused_) {
+            Opcode* fusedPc = pc - 1;
+            Immediate n = readImmediate();
+            advanceImmediate();
+            assert(n <= MAX_FUSED_OPERANDS);
+            SEXP kernel = ostack_at(ctx, 0);
+            SEXP args[MAX_FUSED_OPERANDS];
+            for (size_t i = 0; i < n; ++i)
+                args[i] = ostack_at(ctx, n - i);
+            res = fusedFastPath(kernel, args, n);
+            if (!res)
+                res = fusedFallback(kernel, args,
+                                    getSrcForCall(c, fusedPc, ctx));
+            R_Visible = TRUE;
+            ostack_popn(ctx, n + 1);
+            ostack_push(ctx, res);
+            NEXT();
+        }
+
         INSTRUCTION(identical_noforce_) {
             SEXP rhs = ostack_pop(ctx);
             SEXP lhs = ostack_pop(ctx);
@@ -2824,6 +4126,7 @@ SEXP evalRirCode(Code* c, InterpreterInstance* ctx, SEXP env,
             res = Rf_ScalarLogical(x1);
             ostack_pop(ctx);
             ostack_push(ctx, res);
+            RECORD_ALLOCATION(c, pc, res);
             NEXT();
         }
 
@@ -2940,8 +4243,17 @@ SEXP evalRirCode(Code* c, InterpreterInstance* ctx, SEXP env,
 
         INSTRUCTION(isstubenv_) {
             SEXP val = ostack_pop(ctx);
-            ostack_push(
-                ctx, LazyEnvironment::check(val) ? R_TrueValue : R_FalseValue);
+            auto le = LazyEnvironment::check(val);
+            ostack_push(ctx, le && !le->materialized() ? R_TrueValue
+                                                        : R_FalseValue);
+            NEXT();
+        }
+
+        INSTRUCTION(check_dependencies_) {
+            SEXP deps = readConst(ctx, readImmediate());
+            advanceImmediate();
+            ostack_push(ctx, Function::dependenciesValid(deps) ? R_TrueValue
+                                                               : R_FalseValue);
             NEXT();
         }
 
@@ -3034,6 +4346,7 @@ SEXP evalRirCode(Code* c, InterpreterInstance* ctx, SEXP env,
 
             SEXP args = CONS_NR(val, CONS_NR(idx, R_NilValue));
             ostack_push(ctx, args);
+            RECORD_NODE_ALLOCATIONS(c, pc, 2);
 
             if (isObject(val)) {
                 SEXP call = getSrcForCall(c, pc - 1, ctx);
@@ -3058,6 +4371,7 @@ SEXP evalRirCode(Code* c, InterpreterInstance* ctx, SEXP env,
 
             SEXP args = CONS_NR(val, CONS_NR(idx, CONS_NR(idx2, R_NilValue)));
             ostack_push(ctx, args);
+            RECORD_NODE_ALLOCATIONS(c, pc, 3);
 
             if (isObject(val)) {
                 SEXP call = getSrcForCall(c, pc - 1, ctx);
@@ -3118,6 +4432,7 @@ SEXP evalRirCode(Code* c, InterpreterInstance* ctx, SEXP env,
             vecaccess(res)[0] = vecaccess(val)[i];                             \
         } else {                                                               \
             res = Rf_allocVector(vectype, 1);                                  \
+            RECORD_ALLOCATION(c, pc, res);                                     \
             vecaccess(res)[0] = vecaccess(val)[i];                             \
         }                                                                      \
         break;                                                                 \
@@ -3146,6 +4461,7 @@ SEXP evalRirCode(Code* c, InterpreterInstance* ctx, SEXP env,
         fallback : {
             SEXP args = CONS_NR(val, CONS_NR(idx, R_NilValue));
             ostack_push(ctx, args);
+            RECORD_NODE_ALLOCATIONS(c, pc, 2);
             if (isObject(val)) {
                 SEXP call = getSrcAt(c, pc - 1, ctx);
                 res = dispatchApply(call, val, args, symbol::DoubleBracket, env,
@@ -3164,6 +4480,63 @@ SEXP evalRirCode(Code* c, InterpreterInstance* ctx, SEXP env,
         }
         }
 
+        INSTRUCTION(extract2_1_unchecked_) {
+            // PIR proved that val is a non-object vector of a simple type and
+            // idx a numeric scalar within its bounds.
+            SEXP val = ostack_at(ctx, 1);
+            SEXP idx = ostack_at(ctx, 0);
+            R_xlen_t i = (TYPEOF(idx) == INTSXP ? (R_xlen_t)*INTEGER(idx)
+                                                : (R_xlen_t)*REAL(idx)) -
+                         1;
+            SLOWASSERT(!isObject(val) && i >= 0 && i < XLENGTH(val));
+
+            // PIR does not know about attributes, leave them to the default
+            // implementation like extract2_1_
+            if (ATTRIB(val) != R_NilValue || ATTRIB(idx) != R_NilValue) {
+                SEXP args = CONS_NR(val, CONS_NR(idx, R_NilValue));
+                ostack_push(ctx, args);
+                RECORD_NODE_ALLOCATIONS(c, pc, 2);
+                res = do_subset2_dflt(R_NilValue, symbol::DoubleBracket, args,
+                                      env);
+                ostack_popn(ctx, 3);
+                ostack_push(ctx, res);
+                R_Visible = (Rboolean) true;
+                NEXT();
+            }
+
+            switch (TYPEOF(val)) {
+
+#define SIMPLECASE(vectype, vecaccess)                                         \
+    case vectype: {                                                            \
+        if (XLENGTH(val) == 1 && NO_REFERENCES(val)) {                         \
+            res = val;                                                         \
+        } else {                                                               \
+            res = Rf_allocVector(vectype, 1);                                  \
+            RECORD_ALLOCATION(c, pc, res);                                     \
+            vecaccess(res)[0] = vecaccess(val)[i];                             \
+        }                                                                      \
+        break;                                                                 \
+    }
+
+                SIMPLECASE(REALSXP, REAL);
+                SIMPLECASE(INTSXP, INTEGER);
+                SIMPLECASE(LGLSXP, LOGICAL);
+#undef SIMPLECASE
+
+            case VECSXP:
+                res = VECTOR_ELT(val, i);
+                break;
+
+            default:
+                assert(false);
+            }
+
+            ostack_popn(ctx, 2);
+            ostack_push(ctx, res);
+            R_Visible = (Rboolean) true;
+            NEXT();
+        }
+
         INSTRUCTION(extract2_2_) {
             SEXP val = ostack_at(ctx, 2);
             SEXP idx = ostack_at(ctx, 1);
@@ -3171,6 +4544,7 @@ SEXP evalRirCode(Code* c, InterpreterInstance* ctx, SEXP env,
 
             SEXP args = CONS_NR(val, CONS_NR(idx, CONS_NR(idx2, R_NilValue)));
             ostack_push(ctx, args);
+            RECORD_NODE_ALLOCATIONS(c, pc, 3);
 
             if (isObject(val)) {
                 SEXP call = getSrcForCall(c, pc - 1, ctx);
@@ -3189,6 +4563,27 @@ SEXP evalRirCode(Code* c, InterpreterInstance* ctx, SEXP env,
             NEXT();
         }
 
+        INSTRUCTION(subassign1_1_unchecked_) {
+            // PIR proved that idx is a numeric scalar within the bounds of
+            // vec. We only handle updating a scalar cell in place here.
+            SEXP idx = ostack_at(ctx, 0);
+            SEXP vec = ostack_at(ctx, 1);
+            SEXP val = ostack_at(ctx, 2);
+
+            if (NOT_SHARED(vec) && !isObject(vec) && TYPEOF(vec) != VECSXP &&
+                XLENGTH(val) == 1) {
+                R_xlen_t i = (TYPEOF(idx) == INTSXP ? (R_xlen_t)*INTEGER(idx)
+                                                    : (R_xlen_t)*REAL(idx)) -
+                             1;
+                if (setVectorElt(vec, i, val)) {
+                    ostack_popn(ctx, 3);
+                    ostack_push(ctx, vec);
+                    NEXT();
+                }
+            }
+            // fall through to the generic implementation
+        }
+
         INSTRUCTION(subassign1_1_) {
             SEXP idx = ostack_at(ctx, 0);
             SEXP vec = ostack_at(ctx, 1);
@@ -3200,11 +4595,13 @@ SEXP evalRirCode(Code* c, InterpreterInstance* ctx, SEXP env,
             if (MAYBE_SHARED(vec)) {
                 vec = Rf_duplicate(vec);
                 ostack_set(ctx, 1, vec);
+                RECORD_ALLOCATION(c, pc, vec);
             }
 
             SEXP args = CONS_NR(vec, CONS_NR(idx, CONS_NR(val, R_NilValue)));
             SET_TAG(CDDR(args), symbol::value);
             PROTECT(args);
+            RECORD_NODE_ALLOCATIONS(c, pc, 3);
 
             res = nullptr;
             SEXP call = getSrcForCall(c, pc - 1, ctx);
@@ -3241,12 +4638,14 @@ SEXP evalRirCode(Code* c, InterpreterInstance* ctx, SEXP env,
             if (MAYBE_SHARED(mtx)) {
                 mtx = Rf_duplicate(mtx);
                 ostack_set(ctx, 2, mtx);
+                RECORD_ALLOCATION(c, pc, mtx);
             }
 
             SEXP args = CONS_NR(
                 mtx, CONS_NR(idx1, CONS_NR(idx2, CONS_NR(val, R_NilValue))));
             SET_TAG(CDDDR(args), symbol::value);
             PROTECT(args);
+            RECORD_NODE_ALLOCATIONS(c, pc, 4);
 
             res = nullptr;
             SEXP call = getSrcForCall(c, pc - 1, ctx);
@@ -3272,6 +4671,28 @@ SEXP evalRirCode(Code* c, InterpreterInstance* ctx, SEXP env,
             NEXT();
         }
 
+        INSTRUCTION(subassign2_1_unchecked_) {
+            // PIR proved that idx is a numeric scalar within the bounds of
+            // vec. We only handle updating a cell in place here.
+            SEXP idx = ostack_at(ctx, 0);
+            SEXP vec = ostack_at(ctx, 1);
+            SEXP val = ostack_at(ctx, 2);
+
+            if (NOT_SHARED(vec) && !isObject(vec) &&
+                (TYPEOF(vec) == VECSXP ? val != R_NilValue
+                                       : XLENGTH(val) == 1)) {
+                R_xlen_t i = (TYPEOF(idx) == INTSXP ? (R_xlen_t)*INTEGER(idx)
+                                                    : (R_xlen_t)*REAL(idx)) -
+                             1;
+                if (setVectorElt(vec, i, val)) {
+                    ostack_popn(ctx, 3);
+                    ostack_push(ctx, vec);
+                    NEXT();
+                }
+            }
+            // fall through to the generic implementation
+        }
+
         INSTRUCTION(subassign2_1_) {
             SEXP idx = ostack_at(ctx, 0);
             SEXP vec = ostack_at(ctx, 1);
@@ -3338,11 +4759,13 @@ SEXP evalRirCode(Code* c, InterpreterInstance* ctx, SEXP env,
             if (MAYBE_SHARED(vec)) {
                 vec = Rf_duplicate(vec);
                 ostack_set(ctx, 1, vec);
+                RECORD_ALLOCATION(c, pc, vec);
             }
 
             SEXP args = CONS_NR(vec, CONS_NR(idx, CONS_NR(val, R_NilValue)));
             SET_TAG(CDDR(args), symbol::value);
             PROTECT(args);
+            RECORD_NODE_ALLOCATIONS(c, pc, 3);
 
             res = nullptr;
             SEXP call = getSrcForCall(c, pc - 1, ctx);
@@ -3452,12 +4875,14 @@ SEXP evalRirCode(Code* c, InterpreterInstance* ctx, SEXP env,
             if (MAYBE_SHARED(mtx)) {
                 mtx = Rf_duplicate(mtx);
                 ostack_set(ctx, 2, mtx);
+                RECORD_ALLOCATION(c, pc, mtx);
             }
 
             SEXP args = CONS_NR(
                 mtx, CONS_NR(idx1, CONS_NR(idx2, CONS_NR(val, R_NilValue))));
             SET_TAG(CDDDR(args), symbol::value);
             PROTECT(args);
+            RECORD_NODE_ALLOCATIONS(c, pc, 4);
 
             res = nullptr;
             SEXP call = getSrcForCall(c, pc - 1, ctx);
@@ -3575,12 +5000,15 @@ SEXP evalRirCode(Code* c, InterpreterInstance* ctx, SEXP env,
                 }
             }
 
-            if (!res) {
+            if (res) {
+                RECORD_ALLOCATION(c, pc, res);
+            } else {
                 SLOWASSERT(!isObject(from));
                 SEXP call = getSrcForCall(c, pc - 1, ctx);
                 SEXP argslist =
                     CONS_NR(from, CONS_NR(to, CONS_NR(by, R_NilValue)));
                 ostack_push(ctx, argslist);
+                RECORD_NODE_ALLOCATIONS(c, pc, 3);
                 res = Rf_applyClosure(call, prim, argslist, env, R_NilValue);
                 ostack_pop(ctx);
             }
@@ -3632,6 +5060,7 @@ SEXP evalRirCode(Code* c, InterpreterInstance* ctx, SEXP env,
 
             if (res != NULL) {
                 R_Visible = (Rboolean) true;
+                RECORD_ALLOCATION(c, pc, res);
             } else {
                 BINOP_FALLBACK(":");
             }
@@ -3660,6 +5089,7 @@ SEXP evalRirCode(Code* c, InterpreterInstance* ctx, SEXP env,
             advanceImmediate();
             res = Rf_allocVector(type, INTEGER(val)[0]);
             ostack_push(ctx, res);
+            RECORD_ALLOCATION(c, pc, res);
             NEXT();
         }
 
@@ -3668,6 +5098,7 @@ SEXP evalRirCode(Code* c, InterpreterInstance* ctx, SEXP env,
             R_xlen_t len = XLENGTH(val);
             ostack_push(ctx, Rf_allocVector(INTSXP, 1));
             INTEGER(ostack_top(ctx))[0] = len;
+            RECORD_ALLOCATION(c, pc, ostack_top(ctx));
             NEXT();
         }
 
@@ -3688,12 +5119,16 @@ SEXP evalRirCode(Code* c, InterpreterInstance* ctx, SEXP env,
             // BC on it, we would. To prevent this we strip the object
             // flag here. What we should do instead, is use a non-dispatching
             // extract BC.
-            if (isObject(seq)) {
+            bool duplicated = isObject(seq);
+            if (duplicated) {
                 seq = Rf_duplicate(seq);
                 SET_OBJECT(seq, 0);
                 ostack_set(ctx, 0, seq);
             }
             ostack_push(ctx, value);
+            RECORD_ALLOCATION(c, pc, value);
+            if (duplicated)
+                RECORD_ALLOCATION(c, pc, seq);
             NEXT();
         }
 
@@ -3734,6 +5169,19 @@ SEXP evalRirCode(Code* c, InterpreterInstance* ctx, SEXP env,
 
         INSTRUCTION(endloop_) { return loopTrampolineMarker; }
 
+        INSTRUCTION(push_loop_context_) {
+            pc = loopContextTrampoline(c, ctx, env, callCtxt, pc, localsBase,
+                                       bindingCache);
+            checkUserInterrupt();
+            NEXT();
+        }
+
+        INSTRUCTION(pop_loop_context_) {
+            ostack_pop(ctx);
+            // Not a SEXP, loopContextTrampoline continues at this pc
+            return reinterpret_cast<SEXP>(pc);
+        }
+
         INSTRUCTION(return_) {
             res = ostack_top(ctx);
             // this restores stack pointer to the value from the target context
@@ -1,6 +1,7 @@
 #ifndef RIR_INTERPRETER_C_H
 #define RIR_INTERPRETER_C_H
 
+#include "LazyEnvironment.h"
 #include "builtins.h"
 #include "call_context.h"
 #include "instance.h"
@@ -31,10 +32,21 @@ inline RCNTXT* getFunctionContext(size_t pos = 0,
     return nullptr;
 }
 
+// A stub environment stays on the operand stack after it is materialized,
+// while the context might already refer to the materialized environment
+inline SEXP materializedEnv(SEXP e) {
+    if (auto le = LazyEnvironment::check(e))
+        if (auto env = le->materialized())
+            return env;
+    return e;
+}
+
 inline RCNTXT* findFunctionContextFor(SEXP e) {
+    e = materializedEnv(e);
     auto cptr = R_GlobalContext;
     while (cptr->nextcontext != NULL) {
-        if (cptr->callflag & CTXT_FUNCTION && cptr->cloenv == e) {
+        if (cptr->callflag & CTXT_FUNCTION &&
+            materializedEnv(cptr->cloenv) == e) {
             return cptr;
         }
         cptr = cptr->nextcontext;
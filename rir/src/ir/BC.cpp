@@ -42,6 +42,7 @@ BC_NOARGS(V, _)
     case Opcode::deopt_:
     case Opcode::ldfun_:
     case Opcode::ldddvar_:
+    case Opcode::check_dependencies_:
     case Opcode::ldvar_:
     case Opcode::ldvar_for_update_:
     case Opcode::ldvar_noforce_:
@@ -99,6 +100,7 @@ BC_NOARGS(V, _)
         break;
 
     case Opcode::promise_:
+    case Opcode::stack_promise_:
     case Opcode::push_code_:
         cs.insert(immediate.fun);
         return;
@@ -120,6 +122,7 @@ BC_NOARGS(V, _)
         return;
 
     case Opcode::popn_:
+    case Opcode::fused_:
     case Opcode::pick_:
     case Opcode::pull_:
     case Opcode::is_:
@@ -180,6 +183,7 @@ void BC::deserialize(SEXP refTable, R_inpstream_t inp, Opcode* code,
         case Opcode::push_:
         case Opcode::ldfun_:
         case Opcode::ldddvar_:
+        case Opcode::check_dependencies_:
         case Opcode::ldvar_:
         case Opcode::ldvar_for_update_:
         case Opcode::ldvar_noforce_:
@@ -273,6 +277,7 @@ void BC::deserialize(SEXP refTable, R_inpstream_t inp, Opcode* code,
         case Opcode::record_call_:
         case Opcode::record_type_:
         case Opcode::promise_:
+        case Opcode::stack_promise_:
         case Opcode::push_code_:
         case Opcode::br_:
         case Opcode::brtrue_:
@@ -281,6 +286,7 @@ void BC::deserialize(SEXP refTable, R_inpstream_t inp, Opcode* code,
         case Opcode::brobj_:
         case Opcode::brfalse_:
         case Opcode::popn_:
+        case Opcode::fused_:
         case Opcode::pick_:
         case Opcode::pull_:
         case Opcode::is_:
@@ -330,6 +336,7 @@ void BC::serialize(SEXP refTable, R_outpstream_t out, const Opcode* code,
         case Opcode::push_:
         case Opcode::ldfun_:
         case Opcode::ldddvar_:
+        case Opcode::check_dependencies_:
         case Opcode::ldvar_:
         case Opcode::ldvar_for_update_:
         case Opcode::ldvar_noforce_:
@@ -411,6 +418,7 @@ void BC::serialize(SEXP refTable, R_outpstream_t out, const Opcode* code,
         case Opcode::record_call_:
         case Opcode::record_type_:
         case Opcode::promise_:
+        case Opcode::stack_promise_:
         case Opcode::push_code_:
         case Opcode::br_:
         case Opcode::brtrue_:
@@ -419,6 +427,7 @@ void BC::serialize(SEXP refTable, R_outpstream_t out, const Opcode* code,
         case Opcode::brobj_:
         case Opcode::brfalse_:
         case Opcode::popn_:
+        case Opcode::fused_:
         case Opcode::pick_:
         case Opcode::pull_:
         case Opcode::is_:
@@ -561,6 +570,7 @@ void BC::print(std::ostream& out) const {
         break;
     }
     case Opcode::push_:
+    case Opcode::check_dependencies_:
         out << dumpSexp(immediateConst()).c_str();
         break;
     case Opcode::ldfun_:
@@ -591,6 +601,7 @@ void BC::print(std::ostream& out) const {
         break;
     }
     case Opcode::popn_:
+    case Opcode::fused_:
     case Opcode::pick_:
     case Opcode::pull_:
     case Opcode::put_:
@@ -643,6 +654,7 @@ BC_NOARGS(V, _)
 #undef V
         break;
     case Opcode::promise_:
+    case Opcode::stack_promise_:
     case Opcode::push_code_:
         out << std::hex << immediate.fun << std::dec;
         break;
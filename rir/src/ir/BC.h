@@ -29,6 +29,11 @@ BC BC::popn(unsigned n) {
     i.i = n;
     return BC(Opcode::popn_, i);
 }
+BC BC::fused(unsigned nargs) {
+    ImmediateArguments i;
+    i.i = nargs;
+    return BC(Opcode::fused_, i);
+}
 BC BC::push(SEXP constant) {
     assert(TYPEOF(constant) != PROMSXP);
     assert(!Code::check(constant));
@@ -57,6 +62,11 @@ BC BC::ldfun(SEXP sym) {
     i.pool = Pool::insert(sym);
     return BC(Opcode::ldfun_, i);
 }
+BC BC::checkDependencies(SEXP deps) {
+    ImmediateArguments i;
+    i.pool = Pool::insert(deps);
+    return BC(Opcode::check_dependencies_, i);
+}
 BC BC::ldddvar(SEXP sym) {
     assert(DDVAL(sym));
     ImmediateArguments i;
@@ -177,6 +187,11 @@ BC BC::promise(FunIdx prom) {
     i.fun = prom;
     return BC(Opcode::promise_, i);
 }
+BC BC::stackPromise(FunIdx prom) {
+    ImmediateArguments i;
+    i.fun = prom;
+    return BC(Opcode::stack_promise_, i);
+}
 BC BC::missing(SEXP sym) {
     assert(TYPEOF(sym) == SYMSXP);
     assert(strlen(CHAR(PRINTNAME(sym))));
@@ -232,6 +232,8 @@ class BC {
             return immediate.mkEnvFixedArgs.nargs + 1;
         if (bc == Opcode::popn_)
             return immediate.i;
+        if (bc == Opcode::fused_)
+            return immediate.i + 1;
         return popCount(bc);
     }
     inline size_t pushCount() { return pushCount(bc); }
@@ -270,13 +272,14 @@ class BC {
     bool hasPromargs() const {
         return bc == Opcode::call_implicit_ ||
                bc == Opcode::named_call_implicit_ || bc == Opcode::promise_ ||
-               bc == Opcode::push_code_;
+               bc == Opcode::stack_promise_ || bc == Opcode::push_code_;
     }
 
     void addMyPromArgsTo(std::vector<FunIdx>& proms) {
         switch (bc) {
         case Opcode::push_code_:
         case Opcode::promise_:
+        case Opcode::stack_promise_:
             proms.push_back(immediate.arg_idx);
             break;
         case Opcode::named_call_implicit_:
@@ -361,6 +364,7 @@ BC_NOARGS(V, _)
     inline static BC recordBinop();
     inline static BC recordType();
     inline static BC popn(unsigned n);
+    inline static BC fused(unsigned nargs);
     inline static BC push(SEXP constant);
     inline static BC push(double constant);
     inline static BC push(int constant);
@@ -382,6 +386,7 @@ BC_NOARGS(V, _)
     inline static BC stloc(uint32_t offset);
     inline static BC copyloc(uint32_t target, uint32_t source);
     inline static BC promise(FunIdx prom);
+    inline static BC stackPromise(FunIdx prom);
     inline static BC starg(SEXP sym);
     inline static BC stvarStubbed(unsigned stubbed);
     inline static BC stvar(SEXP sym);
@@ -389,6 +394,7 @@ BC_NOARGS(V, _)
     inline static BC stvarCached(SEXP sym, uint32_t cacheSlot);
     inline static BC stvarSuper(SEXP sym);
     inline static BC missing(SEXP sym);
+    inline static BC checkDependencies(SEXP deps);
     inline static BC alloc(int type);
     inline static BC asint(bool ceil);
     inline static BC pushContext(Jmp);
@@ -646,6 +652,7 @@ BC_NOARGS(V, _)
         case Opcode::ldvar_super_:
         case Opcode::ldvar_noforce_super_:
         case Opcode::ldddvar_:
+        case Opcode::check_dependencies_:
         case Opcode::stvar_:
         case Opcode::starg_:
         case Opcode::stvar_super_:
@@ -684,6 +691,7 @@ BC_NOARGS(V, _)
             memcpy(&immediate.guard_fun_args, pc, sizeof(GuardFunArgs));
             break;
         case Opcode::promise_:
+        case Opcode::stack_promise_:
         case Opcode::push_code_:
             memcpy(&immediate.fun, pc, sizeof(FunIdx));
             break;
@@ -696,6 +704,7 @@ BC_NOARGS(V, _)
             memcpy(&immediate.offset, pc, sizeof(Jmp));
             break;
         case Opcode::popn_:
+        case Opcode::fused_:
         case Opcode::pick_:
         case Opcode::pull_:
         case Opcode::is_:
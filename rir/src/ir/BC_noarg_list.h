@@ -18,7 +18,9 @@
     V(NESTED, asast, asast)                                                    \
     V(NESTED, checkMissing, check_missing)                                     \
     V(NESTED, subassign1_1, subassign1_1)                                      \
+    V(NESTED, subassign1_1Unchecked, subassign1_1_unchecked)                   \
     V(NESTED, subassign2_1, subassign2_1)                                      \
+    V(NESTED, subassign2_1Unchecked, subassign2_1_unchecked)                   \
     V(NESTED, subassign1_2, subassign1_2)                                      \
     V(NESTED, subassign2_2, subassign2_2)                                      \
     V(NESTED, length, length)                                                  \
@@ -26,6 +28,8 @@
     V(NESTED, setNames, set_names)                                             \
     V(NESTED, asbool, asbool)                                                  \
     V(NESTED, endloop, endloop)                                                \
+    V(NESTED, pushLoopContext, push_loop_context)                              \
+    V(NESTED, popLoopContext, pop_loop_context)                                \
     V(NESTED, dup, dup)                                                        \
     V(NESTED, dup2, dup2)                                                      \
     V(NESTED, forSeqSize, for_seq_size)                                        \
@@ -49,6 +53,20 @@
     V(NESTED, eq, eq)                                                          \
     V(NESTED, identicalNoforce, identical_noforce)                             \
     V(NESTED, ne, ne)                                                          \
+    V(NESTED, box, box)                                                        \
+    V(NESTED, unbox, unbox)                                                    \
+    V(NESTED, addUnboxed, add_unboxed)                                         \
+    V(NESTED, subUnboxed, sub_unboxed)                                         \
+    V(NESTED, mulUnboxed, mul_unboxed)                                         \
+    V(NESTED, divUnboxed, div_unboxed)                                         \
+    V(NESTED, ltUnboxed, lt_unboxed)                                           \
+    V(NESTED, gtUnboxed, gt_unboxed)                                           \
+    V(NESTED, leUnboxed, le_unboxed)                                           \
+    V(NESTED, geUnboxed, ge_unboxed)                                           \
+    V(NESTED, eqUnboxed, eq_unboxed)                                           \
+    V(NESTED, neUnboxed, ne_unboxed)                                           \
+    V(NESTED, incUnboxed, inc_unboxed)                                         \
+    V(NESTED, decUnboxed, dec_unboxed)                                         \
     V(NESTED, seq, seq)                                                        \
     V(NESTED, colon, colon)                                                    \
     V(NESTED, setShared, set_shared)                                           \
@@ -64,6 +82,7 @@
     V(NESTED, extract1_1, extract1_1)                                          \
     V(NESTED, extract1_2, extract1_2)                                          \
     V(NESTED, extract2_1, extract2_1)                                          \
+    V(NESTED, extract2_1Unchecked, extract2_1_unchecked)                       \
     V(NESTED, extract2_2, extract2_2)                                          \
     V(NESTED, swap, swap)                                                      \
     V(NESTED, isobj, isobj)                                                    \
@@ -3,6 +3,8 @@
 
 #include <cstring>
 #include <map>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 #include "runtime/Code.h"
@@ -144,7 +146,122 @@ class CodeStream {
         sources.erase(pc + bcSize);
     }
 
+    Opcode* at(unsigned pc) {
+        return reinterpret_cast<Opcode*>(&(*code)[pc]);
+    }
+
+    unsigned skipNops(unsigned pc) {
+        while (pc < pos && *at(pc) == Opcode::nop_)
+            pc++;
+        return pc;
+    }
+
+    // Can a jump land between pc (exclusive) and the instruction at next?
+    bool hasLabelIn(unsigned pc, unsigned next) {
+        auto l = labels.upper_bound(pc);
+        return l != labels.end() && l->first <= next;
+    }
+
+    static bool isBranch(Opcode op) {
+        return op == Opcode::br_ || op == Opcode::brtrue_ ||
+               op == Opcode::brfalse_ || op == Opcode::brobj_;
+    }
+
+    static bool isExit(Opcode op) {
+        return op == Opcode::br_ || op == Opcode::ret_ ||
+               op == Opcode::return_ || op == Opcode::deopt_;
+    }
+
+    // Cleans up the final instruction stream. Instructions are only ever
+    // replaced by nops, thus labels, patchpoints and sources stay valid, the
+    // FunctionWriter compacts them away.
+    void peephole() {
+        std::unordered_map<BC::Label, unsigned> labelPos;
+        for (auto& l : labels)
+            for (auto label : l.second)
+                labelPos[label] = l.first;
+
+        // Jump threading: branches to an unconditional branch go to its
+        // target directly
+        for (auto& p : patchpoints) {
+            if (!isBranch(*at(p.first - sizeof(Opcode))))
+                continue;
+            for (unsigned hops = 0; hops < 8; ++hops) {
+                auto trg = skipNops(labelPos.at(p.second));
+                if (trg == pos || *at(trg) != Opcode::br_)
+                    break;
+                auto next = patchpoints.find(trg + sizeof(Opcode));
+                if (next == patchpoints.end() || next->second == p.second)
+                    break;
+                p.second = next->second;
+            }
+        }
+
+        // Instructions after an exit are dead until the next label which is
+        // still jumped to
+        std::unordered_set<BC::Label> referenced;
+        for (auto& p : patchpoints)
+            referenced.insert(p.second);
+        auto isTarget = [&](unsigned pc) {
+            auto l = labels.find(pc);
+            if (l == labels.end())
+                return false;
+            for (auto label : l->second)
+                if (referenced.count(label))
+                    return true;
+            return false;
+        };
+        bool dead = false;
+        for (unsigned pc = 0; pc < pos; pc += BC::size(at(pc))) {
+            if (isTarget(pc))
+                dead = false;
+            if (dead && *at(pc) != Opcode::nop_)
+                remove(pc);
+            else if (isExit(*at(pc)))
+                dead = true;
+        }
+
+        // Pairs of instructions which cancel out, or where the first one is
+        // overridden by the second one
+        bool changed = true;
+        while (changed) {
+            changed = false;
+            for (unsigned pc = skipNops(0); pc < pos;) {
+                auto next = skipNops(pc + BC::size(at(pc)));
+                if (next == pos)
+                    break;
+                auto a = BC::decodeShallow(at(pc));
+                auto b = BC::decodeShallow(at(next));
+                auto jmp = patchpoints.find(pc + sizeof(Opcode));
+                if (a.is(Opcode::br_) && jmp != patchpoints.end() &&
+                    skipNops(labelPos.at(jmp->second)) == next) {
+                    remove(pc);
+                    changed = true;
+                } else if (hasLabelIn(pc, next)) {
+                    // The second instruction is a jump target
+                } else if ((a.is(Opcode::dup_) && b.is(Opcode::pop_)) ||
+                           (a.is(Opcode::swap_) && b.is(Opcode::swap_)) ||
+                           (a.is(Opcode::push_) && b.is(Opcode::pop_)) ||
+                           (a.is(Opcode::ldloc_) && b.is(Opcode::pop_)) ||
+                           (a.is(Opcode::ldloc_) && b.is(Opcode::stloc_) &&
+                            a.immediate.loc == b.immediate.loc)) {
+                    remove(pc);
+                    remove(next);
+                    changed = true;
+                } else if ((a.is(Opcode::visible_) ||
+                            a.is(Opcode::invisible_)) &&
+                           (b.is(Opcode::visible_) ||
+                            b.is(Opcode::invisible_))) {
+                    remove(pc);
+                    changed = true;
+                }
+                pc = skipNops(next);
+            }
+        }
+    }
+
     Code* finalize(size_t localsCnt, size_t bindingsCnt) {
+        peephole();
         Code* res =
             function.writeCode(ast, &(*code)[0], pos, sources, patchpoints,
                                labels, localsCnt, nops, bindingsCnt);
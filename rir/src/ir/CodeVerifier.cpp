@@ -78,6 +78,7 @@ static Sources hasSources(Opcode bc) {
     case Opcode::extract1_1_:
     case Opcode::extract1_2_:
     case Opcode::extract2_1_:
+    case Opcode::extract2_1_unchecked_:
     case Opcode::extract2_2_:
     case Opcode::seq_:
     case Opcode::add_:
@@ -96,15 +97,29 @@ static Sources hasSources(Opcode bc) {
     case Opcode::ge_:
     case Opcode::eq_:
     case Opcode::ne_:
+    case Opcode::add_unboxed_:
+    case Opcode::sub_unboxed_:
+    case Opcode::mul_unboxed_:
+    case Opcode::div_unboxed_:
+    case Opcode::lt_unboxed_:
+    case Opcode::gt_unboxed_:
+    case Opcode::le_unboxed_:
+    case Opcode::ge_unboxed_:
+    case Opcode::eq_unboxed_:
+    case Opcode::ne_unboxed_:
     case Opcode::colon_:
     case Opcode::subassign1_1_:
+    case Opcode::subassign1_1_unchecked_:
     case Opcode::subassign2_1_:
+    case Opcode::subassign2_1_unchecked_:
     case Opcode::subassign1_2_:
     case Opcode::subassign2_2_:
         return Sources::Required;
 
     case Opcode::inc_:
     case Opcode::dec_:
+    case Opcode::inc_unboxed_:
+    case Opcode::dec_unboxed_:
     case Opcode::identical_noforce_:
     case Opcode::push_:
     case Opcode::ldfun_:
@@ -129,7 +144,9 @@ static Sources hasSources(Opcode bc) {
     case Opcode::named_call_:
     case Opcode::static_call_:
     case Opcode::call_builtin_:
+    case Opcode::fused_:
     case Opcode::promise_:
+    case Opcode::stack_promise_:
     case Opcode::push_code_:
     case Opcode::br_:
     case Opcode::brtrue_:
@@ -172,6 +189,7 @@ static Sources hasSources(Opcode bc) {
     case Opcode::endloop_:
     case Opcode::isobj_:
     case Opcode::isstubenv_:
+    case Opcode::check_dependencies_:
     case Opcode::check_missing_:
     case Opcode::lgl_and_:
     case Opcode::lgl_or_:
@@ -180,12 +198,16 @@ static Sources hasSources(Opcode bc) {
     case Opcode::deopt_:
     case Opcode::pop_context_:
     case Opcode::push_context_:
+    case Opcode::push_loop_context_:
+    case Opcode::pop_loop_context_:
     case Opcode::ceil_:
     case Opcode::floor_:
     case Opcode::clear_binding_cache_:
     case Opcode::ldvar_noforce_stubbed_:
     case Opcode::stvar_stubbed_:
     case Opcode::assert_type_:
+    case Opcode::box_:
+    case Opcode::unbox_:
         return Sources::NotNeeded;
 
     case Opcode::ldloc_:
@@ -348,7 +370,8 @@ void CodeVerifier::verifyFunctionLayout(SEXP sexp, InterpreterInstance* ctx) {
                              "invalid index");
             }
 
-            if (*cptr == Opcode::promise_) {
+            if (*cptr == Opcode::promise_ ||
+                *cptr == Opcode::stack_promise_) {
                 unsigned* promidx = reinterpret_cast<Immediate*>(cptr + 1);
                 objs.push_back(c->getPromise(*promidx));
             }
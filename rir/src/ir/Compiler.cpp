@@ -1169,7 +1169,10 @@ SEXP Compiler::finalize() {
             Code* compiled = compilePromise(ctx, *arg);
             function.addDefaultArg(compiled);
         }
-        signature.pushDefaultArgument();
+        if (arg.tag() == R_DotsSymbol)
+            signature.pushDotsArgument();
+        else
+            signature.pushDefaultArgument();
     }
 
     ctx.push(exp, closureEnv);
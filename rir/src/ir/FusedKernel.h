@@ -0,0 +1,36 @@
+#ifndef RIR_FUSED_KERNEL_H
+#define RIR_FUSED_KERNEL_H
+
+namespace rir {
+
+/*
+ * Operations of a fused elementwise kernel, see fused_. A kernel is an
+ * INTSXP holding a postfix program: Arg is followed by the index of the
+ * operand it loads, all other operations take their inputs from the kernel
+ * stack. Comparisons may only be the last operation.
+ */
+enum class FusedOp : int {
+    Arg,
+    Add,
+    Sub,
+    Mul,
+    Div,
+    Lt,
+    Gt,
+    Le,
+    Ge,
+    Eq,
+    Ne,
+    Sqrt,
+    Exp,
+    Abs,
+};
+
+// Bounds of kernels we generate, such that the interpreter can evaluate them
+// on a fixed size stack
+static const unsigned MAX_FUSED_OPERANDS = 8;
+static const unsigned MAX_FUSED_DEPTH = 8;
+
+} // namespace rir
+
+#endif
@@ -221,6 +221,14 @@ DEF_INSTR(isfun_, 0, 1, 1, 1)
  */
 DEF_INSTR(promise_, 1, 1, 1, 1)
 
+/**
+ * stack_promise_:: like promise_, for an evaluated promise which is only
+ * passed to a static call and does not escape the callee. The promise is not
+ * allocated on the R heap, static_call_ copies it there if the callee turns
+ * out to be a different version.
+ */
+DEF_INSTR(stack_promise_, 1, 1, 1, 1)
+
 /**
  * force_:: pop from objet stack, evaluate, push promise's value
  */
@@ -319,6 +327,48 @@ DEF_INSTR(ne_, 0, 2, 1, 0)
 
 DEF_INSTR(identical_noforce_, 0, 2, 1, 0)
 
+/**
+ * box_:: turn the unboxed scalar tos into an R value
+ */
+DEF_INSTR(box_, 0, 1, 1, 1)
+
+/**
+ * unbox_:: turn the scalar integer, real or logical tos into an unboxed
+ * value. Unboxed values live in stack cells tagged with their type.
+ */
+DEF_INSTR(unbox_, 0, 1, 1, 1)
+
+/**
+ * add_unboxed_:: like add_, but on two unboxed scalars. Pushes an unboxed
+ * result.
+ */
+DEF_INSTR(add_unboxed_, 0, 2, 1, 1)
+DEF_INSTR(sub_unboxed_, 0, 2, 1, 1)
+DEF_INSTR(mul_unboxed_, 0, 2, 1, 1)
+DEF_INSTR(div_unboxed_, 0, 2, 1, 1)
+DEF_INSTR(lt_unboxed_, 0, 2, 1, 1)
+DEF_INSTR(gt_unboxed_, 0, 2, 1, 1)
+DEF_INSTR(le_unboxed_, 0, 2, 1, 1)
+DEF_INSTR(ge_unboxed_, 0, 2, 1, 1)
+DEF_INSTR(eq_unboxed_, 0, 2, 1, 1)
+DEF_INSTR(ne_unboxed_, 0, 2, 1, 1)
+
+/**
+ * inc_unboxed_ :: increment unboxed tos integer
+ */
+DEF_INSTR(inc_unboxed_, 0, 1, 1, 1)
+
+/**
+ * dec_unboxed_ :: decrement unboxed tos integer
+ */
+DEF_INSTR(dec_unboxed_, 0, 1, 1, 1)
+
+/**
+ * fused_:: pop a kernel and n operands, evaluate the elementwise kernel over
+ *          the operands (see FusedKernel.h) and push the result
+ */
+DEF_INSTR(fused_, 1, -1, 1, 0)
+
 /**
  * not_:: unary negation operator !
  */
@@ -375,6 +425,13 @@ DEF_INSTR(isobj_, 0, 1, 1, 1)
  */
 DEF_INSTR(isstubenv_, 0, 1, 1, 1)
 
+/**
+ * check_dependencies_:: push T if all bindings in the immediate dependency
+ * vector (see Function::dependencies) are unchanged, F otherwise. PIR emits
+ * one vector per call site, holding only the binding of the callee.
+ */
+DEF_INSTR(check_dependencies_, 1, 0, 1, 0)
+
 /**
  * missing_ :: check if symb is missing
  */
@@ -426,6 +483,12 @@ DEF_INSTR(extract1_2_, 0, 3, 1, 1)
  */
 DEF_INSTR(subassign1_1_, 0, 3, 1, 1)
 
+/**
+ * subassign1_1_unchecked_ :: like subassign1_1_, but b has to be a numeric
+ * scalar within the bounds of a. Only emitted by PIR.
+ */
+DEF_INSTR(subassign1_1_unchecked_, 0, 3, 1, 1)
+
 /**
  * subassign1_2_ :: a[b,c] <- d
  *
@@ -442,6 +505,14 @@ DEF_INSTR(subassign1_2_, 0, 4, 1, 1)
  */
 DEF_INSTR(extract2_1_, 0, 2, 1, 1)
 
+/**
+ * extract2_1_unchecked_:: like extract2_1_, but a has to be a non-object
+ * logical, integer, real or generic vector and b a numeric scalar within its
+ * bounds. Only emitted by PIR, after proving these properties. Attributes are
+ * still checked, with attributes it falls back to the default [[.
+ */
+DEF_INSTR(extract2_1_unchecked_, 0, 2, 1, 1)
+
 /**
  * extract2_2_:: do a[[b,c]], where a, b and c are on the stack and a is no obj
  */
@@ -458,6 +529,12 @@ DEF_INSTR(extract2_2_, 0, 3, 1, 1)
  */
 DEF_INSTR(subassign2_1_, 0, 3, 1, 1)
 
+/**
+ * subassign2_1_unchecked_ :: like subassign2_1_, but b has to be a numeric
+ * scalar within the bounds of a. Only emitted by PIR.
+ */
+DEF_INSTR(subassign2_1_unchecked_, 0, 3, 1, 1)
+
 /**
  * subassign2_2_ :: a[[b,c]] <- d
  *
@@ -542,6 +619,22 @@ DEF_INSTR(beginloop_, 1, 0, 0, 0)
  */
 DEF_INSTR(endloop_, 0, 0, 0, 0)
 
+/**
+ * push_loop_context_:: runs the following code in a loop context, until a
+ * matching pop_loop_context_. Pushes nil. After a non-local break or next the
+ * code after this instruction runs again, in the same context, with the symbol
+ * `break` or `next` pushed instead. Only emitted by PIR, the current env must
+ * be materialized.
+ */
+DEF_INSTR(push_loop_context_, 0, 0, 1, 0)
+
+/**
+ * pop_loop_context_:: pops the status of the current loop context and leaves
+ * it, execution continues after this instruction. A loop context can have
+ * several pops, eg. at the end of the loop and before returns.
+ */
+DEF_INSTR(pop_loop_context_, 0, 1, 0, 0)
+
 /**
  * return_ :: return instruction. Non-local return instruction as opposed to
  * ret_.
@@ -90,6 +90,16 @@ struct Assumptions {
     TYPE_ASSUMPTIONS(SimpleReal);
 #undef TYPE_ASSUMPTIONS
 
+    // Drop all per argument assumptions, eg. after the args were reordered
+    RIR_INLINE void clearArgTypes() {
+        for (size_t i = 0; i < NUM_ARGS; ++i) {
+            flags.reset(EagerAssumptions[i]);
+            flags.reset(NotObjAssumptions[i]);
+            flags.reset(SimpleIntAssumptions[i]);
+            flags.reset(SimpleRealAssumptions[i]);
+        }
+    }
+
     RIR_INLINE uint8_t numMissing() const { return missing; }
 
     RIR_INLINE void numMissing(long i) {
@@ -1,5 +1,6 @@
 #include "Function.h"
 #include "R/Serialize.h"
+#include "interpreter/cache.h"
 
 namespace rir {
 
@@ -11,7 +12,7 @@ Function* Function::deserialize(SEXP refTable, R_inpstream_t inp) {
     Function* fun = new (payload) Function(functionSize, NULL, {}, sig);
     fun->numArgs = InInteger(inp);
     fun->info.gc_area_length += fun->numArgs;
-    for (unsigned i = 0; i < fun->numArgs + 1; i++) {
+    for (unsigned i = 0; i < fun->numArgs + NUM_PTRS; i++) {
         fun->setEntry(i, R_NilValue);
     }
     PROTECT(store);
@@ -20,6 +21,19 @@ Function* Function::deserialize(SEXP refTable, R_inpstream_t inp) {
     fun->body(body);
     PROTECT(body);
     int protectCount = 2;
+    // Binding cells cannot be serialized, they are looked up again on the
+    // first check
+    size_t numDependencies = InInteger(inp);
+    if (numDependencies) {
+        SEXP deps = Rf_allocVector(VECSXP, numDependencies * DEPENDENCY_FIELDS);
+        fun->dependencies(deps);
+        for (size_t i = 0; i < numDependencies * DEPENDENCY_FIELDS;
+             i += DEPENDENCY_FIELDS) {
+            SET_VECTOR_ELT(deps, i, ReadItem(refTable, inp));
+            SET_VECTOR_ELT(deps, i + 1, ReadItem(refTable, inp));
+            SET_VECTOR_ELT(deps, i + 2, ReadItem(refTable, inp));
+        }
+    }
     for (unsigned i = 0; i < fun->numArgs; i++) {
         if ((bool)InInteger(inp)) {
             SEXP arg = Code::deserialize(refTable, inp)->container();
@@ -39,6 +53,13 @@ void Function::serialize(SEXP refTable, R_outpstream_t out) const {
     OutInteger(out, numArgs);
     HashAdd(container(), refTable);
     body()->serialize(refTable, out);
+    SEXP deps = dependencies();
+    OutInteger(out, Rf_length(deps) / DEPENDENCY_FIELDS);
+    for (int i = 0; i < Rf_length(deps); i += DEPENDENCY_FIELDS) {
+        WriteItem(VECTOR_ELT(deps, i), refTable, out);
+        WriteItem(VECTOR_ELT(deps, i + 1), refTable, out);
+        WriteItem(VECTOR_ELT(deps, i + 2), refTable, out);
+    }
     for (unsigned i = 0; i < numArgs; i++) {
         Code* arg = defaultArg(i);
         OutInteger(out, (int)(arg != NULL));
@@ -47,6 +68,25 @@ void Function::serialize(SEXP refTable, R_outpstream_t out) const {
     }
 }
 
+bool Function::dependenciesValid(SEXP deps) {
+    for (int i = 0; i < Rf_length(deps); i += DEPENDENCY_FIELDS) {
+        SEXP cell = VECTOR_ELT(deps, i + 3);
+        if (cell == R_NilValue) {
+            R_varloc_t loc = R_findVarLocInFrame(VECTOR_ELT(deps, i),
+                                                 VECTOR_ELT(deps, i + 1));
+            if (R_VARLOC_IS_NULL(loc))
+                return false;
+            cell = loc.cell;
+            SET_VECTOR_ELT(deps, i + 3, cell);
+        }
+        // Bindings of base live in the symbol
+        SEXP value = TYPEOF(cell) == SYMSXP ? SYMVALUE(cell) : CAR(cell);
+        if (!BINDING_IS_LOCKED(cell) || value != VECTOR_ELT(deps, i + 2))
+            return false;
+    }
+    return true;
+}
+
 void Function::disassemble(std::ostream& out) {
     body()->disassemble(out);
 }
@@ -20,6 +20,12 @@ typedef SEXP FunctionSEXP;
 // magic in his vector too...
 #define FUNCTION_MAGIC (unsigned)0xca11ab1e
 
+/** Machine code for the body of a Function, see pir_2_native. Reads the
+ *  arguments, which must be plain scalar reals, and returns 0 after storing
+ *  the result, or 1 if the body has to run instead.
+ */
+typedef int (*NativeCode)(const double* args, double* result);
+
 /** A RIR function represents GNU R function.
  *
  *  Each function start with a header and some metadata. Then there are
@@ -39,7 +45,8 @@ struct Function : public RirRuntimeObject<Function, FUNCTION_MAGIC> {
     friend class FunctionCodeIterator;
     friend class ConstFunctionCodeIterator;
 
-    static constexpr size_t NUM_PTRS = 1;
+    static constexpr size_t NUM_PTRS = 3;
+    static constexpr size_t MAX_NATIVE_ARGS = 8;
 
     Function(size_t functionSize, SEXP body_,
              const std::vector<SEXP>& defaultArgs,
@@ -54,11 +61,38 @@ struct Function : public RirRuntimeObject<Function, FUNCTION_MAGIC> {
         for (size_t i = 0; i < numArgs; ++i)
             setEntry(NUM_PTRS + i, defaultArgs[i]);
         body(body_);
+        dependencies(R_NilValue);
+        nativeCode(R_NilValue);
     }
 
     Code* body() const { return Code::unpack(getEntry(0)); }
     void body(SEXP body) { setEntry(0, body); }
 
+    // Optimized code does not guard calls to functions bound in locked
+    // bindings of locked (namespace) environments. Instead the Function
+    // depends on those bindings. They are stored as a vector of
+    // DEPENDENCY_FIELDS entries each: environment, symbol, value and the
+    // binding cell (nil until it is looked up).
+    static constexpr size_t DEPENDENCY_FIELDS = 4;
+    SEXP dependencies() const { return getEntry(1); }
+    void dependencies(SEXP deps) { setEntry(1, deps); }
+    // Checks that all bindings this Function depends on are still locked and
+    // hold the same value. Only then it may be called. Running frames check
+    // a vector with just the one binding before calling through it (see
+    // check_dependencies_).
+    bool dependenciesValid() { return dependenciesValid(dependencies()); }
+    static bool dependenciesValid(SEXP deps);
+
+    // The native code is owned by an external pointer (see Pir2Native), the
+    // address is cached in nativeCodeAddr. It is not serialized.
+    void nativeCode(SEXP handle) {
+        setEntry(2, handle);
+        nativeCodeAddr = handle == R_NilValue
+                             ? nullptr
+                             : reinterpret_cast<NativeCode>(
+                                   R_ExternalPtrAddr(handle));
+    }
+
     static Function* deserialize(SEXP refTable, R_inpstream_t inp);
     void serialize(SEXP refTable, R_outpstream_t out) const;
     void disassemble(std::ostream&);
@@ -83,13 +117,15 @@ struct Function : public RirRuntimeObject<Function, FUNCTION_MAGIC> {
 
     unsigned numArgs;
 
+    NativeCode nativeCodeAddr = nullptr;
+
     const FunctionSignature& signature() const { return signature_; }
 
   private:
     FunctionSignature signature_; /// pointer to this version's signature
 
     // !!! SEXPs traceable by the GC must be declared here !!!
-    // locals contains: origin, next, body
+    // locals contains: body, dependencies, native code
     CodeSEXP locals[NUM_PTRS];
     CodeSEXP defaultArg_[];
 };
@@ -68,12 +68,21 @@ struct FunctionSignature {
         if (numArguments < MAX_TRACKED_ARGS)
             arguments[numArguments] = ArgumentType();
         numArguments++;
+        hasDotsFormals = false;
+    }
+
+    // The `...` formal. Optimized versions only support it as the last formal,
+    // thus hasDotsFormals is cleared again if another formal follows.
+    void pushDotsArgument() {
+        pushDefaultArgument();
+        hasDotsFormals = true;
     }
 
     void pushArgument(ArgumentType arg) {
         if (numArguments < MAX_TRACKED_ARGS)
             arguments[numArguments] = arg;
         numArguments++;
+        hasDotsFormals = false;
     }
 
     static FunctionSignature deserialize(SEXP refTable, R_inpstream_t inp) {
@@ -85,6 +94,9 @@ struct FunctionSignature {
         for (unsigned i = 0; i < numArgs; i++) {
             sig.pushArgument(ArgumentType::deserialize(refTable, inp));
         }
+        sig.hasDotsFormals = InInteger(inp);
+        sig.nonEscapingArgs = InInteger(inp);
+        sig.contextFree = InInteger(inp);
         return sig;
     }
 
@@ -98,6 +110,9 @@ struct FunctionSignature {
                 (i < MAX_TRACKED_ARGS) ? arguments[i] : ArgumentType();
             arg.serialize(refTable, out);
         }
+        OutInteger(out, hasDotsFormals);
+        OutInteger(out, nonEscapingArgs);
+        OutInteger(out, contextFree);
     }
 
     void print(std::ostream& out = std::cout) const {
@@ -119,6 +134,13 @@ struct FunctionSignature {
             out << "optimized code ";
         if (envCreation == Environment::CallerProvided)
             out << "needsEnv ";
+        if (hasDotsFormals)
+            out << "dots ";
+        if (nonEscapingArgs)
+            out << "nonEscaping: " << std::hex << nonEscapingArgs << std::dec
+                << " ";
+        if (contextFree)
+            out << "contextFree ";
         if (!assumptions.empty()) {
             out << "| assumptions: [" << assumptions << "]";
         }
@@ -143,6 +165,14 @@ struct FunctionSignature {
     const OptimizationLevel optimization;
     ArgumentType arguments[MAX_TRACKED_ARGS];
     unsigned numArguments = 0;
+    // The last formal is `...`
+    bool hasDotsFormals = false;
+    // Bitset of the arguments whose promise does not outlive the call, see
+    // stack_promise_
+    unsigned nonEscapingArgs = 0;
+    static const unsigned MAX_NON_ESCAPING_ARGS = 32;
+    // The body never needs an RCNTXT, the interpreter calls it without one
+    bool contextFree = false;
     const Assumptions assumptions;
 };
 
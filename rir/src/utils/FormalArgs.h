@@ -37,6 +37,10 @@ class FormalArgs {
 
     bool hasDots() const { return hasDots_; }
 
+    bool hasTrailingDots() const {
+        return hasDots_ && names_.back() == R_DotsSymbol;
+    }
+
     size_t nargs() const { return names_.size(); }
 
     SEXP original() const { return original_; }